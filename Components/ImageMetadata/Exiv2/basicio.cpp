@@ -0,0 +1,943 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      basicio.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#else
+# ifdef _MSC_VER
+#  include <config_win32.h>
+# endif
+#endif
+
+#include "basicio.hpp"
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+#include <cstring>
+#include <cstdio>                               // for remove, rename
+#include <cassert>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef _MSC_VER
+# define S_ISREG(m)      (((m) & S_IFMT) == S_IFREG)
+#endif
+#ifndef _MSC_VER
+# include <sys/mman.h>                          // for mmap, munmap
+# include <unistd.h>                            // for getpid, close
+#else
+# include <process.h>                           // for getpid
+# include <io.h>                                // for open, close
+#endif
+// Linux can copy between files in the kernel
+#if defined(__linux__) && !defined(HAVE_SENDFILE)
+# define HAVE_SENDFILE 1
+#endif
+#if    defined(__linux__) && defined(__GLIBC__) && !defined(HAVE_COPY_FILE_RANGE) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+# define HAVE_COPY_FILE_RANGE 1
+#endif
+#ifdef HAVE_SENDFILE
+# include <sys/sendfile.h>
+#endif
+// Only files on local file systems are mapped
+#if defined(__APPLE__) || defined(__FreeBSD__)
+# include <sys/param.h>
+# include <sys/mount.h>                         // for fstatfs, MNT_LOCAL
+#elif defined(__linux__)
+# include <sys/vfs.h>                           // for fstatfs
+#endif
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    /*
+      Return true if the file of descriptor fd is on a local file system.
+      Return false if it is on a network file system or if this can not be
+      determined.
+     */
+    bool isLocalFile(int fd);
+
+    /*
+      Read at most count bytes at offset of the file of descriptor fd into
+      buf, without moving the file position. Return the number of bytes
+      read or -1 if failure.
+     */
+    long readAt(int fd, Exiv2::byte* buf, long count, long offset);
+
+}
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    FileIo::FileIo(const std::string& path)
+        : path_(path), fp_(0), opMode_(opSeek), isTemp_(false)
+    {
+    }
+
+    FileIo::~FileIo()
+    {
+        close();
+        if (isTemp_) std::remove(path_.c_str());
+    }
+
+    int FileIo::switchMode(OpMode opMode)
+    {
+        assert(fp_ != 0);
+        if (opMode_ == opMode) return 0;
+        OpMode oldOpMode = opMode_;
+        opMode_ = opMode;
+
+        bool reopen = true;
+        std::string mode = "r+b";
+
+        switch(opMode) {
+        case opRead:
+            // Flush if current mode allows reading, else reopen (in mode "r+b"
+            // as in this case we know that we can write to the file)
+            if (   openMode_[0] == 'r'
+                || openMode_.substr(0, 2) == "w+"
+                || openMode_.substr(0, 2) == "a+") reopen = false;
+            break;
+        case opWrite:
+            // Flush if current mode allows writing, else reopen
+            if (   openMode_.substr(0, 2) == "r+"
+                || openMode_[0] == 'w'
+                || openMode_[0] == 'a') reopen = false;
+            break;
+        case opSeek:
+            reopen = false;
+            break;
+        }
+
+        if (!reopen) {
+            // Don't do anything when switching _from_ opSeek mode; we
+            // flush when switching _to_ opSeek.
+            if (oldOpMode == opSeek) return 0;
+
+            // Flush. On msvcrt fflush does not do the job
+            std::fseek(fp_, 0, SEEK_CUR);
+            return 0;
+        }
+
+        // Reopen the file
+        long offset = std::ftell(fp_);
+        if (offset == -1) return -1;
+        if (open(mode) != 0) return 1;
+        return std::fseek(fp_, offset, SEEK_SET);
+    } // FileIo::switchMode
+
+    long FileIo::write(const byte* data, long wcount)
+    {
+        assert(fp_ != 0);
+        if (switchMode(opWrite) != 0) return 0;
+        return (long)std::fwrite(data, 1, wcount, fp_);
+    }
+
+    long FileIo::write(BasicIo& src)
+    {
+        assert(fp_ != 0);
+        if (static_cast<BasicIo*>(this) == &src) return 0;
+        if (!src.isopen()) return 0;
+        if (switchMode(opWrite) != 0) return 0;
+
+        // Files are copied by the kernel where possible
+        long writeTotal = 0;
+        if (dynamic_cast<FileIo*>(&src) || dynamic_cast<MmapIo*>(&src)) {
+            writeTotal = copyFile(src);
+        }
+
+        // Memory resident sources are written in one go
+        const byte* pData = src.data();
+        if (pData) {
+            const long pos = src.tell();
+            const long wcount = src.size() - pos;
+            if (wcount <= 0) return writeTotal;
+            long writeCount = (long)std::fwrite(pData + pos, 1, wcount, fp_);
+            src.seek(writeCount, BasicIo::cur);
+            return writeTotal + writeCount;
+        }
+
+        byte buf[4096];
+        long readCount = 0;
+        long writeCount = 0;
+        while ((readCount = src.read(buf, sizeof(buf)))) {
+            writeTotal += writeCount = (long)std::fwrite(buf, 1, readCount, fp_);
+            if (writeCount != readCount) {
+                // try to reset back to where write stopped
+                src.seek(writeCount-readCount, BasicIo::cur);
+                break;
+            }
+        }
+
+        return writeTotal;
+    } // FileIo::write
+
+    long FileIo::copyFile(BasicIo& src)
+    {
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE)
+        const long pos = src.tell();
+        const long count = src.size() - pos;
+        if (count <= 0) return 0;
+        int fdIn = ::open(src.path().c_str(), O_RDONLY);
+        if (fdIn == -1) return 0;
+        // The kernel writes to the descriptor, not the stream
+        if (std::fflush(fp_) != 0) {
+            ::close(fdIn);
+            return 0;
+        }
+        const int fdOut = fileno(fp_);
+        off_t offIn = pos;
+        off_t offOut = std::ftell(fp_);
+        long copyTotal = 0;
+        while (copyTotal < count) {
+            ssize_t copyCount = -1;
+#ifdef HAVE_COPY_FILE_RANGE
+            // May share the data blocks on file systems with reflinks
+            copyCount = copy_file_range(fdIn, &offIn, fdOut, &offOut,
+                                        count - copyTotal, 0);
+#endif
+#ifdef HAVE_SENDFILE
+            if (copyCount <= 0) {
+                if (::lseek(fdOut, offOut, SEEK_SET) != offOut) break;
+                copyCount = sendfile(fdOut, fdIn, &offIn, count - copyTotal);
+                if (copyCount > 0) offOut += copyCount;
+            }
+#endif
+            if (copyCount <= 0) break;
+            copyTotal += copyCount;
+        }
+        ::close(fdIn);
+        // Continue writing after the copied data
+        if (std::fseek(fp_, offOut, SEEK_SET) != 0) return 0;
+        src.seek(copyTotal, BasicIo::cur);
+        return copyTotal;
+#else
+        return 0;
+#endif
+    } // FileIo::copyFile
+
+    int FileIo::transfer(BasicIo& src)
+    {
+        const bool wasOpen = (fp_ != 0);
+        const std::string lastMode(openMode_);
+
+        FileIo *fileIo = dynamic_cast<FileIo*>(&src);
+        if (fileIo) {
+            // Optimization if this is another instance of FileIo
+            close();
+            fileIo->close();
+            // Workaround for MSVCRT rename that does not overwrite existing files
+            if (std::remove(path_.c_str()) != 0) return -4;
+            if (std::rename(fileIo->path_.c_str(), path_.c_str()) == -1) return -4;
+            fileIo->isTemp_ = false;
+        }
+        else {
+            // Generic handling, reopen both to reset to start
+            if (open("w+b") != 0) return -4;
+            if (src.open() != 0) return -4;
+            write(src);
+            src.close();
+            if (error()) return -4;
+        }
+
+        if (wasOpen) {
+            if (open(lastMode) != 0) return -4;
+        }
+        else close();
+
+        return 0;
+    } // FileIo::transfer
+
+    int FileIo::putb(byte data)
+    {
+        assert(fp_ != 0);
+        if (switchMode(opWrite) != 0) return EOF;
+        return putc(data, fp_);
+    }
+
+    int FileIo::seek(long offset, Position pos)
+    {
+        assert(fp_ != 0);
+        int fileSeek;
+        if (pos == BasicIo::cur) {
+            fileSeek = SEEK_CUR;
+        }
+        else if (pos == BasicIo::beg) {
+            fileSeek = SEEK_SET;
+        }
+        else {
+            assert(pos == BasicIo::end);
+            fileSeek = SEEK_END;
+        }
+
+        if (switchMode(opSeek) != 0) return 1;
+        return std::fseek(fp_, offset, fileSeek);
+    }
+
+    long FileIo::tell() const
+    {
+        assert(fp_ != 0);
+        return std::ftell(fp_);
+    }
+
+    long FileIo::size() const
+    {
+        // Flush and commit only if the file is open for writing
+        if (fp_ != 0 && (openMode_[0] != 'r' || openMode_[1] == '+')) {
+            std::fflush(fp_);
+        }
+
+        struct stat buf;
+        int ret = -1;
+        if (fp_ != 0) {
+            ret = fstat(fileno(fp_), &buf);
+        }
+        else {
+            ret = stat(path_.c_str(), &buf);
+        }
+        if (ret != 0) return -1;
+        return buf.st_size;
+    }
+
+    int FileIo::open()
+    {
+        // Default open is in read-only binary mode
+        return open("rb");
+    }
+
+    int FileIo::open(const std::string& mode)
+    {
+        close();
+        openMode_ = mode;
+        opMode_ = opSeek;
+        fp_ = std::fopen(path_.c_str(), mode.c_str());
+        if (!fp_) return 1;
+        return 0;
+    }
+
+    bool FileIo::isopen() const
+    {
+        return fp_ != 0;
+    }
+
+    int FileIo::close()
+    {
+        if (fp_ != 0) {
+            std::fclose(fp_);
+            fp_= 0;
+        }
+        return 0;
+    }
+
+    DataBuf FileIo::read(long rcount)
+    {
+        assert(fp_ != 0);
+        DataBuf buf(rcount);
+        long readCount = read(buf.pData_, buf.size_);
+        buf.size_ = readCount;
+        return buf;
+    }
+
+    long FileIo::read(byte* buf, long rcount)
+    {
+        assert(fp_ != 0);
+        if (switchMode(opRead) != 0) return 0;
+        return (long)std::fread(buf, 1, rcount, fp_);
+    }
+
+    int FileIo::getb()
+    {
+        assert(fp_ != 0);
+        if (switchMode(opRead) != 0) return EOF;
+        return getc(fp_);
+    }
+
+    int FileIo::error() const
+    {
+        return fp_ != 0 ? ferror(fp_) : 0;
+    }
+
+    bool FileIo::eof() const
+    {
+        assert(fp_ != 0);
+        return feof(fp_) != 0;
+    }
+
+    std::string FileIo::path() const
+    {
+        return path_;
+    }
+
+    BasicIo::AutoPtr FileIo::temporary() const
+    {
+        pid_t pid = getpid();
+        FileIo* fileIo = new FileIo(path_ + toString(pid));
+        BasicIo::AutoPtr basicIo(fileIo);
+        if (fileIo->open("w+b") == 0) {
+            fileIo->isTemp_ = true;
+        }
+        return basicIo;
+    }
+
+    MmapIo::MmapIo(const std::string& path)
+        : path_(path), data_(0), size_(0), idx_(0), fd_(-1), readFd_(-1),
+          loaded_(0), isOpen_(false), isMapped_(false), eof_(false)
+    {
+    }
+
+    MmapIo::~MmapIo()
+    {
+        close();
+    }
+
+    int MmapIo::open()
+    {
+        idx_ = 0;
+        eof_ = false;
+        if (isOpen_) return 0;
+
+        int fd = ::open(path_.c_str(), O_RDONLY);
+        if (fd == -1) return 1;
+        struct stat buf;
+        if (fstat(fd, &buf) != 0 || !S_ISREG(buf.st_mode)) {
+            ::close(fd);
+            return 1;
+        }
+        size_ = buf.st_size;
+
+        // Files on network file systems are not mapped, they can be
+        // truncated by other clients while they are mapped
+        if (size_ > 0 && isLocalFile(fd)) {
+#ifndef _MSC_VER
+            void* map = mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                data_ = static_cast<byte*>(map);
+                isMapped_ = true;
+            }
+#endif
+        }
+        if (isMapped_) {
+            ::close(fd);
+            loaded_ = size_;
+        }
+        else {
+            // The file is read into a buffer as far as it is used
+            if (size_ > 0) data_ = new byte[size_];
+            readFd_ = fd;
+            loaded_ = 0;
+        }
+        isOpen_ = true;
+        return 0;
+    } // MmapIo::open
+
+    int MmapIo::close()
+    {
+        if (!isOpen_) return 0;
+        if (fd_ != -1) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        if (readFd_ != -1) {
+            ::close(readFd_);
+            readFd_ = -1;
+        }
+#ifndef _MSC_VER
+        if (isMapped_) {
+            munmap(data_, size_);
+            data_ = 0;
+        }
+#endif
+        delete[] data_;
+        data_ = 0;
+        size_ = 0;
+        idx_ = 0;
+        loaded_ = 0;
+        isMapped_ = false;
+        isOpen_ = false;
+        return 0;
+    }
+
+    long MmapIo::load(long end) const
+    {
+        if (loaded_ >= end) return loaded_;
+        // Read ahead in growing chunks, the metadata is near the start
+        long want = loaded_ < 0x10000 ? 0x10000 : 2 * loaded_;
+        if (want < end) want = end;
+        if (want > size_) want = size_;
+        while (loaded_ < want) {
+            long readCount = readAt(readFd_, data_ + loaded_,
+                                    want - loaded_, loaded_);
+            if (readCount <= 0) break;
+            loaded_ += readCount;
+        }
+        return loaded_;
+    } // MmapIo::load
+
+    long MmapIo::write(const byte* data, long wcount)
+    {
+        assert(isOpen_);
+        // The file can not grow while it is mapped
+        if (wcount > size_ - idx_) wcount = size_ - idx_;
+        if (wcount <= 0) return 0;
+        if (fd_ == -1) {
+            fd_ = ::open(path_.c_str(), O_WRONLY);
+            if (fd_ == -1) return 0;
+        }
+        if (::lseek(fd_, idx_, SEEK_SET) != idx_) return 0;
+        long writeTotal = 0;
+        while (writeTotal < wcount) {
+            long writeCount = (long)::write(fd_, data + writeTotal,
+                                            wcount - writeTotal);
+            if (writeCount <= 0) break;
+            writeTotal += writeCount;
+        }
+        // A shared mapping sees the change, a buffered copy is updated
+        if (!isMapped_) memcpy(data_ + idx_, data, writeTotal);
+        idx_ += writeTotal;
+        return writeTotal;
+    }
+
+    long MmapIo::write(BasicIo& src)
+    {
+        assert(isOpen_);
+        if (static_cast<BasicIo*>(this) == &src) return 0;
+        if (!src.isopen()) return 0;
+
+        // Memory resident sources are written in one go
+        const byte* pData = src.data();
+        if (pData) {
+            const long pos = src.tell();
+            long writeTotal = write(pData + pos, src.size() - pos);
+            src.seek(writeTotal, BasicIo::cur);
+            return writeTotal;
+        }
+
+        byte buf[4096];
+        long readCount = 0;
+        long writeTotal = 0;
+        while ((readCount = src.read(buf, sizeof(buf)))) {
+            long writeCount = write(buf, readCount);
+            writeTotal += writeCount;
+            if (writeCount != readCount) {
+                // try to reset back to where write stopped
+                src.seek(writeCount-readCount, BasicIo::cur);
+                break;
+            }
+        }
+        return writeTotal;
+    }
+
+    int MmapIo::putb(byte data)
+    {
+        if (write(&data, 1) != 1) return EOF;
+        return data;
+    }
+
+    DataBuf MmapIo::read(long rcount)
+    {
+        DataBuf buf(rcount);
+        long readCount = read(buf.pData_, buf.size_);
+        buf.size_ = readCount;
+        return buf;
+    }
+
+    long MmapIo::read(byte* buf, long rcount)
+    {
+        assert(isOpen_);
+        long avail = load(idx_ + rcount) - idx_;
+        long allow = rcount < avail ? rcount : avail;
+        if (allow > 0) memcpy(buf, &data_[idx_], allow);
+        if (allow < 0) allow = 0;
+        idx_ += allow;
+        if (rcount > avail) eof_ = true;
+        return allow;
+    }
+
+    int MmapIo::getb()
+    {
+        assert(isOpen_);
+        if (idx_ >= load(idx_ + 1)) {
+            eof_ = true;
+            return EOF;
+        }
+        return data_[idx_++];
+    }
+
+    int MmapIo::transfer(BasicIo& src)
+    {
+        const bool wasOpen = isOpen_;
+        close();
+        FileIo fileIo(path_);
+        int rc = fileIo.transfer(src);
+        if (rc == 0 && wasOpen) {
+            if (open() != 0) rc = -4;
+        }
+        return rc;
+    }
+
+    int MmapIo::seek(long offset, Position pos)
+    {
+        assert(isOpen_);
+        long newIdx = 0;
+
+        if (pos == BasicIo::cur ) {
+            newIdx = idx_ + offset;
+        }
+        else if (pos == BasicIo::beg) {
+            newIdx = offset;
+        }
+        else {
+            assert(pos == BasicIo::end);
+            newIdx = size_ + offset;
+        }
+
+        if (newIdx < 0 || newIdx > size_) return 1;
+        idx_ = newIdx;
+        eof_ = false;
+        return 0;
+    }
+
+    long MmapIo::tell() const
+    {
+        return idx_;
+    }
+
+    long MmapIo::size() const
+    {
+        if (isOpen_) return size_;
+        struct stat buf;
+        if (stat(path_.c_str(), &buf) != 0) return -1;
+        return buf.st_size;
+    }
+
+    bool MmapIo::isopen() const
+    {
+        return isOpen_;
+    }
+
+    int MmapIo::error() const
+    {
+        return 0;
+    }
+
+    bool MmapIo::eof() const
+    {
+        return eof_;
+    }
+
+    std::string MmapIo::path() const
+    {
+        return path_;
+    }
+
+    const byte* MmapIo::data() const
+    {
+        // A file which is not mapped is read completely
+        if (load(size_) < size_) return 0;
+        return data_;
+    }
+
+    BasicIo::AutoPtr MmapIo::temporary() const
+    {
+        FileIo fileIo(path_);
+        return fileIo.temporary();
+    }
+
+    MemIo::MemIo()
+        : data_(0), idx_(0), size_(0),
+          sizeAlloced_(0), isMalloced_(false), eof_(false)
+    {
+    }
+
+    MemIo::MemIo(const byte* data, long size)
+        : data_(const_cast<byte*>(data)), idx_(0), size_(size),
+          sizeAlloced_(0), isMalloced_(false), eof_(false)
+    {
+    }
+
+    MemIo::~MemIo()
+    {
+        if (isMalloced_) {
+            delete[] data_;
+        }
+    }
+
+    void MemIo::reserve(long wcount)
+    {
+        long need = wcount + idx_;
+
+        if (!isMalloced_) {
+            // Minimum size for 1st block is 32kB
+            long size = need > 32768 ? need : 32768;
+            if (size < size_) size = size_;
+            byte* data = new byte[size];
+            if (size_ > 0) memcpy(data, data_, size_);
+            data_ = data;
+            sizeAlloced_ = size;
+            isMalloced_ = true;
+        }
+
+        if (need > size_) {
+            if (need > sizeAlloced_) {
+                // Grow in large blocks to avoid frequent reallocations
+                long size = sizeAlloced_ * 2 > need ? sizeAlloced_ * 2 : need;
+                byte* data = new byte[size];
+                memcpy(data, data_, size_);
+                delete[] data_;
+                data_ = data;
+                sizeAlloced_ = size;
+            }
+            size_ = need;
+        }
+    } // MemIo::reserve
+
+    long MemIo::write(const byte* data, long wcount)
+    {
+        reserve(wcount);
+        memcpy(&data_[idx_], data, wcount);
+        idx_ += wcount;
+        return wcount;
+    }
+
+    long MemIo::write(BasicIo& src)
+    {
+        if (static_cast<BasicIo*>(this) == &src) return 0;
+        if (!src.isopen()) return 0;
+
+        const byte* pData = src.data();
+        if (pData) {
+            const long pos = src.tell();
+            const long wcount = src.size() - pos;
+            if (wcount <= 0) return 0;
+            write(pData + pos, wcount);
+            src.seek(wcount, BasicIo::cur);
+            return wcount;
+        }
+
+        byte buf[4096];
+        long readCount = 0;
+        long writeTotal = 0;
+        while ((readCount = src.read(buf, sizeof(buf)))) {
+            write(buf, readCount);
+            writeTotal += readCount;
+        }
+
+        return writeTotal;
+    }
+
+    int MemIo::putb(byte data)
+    {
+        reserve(1);
+        data_[idx_++] = data;
+        return data;
+    }
+
+    int MemIo::transfer(BasicIo& src)
+    {
+        MemIo *memIo = dynamic_cast<MemIo*>(&src);
+        if (memIo) {
+            // Optimization if this is another instance of MemIo
+            if (isMalloced_) {
+                delete[] data_;
+            }
+            idx_ = 0;
+            data_ = memIo->data_;
+            size_ = memIo->size_;
+            sizeAlloced_ = memIo->sizeAlloced_;
+            isMalloced_ = memIo->isMalloced_;
+            memIo->idx_ = 0;
+            memIo->data_ = 0;
+            memIo->size_ = 0;
+            memIo->sizeAlloced_ = 0;
+            memIo->isMalloced_ = false;
+        }
+        else {
+            // Generic reopen to reset position to start
+            idx_ = 0;
+            size_ = 0;
+            if (src.open() != 0) return -4;
+            write(src);
+            src.close();
+        }
+        eof_ = false;
+        return 0;
+    } // MemIo::transfer
+
+    int MemIo::seek(long offset, Position pos)
+    {
+        long newIdx = 0;
+
+        if (pos == BasicIo::cur ) {
+            newIdx = idx_ + offset;
+        }
+        else if (pos == BasicIo::beg) {
+            newIdx = offset;
+        }
+        else {
+            assert(pos == BasicIo::end);
+            newIdx = size_ + offset;
+        }
+
+        if (newIdx < 0 || newIdx > size_) return 1;
+        idx_ = newIdx;
+        eof_ = false;
+        return 0;
+    }
+
+    long MemIo::tell() const
+    {
+        return idx_;
+    }
+
+    long MemIo::size() const
+    {
+        return size_;
+    }
+
+    int MemIo::open()
+    {
+        idx_ = 0;
+        eof_ = false;
+        return 0;
+    }
+
+    bool MemIo::isopen() const
+    {
+        return true;
+    }
+
+    int MemIo::close()
+    {
+        return 0;
+    }
+
+    DataBuf MemIo::read(long rcount)
+    {
+        DataBuf buf(rcount);
+        long readCount = read(buf.pData_, buf.size_);
+        buf.size_ = readCount;
+        return buf;
+    }
+
+    long MemIo::read(byte* buf, long rcount)
+    {
+        long avail = size_ - idx_;
+        long allow = rcount < avail ? rcount : avail;
+        if (allow > 0) memcpy(buf, &data_[idx_], allow);
+        if (allow < 0) allow = 0;
+        idx_ += allow;
+        if (rcount > avail) eof_ = true;
+        return allow;
+    }
+
+    int MemIo::getb()
+    {
+        if (idx_ >= size_) {
+            eof_ = true;
+            return EOF;
+        }
+        return data_[idx_++];
+    }
+
+    int MemIo::error() const
+    {
+        return 0;
+    }
+
+    bool MemIo::eof() const
+    {
+        return eof_;
+    }
+
+    std::string MemIo::path() const
+    {
+        return "MemIo";
+    }
+
+    const byte* MemIo::data() const
+    {
+        return data_;
+    }
+
+    BasicIo::AutoPtr MemIo::temporary() const
+    {
+        return BasicIo::AutoPtr(new MemIo);
+    }
+
+}                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    bool isLocalFile(int fd)
+    {
+#if defined(__APPLE__) || defined(__FreeBSD__)
+        struct statfs buf;
+        if (fstatfs(fd, &buf) != 0) return false;
+        return (buf.f_flags & MNT_LOCAL) != 0;
+#elif defined(__linux__)
+        struct statfs buf;
+        if (fstatfs(fd, &buf) != 0) return false;
+        switch (static_cast<unsigned long>(buf.f_type) & 0xffffffffUL) {
+        case 0x6969UL:                          // NFS
+        case 0x517bUL:                          // SMB
+        case 0xfe534d42UL:                      // SMB2
+        case 0xff534d42UL:                      // CIFS
+        case 0x564cUL:                          // NCP
+        case 0x5346414fUL:                      // AFS
+        case 0x73757245UL:                      // Coda
+        case 0x65735546UL:                      // FUSE, e.g. sshfs
+            return false;
+        default:
+            return true;
+        }
+#else
+        return false;
+#endif
+    } // isLocalFile
+
+    long readAt(int fd, Exiv2::byte* buf, long count, long offset)
+    {
+#ifdef _MSC_VER
+        if (::lseek(fd, offset, SEEK_SET) != offset) return -1;
+        return (long)::read(fd, buf, count);
+#else
+        return (long)::pread(fd, buf, count, offset);
+#endif
+    } // readAt
+
+}
@@ -0,0 +1,609 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    basicio.hpp
+  @brief   Simple binary IO abstraction with file, memory mapped file and
+           memory buffer implementations
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef BASICIO_HPP_
+#define BASICIO_HPP_
+
+// *****************************************************************************
+// included header files
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+#include <memory>
+#include <cstdio>
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class definitions
+
+    /*!
+      @brief An interface for simple binary IO.
+
+      Designed to have semantics and names similar to those of C style FILE*
+      operations. Subclasses should all behave the same so that they can be
+      interchanged.
+     */
+    class BasicIo {
+    public:
+        //! BasicIo auto_ptr type
+        typedef std::auto_ptr<BasicIo> AutoPtr;
+
+        //! Seek starting positions
+        enum Position { beg, cur, end };
+
+        //! @name Creators
+        //@{
+        //! Destructor
+        virtual ~BasicIo() {}
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Open the IO source using the default access mode. The
+                 default mode should allow for reading and writing.
+
+          This method can also be used to "reopen" an IO source which will
+          flush any unwritten data and reset the IO position to the start.
+          @return 0 if successful;<BR>
+                  Nonzero if failure.
+         */
+        virtual int open() =0;
+        /*!
+          @brief Close the IO source. After closing a BasicIo instance can
+                 not be read or written. Closing flushes any unwritten data.
+                 It is safe to call close on a closed instance.
+          @return 0 if successful;<BR>
+                  Nonzero if failure.
+         */
+        virtual int close() =0;
+        /*!
+          @brief Write data to the IO source. Current IO position is advanced
+                 by the number of bytes written.
+          @param data Pointer to data. Data must be at least \em wcount
+                 bytes long
+          @param wcount Number of bytes to be written.
+          @return Number of bytes written to IO source successfully;<BR>
+                  0 if failure;
+         */
+        virtual long write(const byte* data, long wcount) =0;
+        /*!
+          @brief Write data that is read from another BasicIo instance to
+                 the IO source. Current IO position is advanced by the number
+                 of bytes written.
+          @param src Reference to another BasicIo instance. Reading start
+                 at the source's current IO position
+          @return Number of bytes written to IO source successfully;<BR>
+                  0 if failure;
+         */
+        virtual long write(BasicIo& src) =0;
+        /*!
+          @brief Write one byte to the IO source. Current IO position is
+                 advanced by one byte.
+          @param data The single byte to be written.
+          @return The value of the byte written if successful;<BR>
+                  EOF if failure;
+         */
+        virtual int putb(byte data) =0;
+        /*!
+          @brief Read data from the IO source. Reading starts at the current
+                 IO position and the position is advanced by the number of
+                 bytes read.
+          @param rcount Maximum number of bytes to read. Fewer bytes may be
+                 read if \em rcount bytes are not available.
+          @return DataBuf instance containing the bytes read. Use the
+                 DataBuf::size_ member to find the number of bytes read.
+                 DataBuf::size_ will be 0 on failure.
+         */
+        virtual DataBuf read(long rcount) =0;
+        /*!
+          @brief Read data from the IO source. Reading starts at the current
+                 IO position and the position is advanced by the number of
+                 bytes read.
+          @param buf Pointer to a block of memory into which the read data
+                 is stored. The memory block must be at least \em rcount bytes
+                 long.
+          @param rcount Maximum number of bytes to read. Fewer bytes may be
+                 read if \em rcount bytes are not available.
+          @return Number of bytes read from IO source successfully;<BR>
+                  0 if failure;
+         */
+        virtual long read(byte* buf, long rcount) =0;
+        /*!
+          @brief Read one byte from the IO source. Current IO position is
+                 advanced by one byte.
+          @return The byte read from the IO source if successful;<BR>
+                  EOF if failure;
+         */
+        virtual int getb() =0;
+        /*!
+          @brief Remove all data from this object's IO source and then transfer
+                 data from the \em src BasicIo object into this object.
+
+          The source object is invalidated by this operation and should not be
+          used after this method returns. This method exists primarily to
+          be used with the BasicIo::temporary() method.
+          If this object was open before the call, it is reopened afterwards.
+
+          @param src Reference to another BasicIo instance. The entire contents
+                 of src are transferred to this object. The \em src object is
+                 invalidated by the method.
+          @return 0 if successful;<BR>
+                  -4 if the data could not be transferred;
+         */
+        virtual int transfer(BasicIo& src) =0;
+        /*!
+          @brief Move the current IO position.
+          @param offset Number of bytes to move the position relative
+                 to the starting position specified by \em pos
+          @param pos Position from which the seek should start
+          @return 0 if successful;<BR>
+                  Nonzero if failure;
+         */
+        virtual int seek(long offset, Position pos) =0;
+        //@}
+
+        //! @name Accessors
+        //@{
+        /*!
+          @brief Get the current IO position.
+          @return Offset from the start of IO if successful;<BR>
+                 -1 if failure;
+         */
+        virtual long tell() const =0;
+        /*!
+          @brief Get the current size of the IO source in bytes.
+          @return Size of the IO source in bytes;<BR>
+                 -1 if failure;
+         */
+        virtual long size() const =0;
+        //! Returns true if the IO source is open, otherwise false.
+        virtual bool isopen() const =0;
+        //! Returns 0 if the IO source is in a valid state, otherwise nonzero.
+        virtual int error() const =0;
+        //! Returns true if the IO position has reached the end, otherwise false.
+        virtual bool eof() const =0;
+        /*!
+          @brief Return the path to the IO resource. Often used to form
+                 comprehensive error messages where only a BasicIo instance is
+                 available.
+         */
+        virtual std::string path() const =0;
+        /*!
+          @brief Return a read-only pointer to the entire contents of the IO
+                 source if they are resident in memory (memory buffers and
+                 memory mapped files), else 0. The pointer is only valid while
+                 the IO source is open and not written to.
+         */
+        virtual const byte* data() const { return 0; }
+        /*!
+          @brief Returns a temporary data storage location. This is often
+                 needed to rewrite an IO source.
+
+          For example, data may be read from the original IO source, modified
+          in some way, and then saved to the temporary instance. After the
+          operation is complete, the BasicIo::transfer method can be used to
+          replace the original IO source with the modified version. Subclasses
+          are free to return any class that derives from BasicIo. The
+          returned object is already open.
+
+          @return An instance of BasicIo. Use BasicIo::isopen() to check if
+                  the temporary storage could be created.
+         */
+        virtual BasicIo::AutoPtr temporary() const =0;
+        //@}
+
+    protected:
+        //! @name Creators
+        //@{
+        //! Default Constructor
+        BasicIo() {}
+        //@}
+
+    private:
+        // NOT IMPLEMENTED
+        //! Copy constructor
+        BasicIo(const BasicIo& rhs);
+        //! Assignment operator
+        BasicIo& operator=(const BasicIo& rhs);
+
+    }; // class BasicIo
+
+    /*!
+      @brief Utility class that closes a BasicIo instance upon destruction.
+             Meant to be used as a stack variable in functions that need to
+             ensure BasicIo instances get closed. Useful when functions return
+             errors from many locations.
+     */
+    class IoCloser {
+    public:
+        //! @name Creators
+        //@{
+        //! Constructor, takes a BasicIo reference
+        IoCloser(BasicIo& bio) : bio_(bio) {}
+        //! Destructor, closes the BasicIo reference
+        ~IoCloser() { close(); }
+        //@}
+
+        //! @name Manipulators
+        //@{
+        //! Close the BasicIo if it is open
+        void close() { if (bio_.isopen()) bio_.close(); }
+        //@}
+
+        // DATA
+        //! The BasicIo reference
+        BasicIo& bio_;
+
+    private:
+        // NOT IMPLEMENTED
+        //! Copy constructor
+        IoCloser(const IoCloser&);
+        //! Assignment operator
+        IoCloser& operator=(const IoCloser&);
+
+    }; // class IoCloser
+
+    /*!
+      @brief Provides binary file IO by implementing the BasicIo interface
+             on top of C style FILE* streams.
+     */
+    class FileIo : public BasicIo {
+    public:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor that accepts the file path on which IO will be
+                 performed. The constructor does not open the file, and
+                 therefore never fails.
+          @param path The full path of a file
+         */
+        explicit FileIo(const std::string& path);
+        /*!
+          @brief Destructor. Flushes and closes an open file. Temporary files
+                 which have not been transferred are removed.
+         */
+        virtual ~FileIo();
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Open the file using the specified mode.
+
+          This method can also be used to "reopen" a file which will flush any
+          unwritten data and reset the IO position to the start. Although
+          files can be opened in binary or text mode, this class has only been
+          tested carefully in binary mode.
+
+          @param mode Specified that type of access allowed on the file.
+                 Valid values match those of the C fopen command exactly.
+          @return 0 if successful;<BR>
+                  Nonzero if failure.
+         */
+        int open(const std::string& mode);
+        /*!
+          @brief Open the file for reading ("rb"). The file is reopened for
+                 update transparently the first time it is written to.
+          @return 0 if successful;<BR>
+                  Nonzero if failure.
+         */
+        virtual int open();
+        virtual int close();
+        virtual long write(const byte* data, long wcount);
+        virtual long write(BasicIo& src);
+        virtual int putb(byte data);
+        virtual DataBuf read(long rcount);
+        virtual long read(byte* buf, long rcount);
+        virtual int getb();
+        /*!
+          @brief Replace the file with the contents of \em src. If \em src is
+                 a FileIo instance (e.g., the one returned by temporary()),
+                 the file is simply renamed, otherwise the data is copied.
+          @return 0 if successful;<BR>
+                  -4 if the data could not be transferred;
+         */
+        virtual int transfer(BasicIo& src);
+        virtual int seek(long offset, Position pos);
+        //@}
+
+        //! @name Accessors
+        //@{
+        virtual long tell() const;
+        /*!
+          @brief Flush any buffered writes and get the current file size
+                 in bytes.
+          @return Size of the file in bytes;<BR>
+                 -1 if failure;
+         */
+        virtual long size() const;
+        virtual bool isopen() const;
+        virtual int error() const;
+        virtual bool eof() const;
+        virtual std::string path() const;
+        /*!
+          @brief Returns a temporary file next to the file of this instance,
+                 opened for update ("w+b"). The file is removed when the
+                 returned object is destroyed, unless it has been moved into
+                 place by transfer().
+         */
+        virtual BasicIo::AutoPtr temporary() const;
+        //@}
+
+    private:
+        //! Operations that require special handling of update streams
+        enum OpMode { opRead, opWrite, opSeek };
+
+        //! Switch to the new access mode, reopening the file if needed
+        int switchMode(OpMode opMode);
+        /*!
+          @brief Copy the remaining data of the file \em src without passing
+                 it through user space, if the system supports it.
+          @return Number of bytes copied, which may be less than the
+                  remaining data (0 if copying is not supported).
+         */
+        long copyFile(BasicIo& src);
+
+        // DATA
+        std::string path_;                      //!< Path of the file
+        std::string openMode_;                  //!< Mode of the open file
+        FILE* fp_;                              //!< File stream, 0 if closed
+        OpMode opMode_;                         //!< Last operation
+        bool isTemp_;                           //!< Remove the file when done
+
+        // NOT IMPLEMENTED
+        //! Copy constructor
+        FileIo(FileIo& rhs);
+        //! Assignment operator
+        FileIo& operator=(const FileIo& rhs);
+
+    }; // class FileIo
+
+    /*!
+      @brief Provides binary IO on a memory mapped file.
+
+      Opening an instance maps the whole file into memory, so reading,
+      seeking and scanning are plain pointer arithmetic and no system calls
+      are made for individual reads. If the file can not be mapped, it is
+      read into a memory buffer instead. Writes overwrite the file in place
+      and can not change its size; use temporary() and transfer() to
+      rewrite it.
+
+      Files on network file systems (NFS, SMB, AFS, FUSE, ...) and on
+      systems where this can not be determined are not mapped. They are
+      read into a memory buffer on demand with pread(), in growing chunks
+      from the start of the file, so scanning stays pointer arithmetic and
+      only the part of the file which is used is read.
+
+      @note Reading a mapped file which is truncated by another process
+            while it is mapped raises SIGBUS. This can not be caught, the
+            file must not be truncated while an %MmapIo has it open.
+     */
+    class MmapIo : public BasicIo {
+    public:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor that accepts the file path on which IO will be
+                 performed. The constructor does not open the file, and
+                 therefore never fails.
+          @param path The full path of a file
+         */
+        explicit MmapIo(const std::string& path);
+        //! Destructor. Unmaps the file.
+        virtual ~MmapIo();
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Map the file into memory, unless it is on a network file
+                 system, in which case it is read when it is used. If the
+                 file is already open, the IO position is reset to the
+                 start.
+          @return 0 if successful;<BR>
+                  Nonzero if failure, or if the path is not a regular file.
+         */
+        virtual int open();
+        virtual int close();
+        /*!
+          @brief Overwrite the file at the current IO position. Writing
+                 stops at the end of the file.
+          @return Number of bytes written to the file.
+         */
+        virtual long write(const byte* data, long wcount);
+        /*!
+          @brief Overwrite the file with the remaining data of \em src,
+                 starting at the current IO position. Writing stops at the
+                 end of the file.
+          @return Number of bytes written to the file.
+         */
+        virtual long write(BasicIo& src);
+        /*!
+          @brief Overwrite one byte at the current IO position.
+          @return The byte written if successful;<BR>
+                  EOF if failure;
+         */
+        virtual int putb(byte data);
+        virtual DataBuf read(long rcount);
+        virtual long read(byte* buf, long rcount);
+        virtual int getb();
+        /*!
+          @brief Replace the file with the contents of \em src, see
+                 FileIo::transfer(). The file is remapped if it was open.
+          @return 0 if successful;<BR>
+                  -4 if the data could not be transferred;
+         */
+        virtual int transfer(BasicIo& src);
+        virtual int seek(long offset, Position pos);
+        //@}
+
+        //! @name Accessors
+        //@{
+        virtual long tell() const;
+        virtual long size() const;
+        virtual bool isopen() const;
+        virtual int error() const;
+        virtual bool eof() const;
+        virtual std::string path() const;
+        virtual const byte* data() const;
+        //! Returns a temporary FileIo, see FileIo::temporary().
+        virtual BasicIo::AutoPtr temporary() const;
+        //@}
+
+    private:
+        /*!
+          @brief Read the file into data_ up to at least offset \em end,
+                 if it is not mapped. Return the number of bytes of data_
+                 which can be used.
+         */
+        long load(long end) const;
+
+        // DATA
+        std::string path_;                      //!< Path of the file
+        byte* data_;                            //!< Start of the file data
+        long size_;                             //!< Size of the file data
+        long idx_;                              //!< Current IO position
+        int fd_;                                //!< Descriptor for writes
+        int readFd_;                            //!< Descriptor for reads if
+                                                //!< not mapped, else -1
+        mutable long loaded_;                   //!< Bytes of data_ read
+        bool isOpen_;                           //!< True if the file is open
+        bool isMapped_;                         //!< True if data_ is mapped
+        bool eof_;                              //!< End of file indicator
+
+        // NOT IMPLEMENTED
+        //! Copy constructor
+        MmapIo(MmapIo& rhs);
+        //! Assignment operator
+        MmapIo& operator=(const MmapIo& rhs);
+
+    }; // class MmapIo
+
+    /*!
+      @brief Provides binary IO on blocks of memory by implementing the
+             BasicIo interface. A copy-on-write implementation ensures that
+             the data passed in is only copied when necessary, i.e., as soon
+             as data is written to the MemIo. The original data is only used
+             for reading. If writes are performed, the changed data can be
+             retrieved using the read methods (since the data used in
+             construction is never modified).
+
+      @note If read only usage of this class is common, it might be worth
+            creating a specialized readonly class or changing this one to
+            have a readonly mode.
+     */
+    class MemIo : public BasicIo {
+    public:
+        //! @name Creators
+        //@{
+        //! Default constructor that results in an empty object
+        MemIo();
+        /*!
+          @brief Constructor that accepts a block of memory to be used for
+                 IO. The data is not copied until it is written to.
+          @param data Pointer to data. Data must be at least \em size
+                 bytes long and must remain valid as long as it is used
+                 by the MemIo.
+          @param size Number of bytes to copy.
+         */
+        MemIo(const byte* data, long size);
+        //! Destructor. Releases all managed memory
+        virtual ~MemIo();
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Memory IO is always open for reading and writing. This method
+                 therefore only resets the IO position to the start.
+          @return 0
+         */
+        virtual int open();
+        //! Does nothing on MemIo objects, returns 0.
+        virtual int close();
+        virtual long write(const byte* data, long wcount);
+        virtual long write(BasicIo& src);
+        virtual int putb(byte data);
+        virtual DataBuf read(long rcount);
+        virtual long read(byte* buf, long rcount);
+        virtual int getb();
+        /*!
+          @brief Replace the contents of this MemIo with those of \em src. If
+                 \em src is a MemIo instance, its buffer is taken over without
+                 copying, otherwise the data is copied.
+          @return 0 if successful;<BR>
+                  -4 if the data could not be transferred;
+         */
+        virtual int transfer(BasicIo& src);
+        virtual int seek(long offset, Position pos);
+        //@}
+
+        //! @name Accessors
+        //@{
+        virtual long tell() const;
+        virtual long size() const;
+        //! Always returns true
+        virtual bool isopen() const;
+        //! Always returns 0
+        virtual int error() const;
+        virtual bool eof() const;
+        //! Returns a dummy path, indicating that memory access is used
+        virtual std::string path() const;
+        virtual const byte* data() const;
+        //! Returns a new, empty MemIo instance.
+        virtual BasicIo::AutoPtr temporary() const;
+        //@}
+
+    private:
+        //! Reserve memory for at least \em wcount more bytes, copying on write
+        void reserve(long wcount);
+
+        // DATA
+        byte* data_;                            //!< Data buffer
+        long idx_;                              //!< Current IO position
+        long size_;                             //!< Size of the data
+        long sizeAlloced_;                      //!< Size of the allocated buffer
+        bool isMalloced_;                       //!< True if data_ is owned
+        bool eof_;                              //!< End of data indicator
+
+        // NOT IMPLEMENTED
+        //! Copy constructor
+        MemIo(MemIo& rhs);
+        //! Assignment operator
+        MemIo& operator=(const MemIo& rhs);
+
+    }; // class MemIo
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef BASICIO_HPP_
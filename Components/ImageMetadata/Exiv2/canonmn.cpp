@@ -67,8 +67,14 @@ namespace Exiv2 {
         MakerNote::MnTagInfo(0xffff, "(UnknownCanonMakerNoteTag)", "Unknown CanonMakerNote tag")
     };
 
+    // Index of the Canon MakerNote Tag Info
+    static const TagIndex canonMnTagIndex(canonMnTagInfo,
+                                          &MakerNote::MnTagInfo::tag_,
+                                          &MakerNote::MnTagInfo::name_);
+
     CanonMakerNote::CanonMakerNote(bool alloc)
-        : IfdMakerNote(canonMnTagInfo, alloc), ifdItem_("Canon")
+        : IfdMakerNote(canonMnTagInfo, alloc, &canonMnTagIndex),
+          ifdItem_("Canon")
     {
     }
 
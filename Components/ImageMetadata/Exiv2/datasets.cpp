@@ -166,28 +166,31 @@ namespace Exiv2 {
         0
     };
 
+    // Indexes of the dataset lookup lists by number and name, built at startup
+    static const TagIndex envelopeIndex(envelopeRecord, &DataSet::number_, &DataSet::name_);
+    static const TagIndex application2Index(application2Record, &DataSet::number_, &DataSet::name_);
+
+    // The indexes of the lists in records_, in the same order
+    const TagIndex* IptcDataSets::recordIndexes_[] = {
+        0, 
+        &envelopeIndex, &application2Index, 
+        0
+    };
+
     int IptcDataSets::dataSetIdx(uint16_t number, uint16_t recordId)
     {
         if( recordId != envelope && recordId != application2 ) return -1;
-        const DataSet* dataSet = records_[recordId];
-        if (dataSet == 0) return -1;
-        int idx;
-        for (idx = 0; dataSet[idx].number_ != number; ++idx) {
-            if (dataSet[idx].number_ == 0xffff) return -1;
-        }
-        return idx;
+        const TagIndex* recordIndex = recordIndexes_[recordId];
+        if (recordIndex == 0) return -1;
+        return recordIndex->find(number);
     }
 
     int IptcDataSets::dataSetIdx(const std::string& dataSetName, uint16_t recordId)
     {
         if( recordId != envelope && recordId != application2 ) return -1;
-        const DataSet* dataSet = records_[recordId];
-        if (dataSet == 0) return -1;
-        int idx;
-        for (idx = 0; dataSet[idx].name_ != dataSetName; ++idx) {
-            if (dataSet[idx].number_ == 0xffff) return -1;
-        }
-        return idx;
+        const TagIndex* recordIndex = recordIndexes_[recordId];
+        if (recordIndex == 0) return -1;
+        return recordIndex->find(dataSetName);
     }
 
     TypeId IptcDataSets::dataSetType(uint16_t number, uint16_t recordId)
@@ -254,6 +254,7 @@ namespace Exiv2 {
         static int dataSetIdx(const std::string& dataSetName, uint16_t recordId);
 
         static const DataSet* records_[];
+        static const TagIndex* recordIndexes_[];
         static const RecordInfo recordInfo_[];
 
     }; // class IptcDataSets
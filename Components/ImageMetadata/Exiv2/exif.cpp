@@ -42,6 +42,7 @@ EXIV2_RCSID("@(#) $Id: exif.cpp 486 2005-01-16 14:50:33Z ahuggel $");
 #include "tags.hpp"
 #include "image.hpp"
 #include "makernote.hpp"
+#include "visitor.hpp"
 
 // + standard includes
 #include <iostream>
@@ -49,6 +50,7 @@ EXIV2_RCSID("@(#) $Id: exif.cpp 486 2005-01-16 14:50:33Z ahuggel $");
 #include <utility>
 #include <algorithm>
 #include <map>
+#include <set>
 #include <cstring>
 #include <cassert>
 #include <cstdio>
@@ -57,6 +59,9 @@ EXIV2_RCSID("@(#) $Id: exif.cpp 486 2005-01-16 14:50:33Z ahuggel $");
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>                    // for stat()
 #endif
+#ifndef _MSC_VER
+# include <pthread.h>
+#endif
 
 // *****************************************************************************
 // local declarations
@@ -73,36 +78,414 @@ namespace {
                       uint32_t offset, 
                       Exiv2::ByteOrder byteOrder);
 
+    /*
+      Remove the first Exifdatum with tag from mds. Return its index or 0 if
+      there is no Exifdatum with this tag.
+     */
+    int eraseTag(std::vector<const Exiv2::Exifdatum*>& mds, uint16_t tag);
+
+    /*
+      Add an entry for each Exifdatum of mds to ifd. The values are encoded
+      with byteOrder through buf, which grows as needed, directly into the
+      entries of the IFD.
+     */
+    void encodeIfd(Exiv2::Ifd& ifd,
+                   const std::vector<const Exiv2::Exifdatum*>& mds,
+                   Exiv2::ByteOrder byteOrder,
+                   Exiv2::DataBuf& buf);
+
     // Read file path into a DataBuf, which is returned.
     Exiv2::DataBuf readFile(const std::string& path);
 
+    // Read rcount bytes at offset from io into buf, return true if successful
+    bool readAt(Exiv2::BasicIo& io, long offset, Exiv2::byte* buf, long rcount);
+
+    // Return the id of a tag in an IFD, used as key of the metadata index
+    uint32_t indexId(Exiv2::IfdId ifdId, uint16_t tag);
+
+    // Unary predicate that matches an Exifdatum whose id is not in ids
+    class IdNotIn {
+    public:
+        // Constructor, ids are index ids of the metadata to keep
+        IdNotIn(const std::set<uint32_t>& ids) : ids_(ids) {}
+        bool operator()(const Exiv2::Exifdatum& exifdatum) const
+            { return ids_.find(indexId(exifdatum.ifdId(),
+                                       exifdatum.tag())) == ids_.end(); }
+    private:
+        const std::set<uint32_t>& ids_;
+    };
+
+    /*
+      Exif visitor that adds the entries with the requested keys to an
+      ExifData. It skips the IFDs which can not hold any of the keys and
+      stops the walk as soon as all keys are found.
+     */
+    class KeyReader : public Exiv2::ExifVisitor {
+    public:
+        // Constructor, keys must not contain makernote keys
+        KeyReader(Exiv2::ExifData& exifData,
+                  const std::vector<Exiv2::ExifKey>& keys);
+        // Return true if the IFD or one of its sub-IFDs can hold a key
+        bool enterIfd(Exiv2::IfdId ifdId);
+        // Add the entry if it is requested, return false once all are found
+        bool visitEntry(Exiv2::IfdId ifdId,
+                        uint16_t tag,
+                        uint16_t type,
+                        uint32_t count,
+                        const Exiv2::byte* pData,
+                        long size,
+                        Exiv2::ByteOrder byteOrder);
+    private:
+        Exiv2::ExifData& exifData_;             // Receives the metadata
+        std::vector<Exiv2::ExifKey> keys_;      // Keys not found yet
+        bool ifds_[Exiv2::lastIfdId];           // IFDs of the keys
+    };
+
+    /*
+      Exif visitor that records the entries of an Exif data buffer in the
+      entries of an ExifData without decoding them. Reads the makernote
+      itself, so that the MakerNote is kept.
+     */
+    class EntryReader : public Exiv2::ExifVisitor {
+    public:
+        // Constructor, buf is the Exif data buffer
+        EntryReader(Exiv2::ExifEntries& entries,
+                    const Exiv2::byte* buf,
+                    Exiv2::ByteOrder byteOrder);
+        // Read the makernote instead of entering it
+        bool enterIfd(Exiv2::IfdId ifdId);
+        // Add the entry, except the pointers to sub-IFDs in IFD1
+        bool visitEntry(Exiv2::IfdId ifdId,
+                        uint16_t tag,
+                        uint16_t type,
+                        uint32_t count,
+                        const Exiv2::byte* pData,
+                        long size,
+                        Exiv2::ByteOrder byteOrder);
+        // Return the MakerNote, 0 if the makernote was not read
+        Exiv2::MakerNote::AutoPtr makerNote() { return makerNote_; }
+        // Return true if IFD1 has pointers to sub-IFDs
+        bool ifd1SubIfds() const { return ifd1SubIfds_; }
+    private:
+        Exiv2::ExifEntries& entries_;           // Receives the entries
+        const Exiv2::byte* buf_;                // Exif data buffer
+        Exiv2::ByteOrder byteOrder_;            // Byte order of the buffer
+        int idx_[Exiv2::lastIfdId];             // Number of entries per IFD
+        std::string make_;                      // Camera make
+        std::string model_;                     // Camera model
+        const Exiv2::byte* pMakerNote_;         // The makernote
+        long sizeMakerNote_;                    // Size of the makernote
+        long makerNoteEntry_;                   // Raw makernote entry
+        Exiv2::MakerNote::AutoPtr makerNote_;   // The MakerNote
+        bool ifd1SubIfds_;                      // IFD1 has sub-IFD pointers
+    };
+
+    /*
+      Index of the entries of the IFDs and the MakerNote of an ExifData by
+      IFD id and idx, used to pair the entries with the metadata.
+     */
+    class EntryIndex {
+    public:
+        // An entry and the Exifdatum that belongs to it
+        struct Slot {
+            Exiv2::Entry* pEntry_;
+            Exiv2::ByteOrder byteOrder_;
+            const Exiv2::Exifdatum* pExifdatum_;
+        };
+        // Constructor
+        EntryIndex() : count_(0) {}
+        // Add the entries from begin to end, with byte order byteOrder
+        void add(Exiv2::Entries::iterator begin,
+                 Exiv2::Entries::iterator end,
+                 Exiv2::ByteOrder byteOrder);
+        // Return the slot of the entry with ifdId and idx, 0 if none
+        Slot* find(Exiv2::IfdId ifdId, int idx);
+        // Return the number of entries
+        long count() const { return count_; }
+    private:
+        std::vector<Slot> slots_[Exiv2::lastIfdId]; // By IFD id and idx
+        long count_;                            // Number of entries
+    };
+
 }
 
 // *****************************************************************************
 // class member definitions
 namespace Exiv2 {
 
+    /*
+      The entries of an Exif data buffer, shared by the ExifData that read
+      them and the Exifdatum objects which refer to them. Owns a copy of the
+      data buffer, unless it is borrowed from the caller of ExifData::read(),
+      an empty MakerNote to create the keys of MakerNote tags and the arena
+      in which the keys and values are created. Deletes itself when the last
+      reference is released.
+
+      Copies of an Exifdatum, and so copies of an ExifData, share the
+      entries and may be used by different threads. The reference count,
+      the arena and the data buffer are therefore protected by a mutex.
+     */
+    class ExifEntries {
+    public:
+        //! An IFD entry, its value is at offset_ in the data buffer
+        struct RawEntry {
+            uint16_t tag_;
+            uint16_t type_;
+            IfdId ifdId_;
+            int idx_;
+            long offset_;
+            long size_;
+            ByteOrder byteOrder_;
+        };
+
+        /*!
+          @brief Constructor, copies the data buffer if \em alloc is true,
+                 else borrows it. The reference count is 1.
+         */
+        ExifEntries(const byte* buf, long len, bool alloc);
+
+        //! Reserve space for \em count entries
+        void reserve(long count) { entries_.reserve(count); }
+        //! Add a reference
+        void addRef();
+        //! Remove a reference, delete the object if it was the last one
+        void release();
+        //! Use a copy of \em makerNote to create the keys of MakerNote tags
+        void setMakerNote(const MakerNote* makerNote);
+        /*!
+          @brief Add entry \em e, return its index or -1 if it can not be
+                 referred to (its data is not in the data buffer or it has
+                 a data area).
+         */
+        long add(const Entry& e, ByteOrder byteOrder);
+        /*!
+          @brief Add an entry with a value of \em size bytes at \em pData,
+                 return its index or -1 if the value is not in the data
+                 buffer.
+         */
+        long add(IfdId ifdId,
+                 int idx,
+                 uint16_t tag,
+                 uint16_t type,
+                 const byte* pData,
+                 long size,
+                 ByteOrder byteOrder);
+        /*!
+          @brief Remove entry \em entry. Only allowed as long as no Exifdatum
+                 refers to the entries.
+         */
+        void erase(long entry) { entries_.erase(entries_.begin() + entry); }
+        /*!
+          @brief Make the data buffer private: return it to the caller, who
+                 owns it from now on, and keep a copy for the entries. Only
+                 the ExifData which read the entries may call this and only
+                 if the data buffer is not borrowed.
+         */
+        byte* takeData();
+
+        /*!
+          @brief Return the data buffer. Only the ExifData which read the
+                 entries may call this, the buffer changes in takeData().
+         */
+        byte* data() const { return pData_; }
+        //! Return the number of entries
+        long count() const { return static_cast<long>(entries_.size()); }
+        //! Return entry \em entry
+        const RawEntry& entry(long entry) const { return entries_[entry]; }
+        //! Create the key of entry \em entry in the arena
+        ExifKey::AutoPtr key(long entry) const;
+        //! Create the value of entry \em entry in the arena
+        Value::AutoPtr value(long entry) const;
+
+    private:
+        //! Locks the entries for the lifetime of the object
+        class Lock {
+        public:
+            explicit Lock(const ExifEntries& entries);
+            ~Lock();
+        private:
+            const ExifEntries& entries_;
+        };
+
+        //! Destructor, only called by release()
+        ~ExifEntries();
+
+        // DATA
+        long refs_;                             // Reference count
+        byte* pData_;                           // Exif data buffer
+        long size_;                             // Size of the data buffer
+        bool alloc_;                            // Data buffer is owned
+        std::vector<RawEntry> entries_;         // The entries
+        MakerNote::AutoPtr makerNote_;          // For the MakerNote keys
+        mutable Arena arena_;                   // For the keys and values
+#ifndef _MSC_VER
+        mutable pthread_mutex_t mutex_;         // Protects refs_, pData_,
+                                                // size_ and arena_
+#endif
+
+    }; // class ExifEntries
+
+    ExifEntries::Lock::Lock(const ExifEntries& entries)
+        : entries_(entries)
+    {
+#ifndef _MSC_VER
+        pthread_mutex_lock(&entries_.mutex_);
+#endif
+    }
+
+    ExifEntries::Lock::~Lock()
+    {
+#ifndef _MSC_VER
+        pthread_mutex_unlock(&entries_.mutex_);
+#endif
+    }
+
+    ExifEntries::ExifEntries(const byte* buf, long len, bool alloc)
+        : refs_(1), pData_(const_cast<byte*>(buf)), size_(len), alloc_(alloc)
+    {
+        if (alloc_) {
+            pData_ = new byte[len];
+            memcpy(pData_, buf, len);
+        }
+#ifndef _MSC_VER
+        pthread_mutex_init(&mutex_, 0);
+#endif
+    }
+
+    ExifEntries::~ExifEntries()
+    {
+        if (alloc_) delete[] pData_;
+#ifndef _MSC_VER
+        pthread_mutex_destroy(&mutex_);
+#endif
+    }
+
+    void ExifEntries::addRef()
+    {
+        Lock lock(*this);
+        ++refs_;
+    }
+
+    void ExifEntries::release()
+    {
+        long refs = 0;
+        {
+            Lock lock(*this);
+            refs = --refs_;
+        }
+        if (refs == 0) delete this;
+    }
+
+    void ExifEntries::setMakerNote(const MakerNote* makerNote)
+    {
+        makerNote_.reset();
+        if (makerNote != 0) makerNote_ = makerNote->clone();
+    }
+
+    long ExifEntries::add(const Entry& e, ByteOrder byteOrder)
+    {
+        if (   e.sizeDataArea() > 0
+            || e.data() < pData_ || e.data() + e.size() > pData_ + size_) {
+            return -1;
+        }
+        return add(e.ifdId(), e.idx(), e.tag(), e.type(), e.data(),
+                   e.count() * e.typeSize(), byteOrder);
+    } // ExifEntries::add
+
+    long ExifEntries::add(IfdId ifdId,
+                          int idx,
+                          uint16_t tag,
+                          uint16_t type,
+                          const byte* pData,
+                          long size,
+                          ByteOrder byteOrder)
+    {
+        if (pData < pData_ || pData + size > pData_ + size_) return -1;
+        RawEntry raw;
+        raw.tag_ = tag;
+        raw.type_ = type;
+        raw.ifdId_ = ifdId;
+        raw.idx_ = idx;
+        raw.offset_ = static_cast<long>(pData - pData_);
+        raw.size_ = size;
+        raw.byteOrder_ = byteOrder;
+        entries_.push_back(raw);
+        return static_cast<long>(entries_.size()) - 1;
+    } // ExifEntries::add
+
+    byte* ExifEntries::takeData()
+    {
+        assert(alloc_);
+        Lock lock(*this);
+        byte* pData = pData_;
+        if (refs_ > 1) {
+            pData_ = new byte[size_];
+            memcpy(pData_, pData, size_);
+        }
+        else {
+            pData_ = 0;
+            size_ = 0;
+        }
+        return pData;
+    } // ExifEntries::takeData
+
+    ExifKey::AutoPtr ExifEntries::key(long entry) const
+    {
+        const RawEntry& raw = entries_[entry];
+        Entry e(false);
+        e.setTag(raw.tag_);
+        e.setIfdId(raw.ifdId_);
+        e.setIdx(raw.idx_);
+        e.setMakerNote(makerNote_.get());
+        Lock lock(*this);
+        return ExifKey::AutoPtr(new (&arena_) ExifKey(e));
+    }
+
+    Value::AutoPtr ExifEntries::value(long entry) const
+    {
+        const RawEntry& raw = entries_[entry];
+        Lock lock(*this);
+        Value::AutoPtr value = Value::create(TypeId(raw.type_), &arena_);
+        value->read(pData_ + raw.offset_, raw.size_, raw.byteOrder_);
+        return value;
+    }
+
     Exifdatum::Exifdatum(const Entry& e, ByteOrder byteOrder)
-        : key_(ExifKey::AutoPtr(new ExifKey(e)))
+        : key_(ExifKey::AutoPtr(new ExifKey(e))), pEntries_(0), entry_(-1)
     {
         setValue(e, byteOrder);
     }
 
     Exifdatum::Exifdatum(const ExifKey& key, const Value* pValue) 
-        : key_(key.clone())
+        : key_(key.clone()), pEntries_(0), entry_(-1)
     {
         if (pValue) value_ = pValue->clone();
     }
 
+    Exifdatum::Exifdatum(ExifEntries* pEntries, long entry)
+        : pEntries_(pEntries), entry_(entry)
+    {
+        pEntries_->addRef();
+    }
+
     Exifdatum::~Exifdatum()
     {
+        // The key and value may be in the arena of the entries
+        key_.reset();
+        value_.reset();
+        if (pEntries_ != 0) pEntries_->release();
     }
 
     Exifdatum::Exifdatum(const Exifdatum& rhs)
-        : Metadatum(rhs)
+        : Metadatum(rhs), pEntries_(0), entry_(rhs.entry_)
     {
         if (rhs.key_.get() != 0) key_ = rhs.key_->clone(); // deep copy
         if (rhs.value_.get() != 0) value_ = rhs.value_->clone(); // deep copy
+        // The entries are shared, they are not changed
+        if (entry_ >= 0) {
+            pEntries_ = rhs.pEntries_;
+            pEntries_->addRef();
+        }
     }
 
     Exifdatum& Exifdatum::operator=(const Exifdatum& rhs)
@@ -116,6 +499,14 @@ namespace Exiv2 {
         value_.reset();
         if (rhs.value_.get() != 0) value_ = rhs.value_->clone(); // deep copy
 
+        if (pEntries_ != 0) pEntries_->release();
+        pEntries_ = 0;
+        entry_ = rhs.entry_;
+        if (entry_ >= 0) {
+            pEntries_ = rhs.pEntries_;
+            pEntries_->addRef();
+        }
+
         return *this;
     } // Exifdatum::operator=
     
@@ -163,12 +554,14 @@ namespace Exiv2 {
 
     void Exifdatum::setValue(const Value* pValue)
     {
+        release();
         value_.reset();
         if (pValue) value_ = pValue->clone();
     }
 
     void Exifdatum::setValue(const Entry& e, ByteOrder byteOrder)
     {
+        release();
         value_ = Value::create(TypeId(e.type()));
         value_->read(e.data(), e.count() * e.typeSize(), byteOrder);
         value_->setDataArea(e.dataArea(), e.sizeDataArea());
@@ -176,10 +569,53 @@ namespace Exiv2 {
 
     void Exifdatum::setValue(const std::string& value)
     {
-        if (value_.get() == 0) value_ = Value::create(asciiString);
+        if (pValue() == 0) value_ = Value::create(asciiString);
+        release();
         value_->read(value);
     }
 
+    uint16_t Exifdatum::tag() const
+    {
+        if (key_.get() == 0 && entry_ >= 0) {
+            return pEntries_->entry(entry_).tag_;
+        }
+        return key_.get() == 0 ? 0xffff : key_->tag();
+    }
+
+    IfdId Exifdatum::ifdId() const
+    {
+        if (key_.get() == 0 && entry_ >= 0) {
+            return pEntries_->entry(entry_).ifdId_;
+        }
+        return key_.get() == 0 ? ifdIdNotSet : key_->ifdId();
+    }
+
+    int Exifdatum::idx() const
+    {
+        if (key_.get() == 0 && entry_ >= 0) {
+            return pEntries_->entry(entry_).idx_;
+        }
+        return key_.get() == 0 ? 0 : key_->idx();
+    }
+
+    void Exifdatum::loadKey() const
+    {
+        key_ = pEntries_->key(entry_);
+    }
+
+    void Exifdatum::loadValue() const
+    {
+        value_ = pEntries_->value(entry_);
+    }
+
+    void Exifdatum::release() const
+    {
+        if (entry_ < 0) return;
+        if (key_.get() == 0) key_ = pEntries_->key(entry_);
+        // The entries are still needed for the arena
+        entry_ = -1;
+    } // Exifdatum::release
+
     int TiffThumbnail::setDataArea(ExifData& exifData, Ifd& ifd1,
                                    const byte* buf, long len) const
     {
@@ -227,8 +663,7 @@ namespace Exiv2 {
         // Set corresponding data area at IFD1, if it is a contiguous area
         if (firstOffset + totalSize == lastOffset + lastSize) {
             Ifd::iterator pos = ifd1.findTag(0x0111);
-            assert(pos != ifd1.end());
-            pos->setDataArea(buf + firstOffset, totalSize);
+            if (pos != ifd1.end()) pos->setDataArea(buf + firstOffset, totalSize);
         }
 
         return 0;
@@ -279,8 +714,7 @@ namespace Exiv2 {
         format->setDataArea(buf + offset, size);
         format->setValue("0");
         Ifd::iterator pos = ifd1.findTag(0x0201);
-        assert(pos != ifd1.end());
-        pos->setDataArea(buf + offset, size);
+        if (pos != ifd1.end()) pos->setDataArea(buf + offset, size);
         return 0;
     } // JpegThumbnail::read
 
@@ -306,23 +740,24 @@ namespace Exiv2 {
         : ifd0_(ifd0Id, 0, false), 
           exifIfd_(exifIfdId, 0, false), iopIfd_(iopIfdId, 0, false), 
           gpsIfd_(gpsIfdId, 0, false), ifd1_(ifd1Id, 0, false), 
-          size_(0), pData_(0), compatible_(true)
+          size_(0), pData_(0), pEntries_(0), compatible_(true)
     {
     }
 
     ExifData::ExifData(const ExifData& rhs)
         : tiffHeader_(rhs.tiffHeader_), exifMetadata_(rhs.exifMetadata_),
+          index_(rhs.index_),
           ifd0_(ifd0Id, 0, false), 
           exifIfd_(exifIfdId, 0, false), iopIfd_(iopIfdId, 0, false), 
           gpsIfd_(gpsIfdId, 0, false), ifd1_(ifd1Id, 0, false), 
-          size_(0), pData_(0), compatible_(false)
+          size_(0), pData_(0), pEntries_(0), compatible_(false)
     {
         if (rhs.makerNote_.get() != 0) makerNote_ = rhs.makerNote_->clone();
     }
 
     ExifData::~ExifData()
     {
-        delete[] pData_;
+        releaseData();
     }
 
     ExifData& ExifData::operator=(const ExifData& rhs)
@@ -330,6 +765,7 @@ namespace Exiv2 {
         if (this == &rhs) return *this;
         tiffHeader_ = rhs.tiffHeader_;
         exifMetadata_ = rhs.exifMetadata_;
+        index_ = rhs.index_;
         makerNote_.reset();
         if (rhs.makerNote_.get() != 0) makerNote_ = rhs.makerNote_->clone();
         ifd0_.clear();
@@ -337,9 +773,7 @@ namespace Exiv2 {
         iopIfd_.clear();
         gpsIfd_.clear();
         ifd1_.clear();
-        size_ = 0;
-        delete[] pData_;
-        pData_ = 0;
+        releaseData();
         compatible_ = false;
         return *this;
     }
@@ -350,53 +784,122 @@ namespace Exiv2 {
         iterator pos = findKey(exifKey);
         if (pos == end()) {
             add(Exifdatum(exifKey));
-            pos = findKey(exifKey);
+            pos = end() - 1;
         }
         return *pos;
     }
 
     int ExifData::read(const std::string& path)
     {
-        if (!fileExists(path, true)) return -1;
-        Image::AutoPtr image = ImageFactory::instance().open(path);
-        if (image.get() == 0) {
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
+        return readFromImage(image.get());
+    }
+
+    int ExifData::quickRead(const std::string& path,
+                            const std::vector<std::string>& keys)
+    {
+        std::vector<ExifKey> exifKeys;
+        std::set<uint32_t> ids;
+        bool makerKeys = false;
+        for (std::vector<std::string>::const_iterator i = keys.begin();
+             i != keys.end(); ++i) {
+            ExifKey key(*i);
+            if (!ids.insert(indexId(key.ifdId(), key.tag())).second) continue;
+            if (key.ifdId() == makerIfdId) makerKeys = true;
+            exifKeys.push_back(key);
+        }
+        if (makerKeys) {
+            // The makernote is needed, read everything and keep the keys
+            int rc = read(path);
+            erase(std::remove_if(begin(), end(), IdNotIn(ids)), end());
+            compatible_ = false;
+            return rc;
+        }
+
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
+        if (image.get() == 0) return -2;
+        int rc = image->readMetadata(mdExif);
+        if (rc) return rc;
+        if (image->sizeExifData() == 0) return 3;
+
+        exifMetadata_.clear();
+        index_.reset();
+        makerNote_.reset();
+        ifd0_.clear();
+        exifIfd_.clear();
+        iopIfd_.clear();
+        gpsIfd_.clear();
+        ifd1_.clear();
+        releaseData();
+        compatible_ = false;
+        rc = tiffHeader_.read(image->exifData());
+        if (rc || exifKeys.empty()) return rc;
+
+        KeyReader keyReader(*this, exifKeys);
+        return visitExif(image->exifData(), image->sizeExifData(), keyReader);
+    } // ExifData::quickRead
+
+    int ExifData::read(Image& image)
+    {
+        return readFromImage(&image);
+    }
+
+    int ExifData::readImage(const byte* data, long size)
+    {
+        Image::AutoPtr image = ImageFactory::instance().open(data, size);
+        return readFromImage(image.get());
+    }
+
+    int ExifData::readFromImage(Image* pImage)
+    {
+        if (pImage == 0) {
             // We don't know this type of file
             return -2;
         }
 
-        int rc = image->readMetadata();
+        int rc = pImage->readMetadata(mdExif);
         if (rc == 0) {
-            if (image->sizeExifData() > 0) {
-                rc = read(image->exifData(), image->sizeExifData());
+            if (pImage->sizeExifData() > 0) {
+                rc = read(pImage->exifData(), pImage->sizeExifData());
             }
             else {
                 rc = 3;
             }
         }
         return rc;
-    }
+    } // ExifData::readFromImage
 
-    int ExifData::read(const byte* buf, long len)
+    int ExifData::read(const byte* buf, long len, bool alloc)
     {
-        // Copy the data buffer
-        delete[] pData_;
-        pData_ = new byte[len];
-        memcpy(pData_, buf, len);
+        exifMetadata_.clear();
+        index_.reset();
+        makerNote_.reset();
+        releaseData();
+        if (!alloc) return readInPlace(buf, len);
+
+        // Copy the data buffer, the metadata refers to the copy
+        pEntries_ = new ExifEntries(buf, len, true);
+        pData_ = pEntries_->data();
         size_ = len;
+        const byte* pData = pData_;
 
         // Read the TIFF header
         int ret = 0;
-        int rc = tiffHeader_.read(pData_);
+        int rc = tiffHeader_.read(pData);
         if (rc) return rc;
 
         // Read IFD0
-        rc = ifd0_.read(pData_ + tiffHeader_.offset(), 
-                        size_ - tiffHeader_.offset(), 
+        rc = ifd0_.read(pData + tiffHeader_.offset(), 
+                        len - tiffHeader_.offset(), 
                         byteOrder(), 
                         tiffHeader_.offset());
         if (rc) return rc;
         // Find and read ExifIFD sub-IFD of IFD0
-        rc = ifd0_.readSubIfd(exifIfd_, pData_, size_, byteOrder(), 0x8769);
+        rc = ifd0_.readSubIfd(exifIfd_, pData, len, byteOrder(), 0x8769);
         if (rc) return rc;
         // Find MakerNote in ExifIFD, create a MakerNote class 
         Ifd::iterator pos = exifIfd_.findTag(0x927c);
@@ -435,15 +938,15 @@ namespace Exiv2 {
             exifIfd_.erase(pos);
         }
         // Find and read Interoperability IFD in ExifIFD
-        rc = exifIfd_.readSubIfd(iopIfd_, pData_, size_, byteOrder(), 0xa005);
+        rc = exifIfd_.readSubIfd(iopIfd_, pData, len, byteOrder(), 0xa005);
         if (rc) return rc;
         // Find and read GPSInfo sub-IFD in IFD0
-        rc = ifd0_.readSubIfd(gpsIfd_, pData_, size_, byteOrder(), 0x8825);
+        rc = ifd0_.readSubIfd(gpsIfd_, pData, len, byteOrder(), 0x8825);
         if (rc) return rc;
         // Read IFD1
         if (ifd0_.next()) {
-            rc = ifd1_.read(pData_ + ifd0_.next(), 
-                            size_ - ifd0_.next(), 
+            rc = ifd1_.read(pData + ifd0_.next(), 
+                            len - ifd0_.next(), 
                             byteOrder(), 
                             ifd0_.next());
             if (rc) return rc;
@@ -461,29 +964,77 @@ namespace Exiv2 {
             ret = 7;
         }
         // Copy all entries from the IFDs and the MakerNote to the metadata
-        exifMetadata_.clear();
-        add(ifd0_.begin(), ifd0_.end(), byteOrder());
-        add(exifIfd_.begin(), exifIfd_.end(), byteOrder());
+        long count =   ifd0_.count() + exifIfd_.count() + iopIfd_.count()
+                     + gpsIfd_.count() + ifd1_.count();
         if (makerNote_.get() != 0) {
-            add(makerNote_->begin(), makerNote_->end(), makerNote_->byteOrder());
+            count += static_cast<long>(makerNote_->end() - makerNote_->begin());
         }
-        add(iopIfd_.begin(), iopIfd_.end(), byteOrder()); 
-        add(gpsIfd_.begin(), gpsIfd_.end(), byteOrder());
-        add(ifd1_.begin(), ifd1_.end(), byteOrder());
+        exifMetadata_.reserve(count);
+        if (pEntries_ != 0) {
+            pEntries_->reserve(count);
+            pEntries_->setMakerNote(makerNote_.get());
+        }
+        addEntries(ifd0_.begin(), ifd0_.end(), byteOrder());
+        addEntries(exifIfd_.begin(), exifIfd_.end(), byteOrder());
+        if (makerNote_.get() != 0) {
+            addEntries(makerNote_->begin(), makerNote_->end(), 
+                       makerNote_->byteOrder());
+        }
+        addEntries(iopIfd_.begin(), iopIfd_.end(), byteOrder()); 
+        addEntries(gpsIfd_.begin(), gpsIfd_.end(), byteOrder());
+        addEntries(ifd1_.begin(), ifd1_.end(), byteOrder());
         // Read the thumbnail (but don't worry whether it was successful or not)
-        readThumbnail();
+        readThumbnail(pData, len);
 
         return ret;
     } // ExifData::read
 
+    int ExifData::readInPlace(const byte* buf, long len)
+    {
+        // No internal IFDs, they would point into the borrowed buffer
+        ifd0_.clear();
+        exifIfd_.clear();
+        iopIfd_.clear();
+        gpsIfd_.clear();
+        ifd1_.clear();
+        compatible_ = false;
+
+        int rc = tiffHeader_.read(buf);
+        if (rc) return rc;
+
+        // Record the entries without decoding them
+        pEntries_ = new ExifEntries(buf, len, false);
+        EntryReader entryReader(*pEntries_, buf, byteOrder());
+        rc = visitExif(buf, len, entryReader);
+        if (rc) {
+            releaseData();
+            return rc;
+        }
+        makerNote_ = entryReader.makerNote();
+        pEntries_->setMakerNote(makerNote_.get());
+
+        long count = pEntries_->count();
+        exifMetadata_.reserve(count);
+        for (long i = 0; i < count; ++i) {
+            const ExifEntries::RawEntry& raw = pEntries_->entry(i);
+            exifMetadata_.push_back(Exifdatum(pEntries_, i));
+            index_.add(indexId(raw.ifdId_, raw.tag_), i);
+        }
+        // Read the thumbnail (but don't worry whether it was successful or not)
+        readThumbnail(buf, len);
+
+        return entryReader.ifd1SubIfds() ? 7 : 0;
+    } // ExifData::readInPlace
+
     int ExifData::erase(const std::string& path) const
     {
-        if (!fileExists(path, true)) return -1;
-        Image::AutoPtr image = ImageFactory::instance().open(path);
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
         if (image.get() == 0) return -2;
 
-        // Read all metadata then erase only Exif data
-        int rc = image->readMetadata();
+        // Other metadata is not read, it is kept unchanged
+        int rc = image->readMetadata(mdNone);
         if (rc == 0) {
             image->clearExifData();
             rc = image->writeMetadata();
@@ -491,24 +1042,37 @@ namespace Exiv2 {
         return rc;
     } // ExifData::erase
 
-    int ExifData::write(const std::string& path) 
+    int ExifData::write(const std::string& path, long padding) 
     {
         // Remove the Exif section from the file if there is no metadata 
         if (count() == 0) return erase(path);
 
-        if (!fileExists(path, true)) return -1;
-        Image::AutoPtr image = ImageFactory::instance().open(path);
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
         if (image.get() == 0) return -2;
-        DataBuf buf(copy());
-        // Read all metadata to preserve non-Exif data
-        int rc = image->readMetadata();
+        // Other metadata is not read, it is kept unchanged
+        int rc = image->readMetadata(mdNone);
         if (rc == 0) {
-            image->setExifData(buf.pData_, buf.size_);
-            rc = image->writeMetadata();
+            rc = write(*image, padding);
         }
         return rc;
     } // ExifData::write
 
+    int ExifData::write(Image& image, long padding)
+    {
+        // Remove the Exif section from the image if there is no metadata
+        if (count() == 0) {
+            image.clearExifData();
+        }
+        else {
+            DataBuf buf(copy());
+            image.setExifData(buf.pData_, buf.size_);
+        }
+        image.setPadding(padding);
+        return image.writeMetadata();
+    } // ExifData::write
+
     DataBuf ExifData::copy()
     {
         DataBuf buf;
@@ -534,20 +1098,44 @@ namespace Exiv2 {
 
     DataBuf ExifData::copyFromMetadata()
     {
-        // Build IFD0
-        Ifd ifd0(ifd0Id);
-        addToIfd(ifd0, begin(), end(), byteOrder());
+        // Partition the metadata by IFD in one pass
+        std::vector<const Exifdatum*> ifdMetadata[lastIfdId];
+        const_iterator end = this->end();
+        for (const_iterator md = begin(); md != end; ++md) {
+            IfdId ifdId = md->ifdId();
+            if (ifdId > ifdIdNotSet && ifdId < lastIfdId) {
+                ifdMetadata[ifdId].push_back(&*md);
+            }
+        }
 
-        // Build Exif IFD from metadata
+        // The pointers to the sub-IFDs and the MakerNote are replaced below
+        int exifIdx = eraseTag(ifdMetadata[ifd0Id], 0x8769);
+        int gpsIdx  = eraseTag(ifdMetadata[ifd0Id], 0x8825);
+        if (makerNote_.get() != 0) {
+            eraseTag(ifdMetadata[exifIfdId], 0x927c);
+        }
+        int iopIdx  = eraseTag(ifdMetadata[exifIfdId], 0xa005);
+
+        // Build the IFDs and the MakerNote from metadata
+        DataBuf valueBuf;
+        Ifd ifd0(ifd0Id);
+        encodeIfd(ifd0, ifdMetadata[ifd0Id], byteOrder(), valueBuf);
         Ifd exifIfd(exifIfdId);
-        addToIfd(exifIfd, begin(), end(), byteOrder());
+        encodeIfd(exifIfd, ifdMetadata[exifIfdId], byteOrder(), valueBuf);
+        Ifd iopIfd(iopIfdId);
+        encodeIfd(iopIfd, ifdMetadata[iopIfdId], byteOrder(), valueBuf);
+        Ifd gpsIfd(gpsIfdId);
+        encodeIfd(gpsIfd, ifdMetadata[gpsIfdId], byteOrder(), valueBuf);
+        Ifd ifd1(ifd1Id);
+        encodeIfd(ifd1, ifdMetadata[ifd1Id], byteOrder(), valueBuf);
         MakerNote::AutoPtr makerNote;
         if (makerNote_.get() != 0) {
-            // Build MakerNote from metadata
             makerNote = makerNote_->clone();
-            addToMakerNote(makerNote.get(), 
-                           begin(), end(), 
-                           makerNote_->byteOrder());
+            const std::vector<const Exifdatum*>& mn = ifdMetadata[makerIfdId];
+            for (std::vector<const Exifdatum*>::const_iterator i = mn.begin();
+                 i != mn.end(); ++i) {
+                addToMakerNote(makerNote.get(), **i, makerNote_->byteOrder());
+            }
             // Create a placeholder MakerNote entry of the correct size and
             // add it to the Exif IFD (because we don't know the offset yet)
             Entry e;
@@ -556,106 +1144,55 @@ namespace Exiv2 {
             DataBuf tmpBuf(makerNote->size());
             memset(tmpBuf.pData_, 0x0, tmpBuf.size_);
             e.setValue(undefined, tmpBuf.size_, tmpBuf.pData_, tmpBuf.size_);
-            exifIfd.erase(0x927c);
             exifIfd.add(e);
         }
 
-        // Build Interoperability IFD from metadata
-        Ifd iopIfd(iopIfdId);
-        addToIfd(iopIfd, begin(), end(), byteOrder());
-
-        // Build GPSInfo IFD from metadata
-        Ifd gpsIfd(gpsIfdId);
-        addToIfd(gpsIfd, begin(), end(), byteOrder());
-
-        // build IFD1 from metadata
-        Ifd ifd1(ifd1Id);
-        addToIfd(ifd1, begin(), end(), byteOrder());
-        // Set a temporary dummy offset in IFD0
-        if (ifd1.size() > 0) {
+        // Add the pointers to the sub-IFDs and IFD1 with dummy offsets, so
+        // that all entries are known before the layout is computed
+        bool hasIop  = iopIfd.size() > 0;
+        bool hasExif = exifIfd.size() > 0 || hasIop;
+        bool hasGps  = gpsIfd.size() > 0;
+        bool hasIfd1 = ifd1.size() > 0;
+        if (hasIfd1) {
             ifd0.setNext(1, byteOrder());
         }
-
-        // Compute the new IFD offsets
-        int exifIdx = ifd0.erase(0x8769);
-        int gpsIdx  = ifd0.erase(0x8825);
-        int iopIdx  = exifIfd.erase(0xa005);
-
-        long ifd0Offset = tiffHeader_.size();
-        bool addOffsetTag = false;
-        long exifIfdOffset = ifd0Offset + ifd0.size() + ifd0.dataSize();
-        if (exifIfd.size() > 0 || iopIfd.size() > 0) {
-            exifIfdOffset += 12; 
-            addOffsetTag = true; 
-        }
-        if (gpsIfd.size() > 0) {
-            exifIfdOffset += 12; 
-            addOffsetTag = true; 
-        }
-        if (ifd0.size() == 0 && addOffsetTag) {
-            exifIfdOffset += 6; 
-        }
-        addOffsetTag = false;
-        long iopIfdOffset = exifIfdOffset + exifIfd.size() + exifIfd.dataSize(); 
-        if (iopIfd.size() > 0) {
-            iopIfdOffset += 12;
-            addOffsetTag = true; 
-        }
-        if (exifIfd.size() == 0 && addOffsetTag) {
-            iopIfdOffset += 6;
-        }
-        long gpsIfdOffset = iopIfdOffset + iopIfd.size() + iopIfd.dataSize();
-        long ifd1Offset   = gpsIfdOffset + gpsIfd.size() + gpsIfd.dataSize();
-
-        // Set the offset to IFD1 in IFD0
-        if (ifd1.size() > 0) {
-            ifd0.setNext(ifd1Offset, byteOrder());
-        }
-
-        // Set the offset to the Exif IFD in IFD0
-        if (exifIfd.size() > 0 || iopIfd.size() > 0) {
-            setOffsetTag(ifd0, exifIdx, 0x8769, exifIfdOffset, byteOrder());
-        }
-        // Set the offset to the GPSInfo IFD in IFD0
-        if (gpsIfd.size() > 0) {
-            setOffsetTag(ifd0, gpsIdx, 0x8825, gpsIfdOffset, byteOrder());
-        }
-        // Set the offset to the Interoperability IFD in Exif IFD
-        if (iopIfd.size() > 0) {
-            setOffsetTag(exifIfd, iopIdx, 0xa005, iopIfdOffset, byteOrder());
-        }
-
-        // Allocate a data buffer big enough for all metadata
+        if (hasExif) setOffsetTag(ifd0, exifIdx, 0x8769, 0, byteOrder());
+        if (hasGps)  setOffsetTag(ifd0, gpsIdx, 0x8825, 0, byteOrder());
+        if (hasIop)  setOffsetTag(exifIfd, iopIdx, 0xa005, 0, byteOrder());
+
+        // Compute the offsets of the IFDs, they follow each other in this order
+        Ifd* ifds[] = { &ifd0, &exifIfd, &iopIfd, &gpsIfd, &ifd1 };
+        const int ifdCount = sizeof(ifds) / sizeof(ifds[0]);
+        long offsets[ifdCount];
         long size = tiffHeader_.size();
-        size += ifd0.size() + ifd0.dataSize();
-        size += exifIfd.size() + exifIfd.dataSize();
-        size += iopIfd.size() + iopIfd.dataSize();
-        size += gpsIfd.size() + gpsIfd.dataSize();
-        size += ifd1.size() + ifd1.dataSize();
+        for (int i = 0; i < ifdCount; ++i) {
+            offsets[i] = size;
+            size += ifds[i]->size() + ifds[i]->dataSize();
+        }
+        const long exifIfdOffset = offsets[1];
+        if (hasIfd1) ifd0.setNext(offsets[4], byteOrder());
+        if (hasExif) setOffsetTag(ifd0, exifIdx, 0x8769, exifIfdOffset, byteOrder());
+        if (hasGps)  setOffsetTag(ifd0, gpsIdx, 0x8825, offsets[3], byteOrder());
+        if (hasIop)  setOffsetTag(exifIfd, iopIdx, 0xa005, offsets[2], byteOrder());
+
+        // Copy the TIFF header, all IFDs, MakerNote and thumbnail to a buffer
+        // big enough for all metadata
         DataBuf buf(size);
-
-        // Copy the TIFF header, all IFDs, MakerNote and thumbnail to the buffer
         size = tiffHeader_.copy(buf.pData_);
-        ifd0.sortByTag();
-        size += ifd0.copy(buf.pData_ + ifd0Offset, byteOrder(), ifd0Offset);
-        exifIfd.sortByTag();
-        size += exifIfd.copy(buf.pData_ + exifIfdOffset, byteOrder(), exifIfdOffset);
-        if (makerNote.get() != 0) {
-            // Copy the MakerNote over the placeholder data
-            Entries::iterator mn = exifIfd.findTag(0x927c);
-            // Do _not_ sort the makernote; vendors (at least Canon), don't seem
-            // to bother about this TIFF standard requirement, so writing the
-            // makernote as is might result in fewer deviations from the original
-            makerNote->copy(buf.pData_ + exifIfdOffset + mn->offset(),
-                            byteOrder(),
-                            exifIfdOffset + mn->offset());
-        }
-        iopIfd.sortByTag();
-        size += iopIfd.copy(buf.pData_ + iopIfdOffset, byteOrder(), iopIfdOffset);
-        gpsIfd.sortByTag();
-        size += gpsIfd.copy(buf.pData_ + gpsIfdOffset, byteOrder(), gpsIfdOffset);
-        ifd1.sortByTag();
-        size += ifd1.copy(buf.pData_ + ifd1Offset, byteOrder(), ifd1Offset);
+        for (int i = 0; i < ifdCount; ++i) {
+            ifds[i]->sortByTag();
+            size += ifds[i]->copy(buf.pData_ + offsets[i], byteOrder(), offsets[i]);
+            if (ifds[i] == &exifIfd && makerNote.get() != 0) {
+                // Copy the MakerNote over the placeholder data
+                Entries::iterator mn = exifIfd.findTag(0x927c);
+                // Do _not_ sort the makernote; vendors (at least Canon), don't seem
+                // to bother about this TIFF standard requirement, so writing the
+                // makernote as is might result in fewer deviations from the original
+                makerNote->copy(buf.pData_ + exifIfdOffset + mn->offset(),
+                                byteOrder(),
+                                exifIfdOffset + mn->offset());
+            }
+        }
         assert(size == buf.size_);
         return buf;
     } // ExifData::copyFromMetadata
@@ -663,10 +1200,10 @@ namespace Exiv2 {
     int ExifData::writeExifData(const std::string& path)
     {
         DataBuf buf(copy());
-        ExvImage exvImage(path, true);
-        if (!exvImage.good()) return -1;
-        exvImage.setExifData(buf.pData_, buf.size_);
-        return exvImage.writeMetadata();
+        Image::AutoPtr image = ImageFactory::instance().create(Image::exv, path);
+        if (image.get() == 0) return -1;
+        image->setExifData(buf.pData_, buf.size_);
+        return image->writeMetadata();
     } // ExifData::writeExifData
 
     void ExifData::add(Entries::const_iterator begin, 
@@ -679,6 +1216,26 @@ namespace Exiv2 {
         }
     }
 
+    void ExifData::addEntries(Entries::const_iterator begin, 
+                              Entries::const_iterator end,
+                              ByteOrder byteOrder)
+    {
+        if (pEntries_ == 0) {
+            add(begin, end, byteOrder);
+            return;
+        }
+        for (Entries::const_iterator i = begin; i != end; ++i) {
+            long entry = pEntries_->add(*i, byteOrder);
+            if (entry == -1) {
+                exifMetadata_.push_back(Exifdatum(*i, byteOrder));
+            }
+            else {
+                exifMetadata_.push_back(Exifdatum(pEntries_, entry));
+            }
+            index_.add(indexId(i->ifdId(), i->tag()), count() - 1);
+        }
+    } // ExifData::addEntries
+
     void ExifData::add(const ExifKey& key, const Value* pValue)
     {
         add(Exifdatum(key, pValue));
@@ -698,18 +1255,19 @@ namespace Exiv2 {
         }
         // allow duplicates
         exifMetadata_.push_back(exifdatum);
+        index_.add(indexId(exifdatum.ifdId(), exifdatum.tag()), count() - 1);
     }
 
     ExifData::const_iterator ExifData::findKey(const ExifKey& key) const
     {
-        return std::find_if(exifMetadata_.begin(), exifMetadata_.end(),
-                            FindMetadatumByKey(key.key()));
+        long pos = findPos(key);
+        return pos == -1 ? end() : begin() + pos;
     }
 
     ExifData::iterator ExifData::findKey(const ExifKey& key)
     {
-        return std::find_if(exifMetadata_.begin(), exifMetadata_.end(),
-                            FindMetadatumByKey(key.key()));
+        long pos = findPos(key);
+        return pos == -1 ? end() : begin() + pos;
     }
 
     ExifData::const_iterator ExifData::findIfdIdIdx(IfdId ifdId, int idx) const
@@ -727,18 +1285,28 @@ namespace Exiv2 {
     void ExifData::sortByKey()
     {
         std::sort(exifMetadata_.begin(), exifMetadata_.end(), cmpMetadataByKey);
+        index_.invalidate();
     }
 
     void ExifData::sortByTag()
     {
         std::sort(exifMetadata_.begin(), exifMetadata_.end(), cmpMetadataByTag);
+        index_.invalidate();
     }
 
     ExifData::iterator ExifData::erase(ExifData::iterator pos)
     {
+        index_.invalidate();
         return exifMetadata_.erase(pos);
     }
 
+    ExifData::iterator ExifData::erase(ExifData::iterator beg,
+                                       ExifData::iterator end)
+    {
+        index_.invalidate();
+        return exifMetadata_.erase(beg, end);
+    }
+
     void ExifData::setJpegThumbnail(const byte* buf, long size)
     {
         (*this)["Exif.Thumbnail.Compression"] = uint16_t(6);
@@ -894,160 +1462,203 @@ namespace Exiv2 {
 
     } // ExifData::getThumbnail
 
-    int ExifData::readThumbnail()
+    int ExifData::readThumbnail(const byte* buf, long len)
     {
         int rc = -1;
         Thumbnail::AutoPtr thumbnail = getThumbnail();
         if (thumbnail.get() != 0) {
-            rc = thumbnail->setDataArea(*this, ifd1_, pData_, size_);
+            rc = thumbnail->setDataArea(*this, ifd1_, buf, len);
         }
         return rc;
 
     } // ExifData::readThumbnail
 
-    bool ExifData::updateEntries()
+    int ExifData::findThumbnail(const std::string& path, 
+                                long& offset, long& size)
     {
-        if (!this->compatible()) return false;
-
-        bool compatible = true;
-        compatible &= updateRange(ifd0_.begin(), ifd0_.end(), byteOrder());
-        compatible &= updateRange(exifIfd_.begin(), exifIfd_.end(), byteOrder());
-        if (makerNote_.get() != 0) {
-            compatible &= updateRange(makerNote_->begin(), 
-                                      makerNote_->end(), 
-                                      makerNote_->byteOrder());
+        BasicIo::AutoPtr fileIo(new FileIo(path));
+        if (fileIo->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(fileIo);
+        if (image.get() == 0) return -2;
+        long exifOffset = 0;
+        long exifSize = 0;
+        int rc = image->locateExifData(exifOffset, exifSize);
+        if (rc) return rc;
+        BasicIo& io = image->io();
+
+        // Read the TIFF header and the offset of IFD1 at the end of IFD0
+        byte buf[12];
+        TiffHeader tiffHeader;
+        if (exifSize < tiffHeader.size()) return 3;
+        if (!readAt(io, exifOffset, buf, tiffHeader.size())) return 1;
+        if (tiffHeader.read(buf) != 0) return 3;
+        ByteOrder byteOrder = tiffHeader.byteOrder();
+        long o = tiffHeader.offset();
+        if (o > exifSize - 2) return 6;
+        if (!readAt(io, exifOffset + o, buf, 2)) return 1;
+        o += 2 + 12 * getUShort(buf, byteOrder);
+        if (o > exifSize - 4) return 6;
+        if (!readAt(io, exifOffset + o, buf, 4)) return 1;
+        o = getULong(buf, byteOrder);
+        if (o == 0) return 8;
+
+        // Read the directory entries of IFD1
+        if (o > exifSize - 2) return 6;
+        if (!readAt(io, exifOffset + o, buf, 2)) return 1;
+        long n = getUShort(buf, byteOrder);
+        if (o + 2 + 12 * n > exifSize) return 6;
+        DataBuf ifd1(12 * n);
+        if (n > 0 && !readAt(io, exifOffset + o + 2, ifd1.pData_, 12 * n)) {
+            return 1;
+        }
+        long thumbOffset = -1;
+        long thumbSize = -1;
+        for (long i = 0; i < n; ++i) {
+            const byte* pEntry = ifd1.pData_ + 12 * i;
+            uint16_t tag = getUShort(pEntry, byteOrder);
+            if (tag != 0x0201 && tag != 0x0202) continue;
+            uint16_t type = getUShort(pEntry + 2, byteOrder);
+            long value = type == unsignedShort
+                ? getUShort(pEntry + 8, byteOrder) 
+                : static_cast<long>(getULong(pEntry + 8, byteOrder));
+            if (tag == 0x0201) thumbOffset = value;
+            else thumbSize = value;
         }
-        compatible &= updateRange(iopIfd_.begin(), iopIfd_.end(), byteOrder());
-        compatible &= updateRange(gpsIfd_.begin(), gpsIfd_.end(), byteOrder());
-        compatible &= updateRange(ifd1_.begin(), ifd1_.end(), byteOrder());
+        if (thumbOffset < 0 || thumbSize <= 0) return 8;
+        if (thumbOffset > exifSize || thumbSize > exifSize - thumbOffset) {
+            return 6;
+        }
+        offset = exifOffset + thumbOffset;
+        size = thumbSize;
+        return 0;
+    } // ExifData::findThumbnail
 
-        return compatible;
-    } // ExifData::updateEntries
+    void ExifData::releaseData()
+    {
+        // The entries own the data buffer until it is taken
+        if (pEntries_ == 0 || pData_ != pEntries_->data()) {
+            delete[] pData_;
+        }
+        if (pEntries_ != 0) {
+            pEntries_->release();
+        }
+        pEntries_ = 0;
+        pData_ = 0;
+        size_ = 0;
+    } // ExifData::releaseData
 
-    bool ExifData::updateRange(const Entries::iterator& begin, 
-                               const Entries::iterator& end,
-                               ByteOrder byteOrder)
-    {
-        bool compatible = true;
-        for (Entries::iterator entry = begin; entry != end; ++entry) {
-            // find the corresponding Exifdatum
-            const_iterator md = findIfdIdIdx(entry->ifdId(), entry->idx());
-            if (md == this->end()) {
-                // corresponding Exifdatum was deleted: this is not (yet) a
-                // supported non-intrusive write operation.
-                compatible = false;
-                continue;
-            }
+    bool ExifData::updateEntries()
+    {
+        // Index the entries of the IFDs and the MakerNote by IFD id and idx
+        EntryIndex entries;
+        entries.add(ifd0_.begin(), ifd0_.end(), byteOrder());
+        entries.add(exifIfd_.begin(), exifIfd_.end(), byteOrder());
+        if (makerNote_.get() != 0) {
+            entries.add(makerNote_->begin(), 
+                        makerNote_->end(), 
+                        makerNote_->byteOrder());
+        }
+        entries.add(iopIfd_.begin(), iopIfd_.end(), byteOrder());
+        entries.add(gpsIfd_.begin(), gpsIfd_.end(), byteOrder());
+        entries.add(ifd1_.begin(), ifd1_.end(), byteOrder());
+
+        // Pair each Exifdatum with its entry and collect the changed ones.
+        // An Exifdatum which still refers to its entry is unchanged.
+        std::vector<EntryIndex::Slot*> changed;
+        for (const_iterator md = begin(); md != end(); ++md) {
+            EntryIndex::Slot* slot = entries.find(md->ifdId(), md->idx());
+            // New and duplicate metadata are not (yet) supported
+            // non-intrusive write operations
+            if (slot == 0 || slot->pExifdatum_ != 0) return false;
+            slot->pExifdatum_ = &*md;
+            if (md->entry_ >= 0 && md->pEntries_ == pEntries_) continue;
+            const Entry* entry = slot->pEntry_;
             if (entry->count() == 0 && md->count() == 0) {
                 // Special case: don't do anything if both the entry and 
                 // Exifdatum have no data. This is to preserve the original
                 // data in the offset field of an IFD entry with count 0,
                 // if the Exifdatum was not changed.
-            }
-            else if (   entry->size() < md->size()
-                     || entry->sizeDataArea() < md->sizeDataArea()) {
-                compatible = false;
                 continue;
             }
-            else {
-                // Hack: Set the entry's value only if there is no data area.
-                // This ensures that the original offsets are not overwritten
-                // with relative offsets from the Exifdatum (which require
-                // conversion to offsets relative to the start of the TIFF
-                // header and that is currently only done in intrusive write
-                // mode). On the other hand, it is thus now not possible to
-                // change the offsets of an entry with a data area in
-                // non-intrusive mode. This can be considered a bug. 
-                // Todo: Fix me!
-                if (md->sizeDataArea() == 0) {
-                    DataBuf buf(md->size());
-                    md->copy(buf.pData_, byteOrder);
-                    entry->setValue(static_cast<uint16_t>(md->typeId()), 
-                                    md->count(), 
-                                    buf.pData_, md->size());
-                }
-                // Always set the data area
-                DataBuf dataArea(md->dataArea());
-                entry->setDataArea(dataArea.pData_, dataArea.size_);
-            }
+            if (   entry->size() < md->size()
+                || entry->sizeDataArea() < md->sizeDataArea()) return false;
+            changed.push_back(slot);
         }
-        return compatible;
-    } // ExifData::updateRange
-
-    bool ExifData::compatible() const
-    {
-        bool compatible = true;
-        // For each Exifdatum, check if it is compatible with the corresponding
-        // IFD or MakerNote entry
-        for (const_iterator md = begin(); md != this->end(); ++md) {
-            std::pair<bool, Entries::const_iterator> rc;
-            rc = findEntry(md->ifdId(), md->idx());
-            // Make sure that we have an entry
-            if (!rc.first) {
-                compatible = false;
-                break;
-            }
-            // Make sure that the size of the Exifdatum fits the available size
-            // of the entry
-            if (   md->size() > rc.second->size() 
-                || md->sizeDataArea() > rc.second->sizeDataArea()) {
-                compatible = false;
-                break;
+        // Neither is deleted metadata
+        if (entries.count() != count()) return false;
+        if (changed.empty()) return true;
+
+        // The metadata must not see the changes that non-intrusive writing
+        // makes to the data buffer
+        if (pEntries_ != 0 && pData_ == pEntries_->data()) {
+            pData_ = pEntries_->takeData();
+        }
+        std::vector<EntryIndex::Slot*>::const_iterator end = changed.end();
+        for (std::vector<EntryIndex::Slot*>::const_iterator i = changed.begin();
+             i != end; ++i) {
+            Entry* entry = (*i)->pEntry_;
+            const Exifdatum* md = (*i)->pExifdatum_;
+            // Hack: Set the entry's value only if there is no data area.
+            // This ensures that the original offsets are not overwritten
+            // with relative offsets from the Exifdatum (which require
+            // conversion to offsets relative to the start of the TIFF
+            // header and that is currently only done in intrusive write
+            // mode). On the other hand, it is thus now not possible to
+            // change the offsets of an entry with a data area in
+            // non-intrusive mode. This can be considered a bug. 
+            // Todo: Fix me!
+            if (md->sizeDataArea() == 0) {
+                DataBuf buf(md->size());
+                md->copy(buf.pData_, (*i)->byteOrder_);
+                entry->setValue(static_cast<uint16_t>(md->typeId()), 
+                                md->count(), 
+                                buf.pData_, md->size());
             }
+            // Always set the data area
+            DataBuf dataArea(md->dataArea());
+            entry->setDataArea(dataArea.pData_, dataArea.size_);
         }
-        return compatible;
-    } // ExifData::compatible
+        return true;
+    } // ExifData::updateEntries
 
-    std::pair<bool, Entries::const_iterator> 
-    ExifData::findEntry(IfdId ifdId, int idx) const
+    long ExifData::findPos(const ExifKey& key) const
     {
-        Entries::const_iterator entry;
-        std::pair<bool, Entries::const_iterator> rc(false, entry);
-
-        if (ifdId == makerIfdId && makerNote_.get() != 0) {
-            entry = makerNote_->findIdx(idx);
-            if (entry != makerNote_->end()) {
-                rc.first = true;
-                rc.second = entry;
-            }
-            return rc;
+        // All MakerNote tags of the metadata belong to the same MakerNote
+        if (   key.ifdId() == makerIfdId
+            && (   makerNote_.get() == 0
+                || makerNote_->ifdItem() != key.ifdItem())) {
+            return -1;
         }
-        const Ifd* ifd = getIfd(ifdId);
-        if (ifdId != makerIfdId && ifd) {
-            entry = ifd->findIdx(idx);
-            if (entry != ifd->end()) {
-                rc.first = true;
-                rc.second = entry;
+        const uint32_t id = indexId(key.ifdId(), key.tag());
+        if (index_.valid()) {
+            long pos = index_.find(id);
+            if (pos != -1) {
+                const Exifdatum& exifdatum = exifMetadata_[pos];
+                if (   exifdatum.tag() == key.tag()
+                    && exifdatum.ifdId() == key.ifdId()) return pos;
+            }
+            else {
+                // The key of a metadatum may have been changed through an
+                // iterator, so a miss is only trusted if no metadatum has
+                // the key. This compares the numbers without creating keys.
+                ExifMetadata::const_iterator md = exifMetadata_.begin();
+                ExifMetadata::const_iterator end = exifMetadata_.end();
+                for (; md != end; ++md) {
+                    if (md->tag() == key.tag() && md->ifdId() == key.ifdId()) {
+                        break;
+                    }
+                }
+                if (md == end) return -1;
             }
         }
-        return rc;
-    } // ExifData::findEntry
-
-    const Ifd* ExifData::getIfd(IfdId ifdId) const
-    {
-        const Ifd* ifd = 0;
-        switch (ifdId) {
-        case ifd0Id: 
-            ifd = &ifd0_;
-            break;
-        case exifIfdId: 
-            ifd = &exifIfd_;
-            break;
-        case iopIfdId: 
-            ifd = &iopIfd_;
-            break;
-        case gpsIfdId: 
-            ifd = &gpsIfd_;
-            break;
-        case ifd1Id: 
-            ifd = &ifd1_;
-            break;
-        default:
-            ifd = 0;
-            break;
+        // The index is invalid or out of date: rebuild it
+        index_.reset();
+        for (long i = 0; i < count(); ++i) {
+            index_.add(indexId(exifMetadata_[i].ifdId(),
+                               exifMetadata_[i].tag()), i);
         }
-        return ifd;
-    } // ExifData::getIfd
+        return index_.find(id);
+    } // ExifData::findPos
 
     std::string ExifData::strError(int rc, const std::string& path)
     {
@@ -1167,7 +1778,7 @@ namespace Exiv2 {
 
     std::ostream& operator<<(std::ostream& os, const Exifdatum& md)
     {
-        assert(md.key_.get() != 0);
+        assert(md.pKey() != 0);
         return md.key_->printTag(os, md.value());
     }
 }                                       // namespace Exiv2
@@ -1176,6 +1787,159 @@ namespace Exiv2 {
 // local definitions
 namespace {
 
+    bool readAt(Exiv2::BasicIo& io, long offset, Exiv2::byte* buf, long rcount)
+    {
+        return    io.seek(offset, Exiv2::BasicIo::beg) == 0
+               && io.read(buf, rcount) == rcount;
+    }
+
+    uint32_t indexId(Exiv2::IfdId ifdId, uint16_t tag)
+    {
+        return (static_cast<uint32_t>(ifdId) << 16) | tag;
+    }
+
+    void EntryIndex::add(Exiv2::Entries::iterator begin,
+                         Exiv2::Entries::iterator end,
+                         Exiv2::ByteOrder byteOrder)
+    {
+        for (Exiv2::Entries::iterator i = begin; i != end; ++i) {
+            const Exiv2::IfdId ifdId = i->ifdId();
+            const int idx = i->idx();
+            if (ifdId >= Exiv2::lastIfdId || idx < 0) continue;
+            std::vector<Slot>& slots = slots_[ifdId];
+            if (idx >= static_cast<int>(slots.size())) {
+                Slot empty = { 0, byteOrder, 0 };
+                slots.resize(idx + 1, empty);
+            }
+            // Like Ifd::findIdx, the first entry with an idx is used
+            if (slots[idx].pEntry_ != 0) continue;
+            slots[idx].pEntry_ = &*i;
+            slots[idx].byteOrder_ = byteOrder;
+            ++count_;
+        }
+    } // EntryIndex::add
+
+    EntryIndex::Slot* EntryIndex::find(Exiv2::IfdId ifdId, int idx)
+    {
+        if (ifdId >= Exiv2::lastIfdId || idx < 0) return 0;
+        std::vector<Slot>& slots = slots_[ifdId];
+        if (   idx >= static_cast<int>(slots.size())
+            || slots[idx].pEntry_ == 0) return 0;
+        return &slots[idx];
+    } // EntryIndex::find
+
+    KeyReader::KeyReader(Exiv2::ExifData& exifData,
+                         const std::vector<Exiv2::ExifKey>& keys)
+        : exifData_(exifData), keys_(keys)
+    {
+        std::fill(ifds_, ifds_ + Exiv2::lastIfdId, false);
+        std::vector<Exiv2::ExifKey>::const_iterator end = keys_.end();
+        for (std::vector<Exiv2::ExifKey>::const_iterator i = keys_.begin();
+             i != end; ++i) {
+            ifds_[i->ifdId()] = true;
+        }
+    }
+
+    bool KeyReader::enterIfd(Exiv2::IfdId ifdId)
+    {
+        switch (ifdId) {
+        case Exiv2::ifd0Id:
+            return    ifds_[Exiv2::ifd0Id] || ifds_[Exiv2::exifIfdId]
+                   || ifds_[Exiv2::iopIfdId] || ifds_[Exiv2::gpsIfdId];
+        case Exiv2::exifIfdId:
+            return ifds_[Exiv2::exifIfdId] || ifds_[Exiv2::iopIfdId];
+        case Exiv2::makerIfdId:
+            return false;
+        default:
+            return ifds_[ifdId];
+        }
+    }
+
+    bool KeyReader::visitEntry(Exiv2::IfdId ifdId,
+                               uint16_t tag,
+                               uint16_t type,
+                               uint32_t,
+                               const Exiv2::byte* pData,
+                               long size,
+                               Exiv2::ByteOrder byteOrder)
+    {
+        std::vector<Exiv2::ExifKey>::iterator end = keys_.end();
+        for (std::vector<Exiv2::ExifKey>::iterator i = keys_.begin();
+             i != end; ++i) {
+            if (i->ifdId() == ifdId && i->tag() == tag) {
+                Exiv2::Value::AutoPtr value 
+                    = Exiv2::Value::create(Exiv2::TypeId(type));
+                value->read(pData, size, byteOrder);
+                exifData_.add(*i, value.get());
+                keys_.erase(i);
+                break;
+            }
+        }
+        return !keys_.empty();
+    }
+
+    EntryReader::EntryReader(Exiv2::ExifEntries& entries,
+                             const Exiv2::byte* buf,
+                             Exiv2::ByteOrder byteOrder)
+        : entries_(entries), buf_(buf), byteOrder_(byteOrder),
+          pMakerNote_(0), sizeMakerNote_(0), makerNoteEntry_(-1),
+          ifd1SubIfds_(false)
+    {
+        std::fill(idx_, idx_ + Exiv2::lastIfdId, 0);
+    }
+
+    bool EntryReader::enterIfd(Exiv2::IfdId ifdId)
+    {
+        if (ifdId != Exiv2::makerIfdId) return true;
+        // The makernote entries refer to the buffer (alloc is false)
+        long offset = static_cast<long>(pMakerNote_ - buf_);
+        Exiv2::MakerNote::AutoPtr makerNote
+            = Exiv2::MakerNoteFactory::instance().create(
+                make_, model_, false, pMakerNote_, sizeMakerNote_,
+                byteOrder_, offset);
+        if (   makerNote.get() == 0
+            || makerNote->read(pMakerNote_, sizeMakerNote_,
+                               byteOrder_, offset) != 0) {
+            return false;
+        }
+        // The parsed MakerNote replaces the raw makernote entry
+        if (makerNoteEntry_ != -1) entries_.erase(makerNoteEntry_);
+        Exiv2::Entries::const_iterator end = makerNote->end();
+        for (Exiv2::Entries::const_iterator i = makerNote->begin(); i != end; ++i) {
+            entries_.add(*i, makerNote->byteOrder());
+        }
+        // Kept to write the metadata, a clone would lose the byte order
+        makerNote_ = makerNote;
+        return false;
+    }
+
+    bool EntryReader::visitEntry(Exiv2::IfdId ifdId,
+                                 uint16_t tag,
+                                 uint16_t type,
+                                 uint32_t,
+                                 const Exiv2::byte* pData,
+                                 long size,
+                                 Exiv2::ByteOrder byteOrder)
+    {
+        int idx = ++idx_[ifdId];
+        if (ifdId == Exiv2::ifd1Id && (tag == 0x8769 || tag == 0x8825)) {
+            ifd1SubIfds_ = true;
+            return true;
+        }
+        long entry = entries_.add(ifdId, idx, tag, type, pData, size, byteOrder);
+        if (ifdId == Exiv2::ifd0Id && (tag == 0x010f || tag == 0x0110)) {
+            const char* p = reinterpret_cast<const char*>(pData);
+            std::string value(p, std::find(p, p + size, '\0'));
+            if (tag == 0x010f) make_ = value; else model_ = value;
+        }
+        if (ifdId == Exiv2::exifIfdId && tag == 0x927c) {
+            pMakerNote_ = pData;
+            sizeMakerNote_ = size;
+            makerNoteEntry_ = entry;
+        }
+        return true;
+    }
+
     void setOffsetTag(Exiv2::Ifd& ifd,
                       int idx,
                       uint16_t tag,
@@ -1195,6 +1959,52 @@ namespace {
         pos->setValue(offset, byteOrder);
     }
 
+    int eraseTag(std::vector<const Exiv2::Exifdatum*>& mds, uint16_t tag)
+    {
+        std::vector<const Exiv2::Exifdatum*>::iterator end = mds.end();
+        for (std::vector<const Exiv2::Exifdatum*>::iterator i = mds.begin();
+             i != end; ++i) {
+            if ((*i)->tag() == tag) {
+                int idx = (*i)->idx();
+                mds.erase(i);
+                return idx;
+            }
+        }
+        return 0;
+    }
+
+    void encodeIfd(Exiv2::Ifd& ifd,
+                   const std::vector<const Exiv2::Exifdatum*>& mds,
+                   Exiv2::ByteOrder byteOrder,
+                   Exiv2::DataBuf& buf)
+    {
+        // Leave room for the pointers to sub-IFDs and the MakerNote
+        ifd.reserve(static_cast<long>(mds.size()) + 3);
+        std::vector<const Exiv2::Exifdatum*>::const_iterator end = mds.end();
+        for (std::vector<const Exiv2::Exifdatum*>::const_iterator i
+                 = mds.begin(); i != end; ++i) {
+            const Exiv2::Exifdatum& md = **i;
+            // Add an empty entry, then set its value in place
+            Exiv2::Entry e;
+            e.setIfdId(md.ifdId());
+            e.setIdx(md.idx());
+            e.setTag(md.tag());
+            e.setOffset(0);  // will be calculated when the IFD is written
+            ifd.add(e);
+            Exiv2::Ifd::iterator pos = ifd.end() - 1;
+
+            long size = md.size();
+            buf.alloc(size);
+            md.copy(buf.pData_, byteOrder);
+            pos->setValue(static_cast<uint16_t>(md.typeId()), md.count(),
+                          buf.pData_, size);
+            if (md.sizeDataArea() > 0) {
+                Exiv2::DataBuf dataArea(md.dataArea());
+                pos->setDataArea(dataArea.pData_, dataArea.size_);
+            }
+        }
+    }
+
     Exiv2::DataBuf readFile(const std::string& path)
     {
         Exiv2::FileCloser file(fopen(path.c_str(), "rb"));
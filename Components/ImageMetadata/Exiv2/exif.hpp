@@ -56,6 +56,7 @@ namespace Exiv2 {
 // *****************************************************************************
 // class declarations
     class ExifData;
+    class ExifEntries;
     class MakerNote;
 
 // *****************************************************************************
@@ -64,8 +65,20 @@ namespace Exiv2 {
     /*!
       @brief Information related to one Exif tag. An Exif metadatum consists of
              an ExifKey and a Value and provides methods to manipulate these.
+
+      An %Exifdatum read by ExifData refers to its entry in the Exif data
+      buffer until its key or value is used; they are only created then, in
+      an arena shared by all metadata read from the buffer. The buffer and
+      the arena are kept as long as an %Exifdatum refers to them.
+
+      Copies of an %Exifdatum share the buffer and the arena, which are
+      locked when they are used, so copies may be used and destroyed by
+      different threads. One %Exifdatum must not be used by several threads
+      at the same time, not even through const accessors, which create its
+      key and value.
      */
     class Exifdatum : public Metadatum {
+        friend class ExifData;
         friend std::ostream& operator<<(std::ostream&, const Exifdatum&);
         template<typename T> friend Exifdatum& setValue(Exifdatum&, const T&);
     public:
@@ -164,35 +177,33 @@ namespace Exiv2 {
                   value has no data area, else 0.
          */
         int setDataArea(const byte* buf, long len) 
-            { return value_.get() == 0 ? -1 : value_->setDataArea(buf, len); }
+            { if (pValue() == 0) return -1;
+              release(); return value_->setDataArea(buf, len); }
         //@}
 
         //! @name Accessors
         //@{
         //! Return the key of the %Exifdatum. 
         std::string key() const 
-            { return key_.get() == 0 ? "" : key_->key(); }
+            { return pKey() == 0 ? "" : key_->key(); }
         //! Return the name of the group (the second part of the key)
         std::string groupName() const
-            { return key_.get() == 0 ? "" : key_->groupName(); }
+            { return pKey() == 0 ? "" : key_->groupName(); }
         //! Return the name of the tag (which is also the third part of the key)
         std::string tagName() const
-            { return key_.get() == 0 ? "" : key_->tagName(); }
-        //! Return the tag
-        uint16_t tag() const
-            { return key_.get() == 0 ? 0xffff : key_->tag(); }
-        //! Return the IFD id
-        IfdId ifdId() const 
-            { return key_.get() == 0 ? ifdIdNotSet : key_->ifdId(); }
+            { return pKey() == 0 ? "" : key_->tagName(); }
+        //! Return the tag, does not create the key
+        uint16_t tag() const;
+        //! Return the IFD id, does not create the key
+        IfdId ifdId() const;
         //! Return the name of the IFD
         const char* ifdName() const
-            { return key_.get() == 0 ? "" : key_->ifdName(); }
+            { return pKey() == 0 ? "" : key_->ifdName(); }
         //! Return the related image item (deprecated)
         std::string ifdItem() const 
-            { return key_.get() == 0 ? "" : key_->ifdItem(); }
-        //! Return the index (unique id of this key within the original IFD)
-        int idx() const
-            { return key_.get() == 0 ? 0 : key_->idx(); }
+            { return pKey() == 0 ? "" : key_->ifdItem(); }
+        //! Return the index (unique id within the original IFD), does not create the key
+        int idx() const;
         /*!
           @brief Write value to a data buffer and return the number
                  of bytes written.
@@ -205,10 +216,10 @@ namespace Exiv2 {
           @return Number of characters written.
         */
         long copy(byte* buf, ByteOrder byteOrder) const 
-            { return value_.get() == 0 ? 0 : value_->copy(buf, byteOrder); }
+            { return pValue() == 0 ? 0 : value_->copy(buf, byteOrder); }
         //! Return the type id of the value
         TypeId typeId() const 
-            { return value_.get() == 0 ? invalidTypeId : value_->typeId(); }
+            { return pValue() == 0 ? invalidTypeId : value_->typeId(); }
         //! Return the name of the type
         const char* typeName() const 
             { return TypeInfo::typeName(typeId()); }
@@ -217,13 +228,13 @@ namespace Exiv2 {
             { return TypeInfo::typeSize(typeId()); }
         //! Return the number of components in the value
         long count() const 
-            { return value_.get() == 0 ? 0 : value_->count(); }
+            { return pValue() == 0 ? 0 : value_->count(); }
         //! Return the size of the value in bytes
         long size() const 
-            { return value_.get() == 0 ? 0 : value_->size(); }
+            { return pValue() == 0 ? 0 : value_->size(); }
         //! Return the value as a string.
         std::string toString() const 
-            { return value_.get() == 0 ? "" : value_->toString(); }
+            { return pValue() == 0 ? "" : value_->toString(); }
         /*!
           @brief Return the <EM>n</EM>-th component of the value converted to
                  long. The return value is -1 if the value of the Exifdatum is
@@ -231,7 +242,7 @@ namespace Exiv2 {
                  is no n-th component.
          */
         long toLong(long n =0) const 
-            { return value_.get() == 0 ? -1 : value_->toLong(n); }
+            { return pValue() == 0 ? -1 : value_->toLong(n); }
         /*!
           @brief Return the <EM>n</EM>-th component of the value converted to
                  float.  The return value is -1 if the value of the Exifdatum is
@@ -239,7 +250,7 @@ namespace Exiv2 {
                  is no n-th component.
          */
         float toFloat(long n =0) const 
-            { return value_.get() == 0 ? -1 : value_->toFloat(n); }
+            { return pValue() == 0 ? -1 : value_->toFloat(n); }
         /*!
           @brief Return the <EM>n</EM>-th component of the value converted to
                  Rational. The return value is -1/1 if the value of the
@@ -247,7 +258,7 @@ namespace Exiv2 {
                  undefined if there is no n-th component.
          */
         Rational toRational(long n =0) const 
-            { return value_.get() == 0 ? Rational(-1, 1) : value_->toRational(n); }
+            { return pValue() == 0 ? Rational(-1, 1) : value_->toRational(n); }
         /*!
           @brief Return an auto-pointer to a copy (clone) of the value. The
                  caller owns this copy and the auto-pointer ensures that it will
@@ -262,7 +273,7 @@ namespace Exiv2 {
                   is not set.
          */
         Value::AutoPtr getValue() const 
-            { return value_.get() == 0 ? Value::AutoPtr(0) : value_->clone(); }
+            { return pValue() == 0 ? Value::AutoPtr(0) : value_->clone(); }
         /*!
           @brief Return a constant reference to the value. 
 
@@ -283,10 +294,10 @@ namespace Exiv2 {
           @throw Error ("Value not set") if the value is not set.
          */
         const Value& value() const 
-            { if (value_.get() != 0) return *value_; throw Error("Value not set"); }
+            { if (pValue() != 0) return *value_; throw Error("Value not set"); }
         //! Return the size of the data area.
         long sizeDataArea() const 
-            { return value_.get() == 0 ? 0 : value_->sizeDataArea(); }
+            { return pValue() == 0 ? 0 : value_->sizeDataArea(); }
         /*!
           @brief Return a copy of the data area of the value. The caller owns
                  this copy and %DataBuf ensures that it will be deleted.
@@ -300,14 +311,46 @@ namespace Exiv2 {
                   value is not set.
          */
         DataBuf dataArea() const
-            { return value_.get() == 0 ? DataBuf(0, 0) : value_->dataArea(); }
+            { return pValue() == 0 ? DataBuf(0, 0) : value_->dataArea(); }
 
         //@}
 
     private:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor to build an %Exifdatum that refers to entry
+                 \em entry of \em pEntries.
+         */
+        Exifdatum(ExifEntries* pEntries, long entry);
+        //@}
+
+        //! @name Accessors
+        //@{
+        //! Return the key, create it from the entry first if necessary
+        const ExifKey* pKey() const
+            { if (key_.get() == 0 && entry_ >= 0) loadKey(); return key_.get(); }
+        //! Return the value, create it from the entry first if necessary
+        const Value* pValue() const
+            { if (value_.get() == 0 && entry_ >= 0) loadValue(); return value_.get(); }
+        //! Create the key from the entry
+        void loadKey() const;
+        //! Create the value from the entry
+        void loadValue() const;
+        //! Create the key if necessary and stop reading from the entry
+        void release() const;
+        //@}
+
         // DATA
-        ExifKey::AutoPtr key_;                  //!< Key 
-        Value::AutoPtr   value_;                //!< Value
+        mutable ExifKey::AutoPtr key_;          //!< Key 
+        mutable Value::AutoPtr   value_;        //!< Value
+        /*!
+          Entries the key and value are created from, 0 if not used. Kept
+          as long as the key or value may be in the arena of the entries.
+         */
+        ExifEntries* pEntries_;
+        //! Index of the entry, -1 if the key and value are not read from it
+        mutable long entry_;
 
     }; // class Exifdatum
 
@@ -354,7 +397,8 @@ namespace Exiv2 {
                  \em buf. Return 0 if successful.
 
           @param exifData Exif data corresponding to the data buffer.
-          @param ifd1 Corresponding raw IFD1.
+          @param ifd1 Corresponding raw IFD1, empty if the internal IFDs
+                 are not kept.
           @param buf Data buffer containing the thumbnail data. The buffer must
                  start with the TIFF header.
           @param len Number of bytes in the data buffer.
@@ -478,6 +522,10 @@ namespace Exiv2 {
       - write Exif data to JPEG files
       - extract Exif metadata to files, insert from these files
       - extract and delete Exif thumbnail (JPEG and TIFF thumbnails)
+
+      An %ExifData must not be used by several threads at the same time, not
+      even through const accessors. Copies of an %ExifData may be used by
+      different threads, see Exifdatum.
     */
     class ExifData {
         //! @name Not implemented
@@ -514,14 +562,84 @@ namespace Exiv2 {
                     if the call to this function fails
          */
         int read(const std::string& path);
+        /*!
+          @brief Read only the Exif metadata with the given \em keys from
+                 file \em path, e.g., "Exif.Photo.DateTimeOriginal" and
+                 "Exif.Image.Orientation".
+
+          Only the IFDs which can hold the keys are walked and the walk
+          stops as soon as all keys are found. Other metadata, the
+          makernote and the thumbnail are not read. Keys which are not
+          found are not added. Makernote keys can not be looked up like
+          this, if one is requested, all Exif data is read and the other
+          keys are dropped. The Exif data is always rebuilt from the
+          metadata when it is written.
+
+          @param path Path to the file
+          @param keys Keys of the metadata to read
+          @return  0 if successful;<BR>
+                  -1 if the file can not be opened;<BR>
+                  -2 if the file contains an unknown image type;<BR>
+                   3 if the file contains no Exif data;<BR>
+                  the return code of Image::readMetadata()
+                    if the call to this function fails<BR>
+                  the return code of visitExif()
+                    if the call to this function fails
+          @throw Error ("Invalid key") if a key cannot be parsed.
+         */
+        int quickRead(const std::string& path,
+                      const std::vector<std::string>& keys);
         /*!
           @brief Read the Exif data from a byte buffer. The data buffer
                  must start with the TIFF header.
+
+                 If \em alloc is false, the data buffer is borrowed: it is
+                 neither copied nor parsed into internal IFDs, the metadata
+                 refers to it and its keys and values are only decoded when
+                 they are used. The caller keeps ownership of the buffer and
+                 must keep it valid and unchanged until this object and all
+                 copies of it and of its metadata are destroyed or read
+                 again. The Exif data is always rebuilt from the metadata
+                 when it is written (no non-intrusive writing). Use this to
+                 read the metadata of many images that are not written
+                 back.
           @param buf Pointer to the data buffer to read from
           @param len Number of bytes in the data buffer 
+          @param alloc Memory management mode. True: the data buffer is
+                 copied, false: the data buffer is borrowed.
           @return 0 if successful.
          */
-        int read(const byte* buf, long len);
+        int read(const byte* buf, long len, bool alloc =true);
+        /*!
+          @brief Read the Exif data from an image held in memory, e.g., the
+                 contents of a JPEG file. The image type is derived from the
+                 data, which is read in place without a temporary file.
+          @param data Pointer to the image data
+          @param size Number of bytes of image data
+          @return  0 if successful;<BR>
+                  -2 if the data is not of a known image type;<BR>
+                   3 if the image contains no Exif data;<BR>
+                  the return code of Image::readMetadata()
+                    if the call to this function fails<BR>
+                  the return code of read(const char* buf, long len)
+                    if the call to this function fails
+         */
+        int readImage(const byte* data, long size);
+        /*!
+          @brief Read the Exif data from \em image, e.g., opened with
+                 ImageFactory::open(). The image keeps the file open and
+                 remembers the position of its metadata, so that a
+                 write(Image& image, long padding) to the same image does
+                 not open and scan the file again.
+          @param image Image to read from
+          @return  0 if successful;<BR>
+                   3 if the image contains no Exif data;<BR>
+                  the return code of Image::readMetadata()
+                    if the call to this function fails<BR>
+                  the return code of read(const char* buf, long len)
+                    if the call to this function fails
+         */
+        int read(Image& image);
         /*!
           @brief Write the Exif data to file \em path. If an Exif data section
                  already exists in the file, it is replaced.  If there is no
@@ -529,9 +647,25 @@ namespace Exiv2 {
                  deleted from the file.  Otherwise, an Exif data section is
                  created. See copy(byte* buf) for further details.
 
+          @param path Path to the file.
+          @param padding Number of bytes to reserve for later edits if the
+                 file needs to be rewritten, see Image::setPadding().
           @return 0 if successful.
          */
-        int write(const std::string& path);
+        int write(const std::string& path, long padding =0);
+        /*!
+          @brief Write the Exif data to \em image like
+                 write(const std::string& path, long padding). The metadata
+                 of the image must have been read before, e.g., with
+                 read(Image& image); metadata which was not read is kept
+                 unchanged.
+
+          @param image Image to write to.
+          @param padding Number of bytes to reserve for later edits if the
+                 file needs to be rewritten, see Image::setPadding().
+          @return 0 if successful.
+         */
+        int write(Image& image, long padding =0);
         /*!
           @brief Write the Exif data to a binary file. By convention, the
                  filename extension should be ".exv". This file format contains
@@ -603,6 +737,13 @@ namespace Exiv2 {
                  by this call.
          */
         iterator erase(iterator pos);
+        /*!
+          @brief Delete the Exifdata in the range [\em beg, \em end) in one
+                 pass, return the position of the next exifdatum. Note that
+                 iterators into the metadata are potentially invalidated by
+                 this call.
+         */
+        iterator erase(iterator beg, iterator end);
         //! Sort metadata by key
         void sortByKey();
         //! Sort metadata by tag
@@ -778,12 +919,36 @@ namespace Exiv2 {
         Thumbnail::AutoPtr getThumbnail() const;
         //@}
 
+        /*!
+          @brief Find the JPEG thumbnail in the Exif data of file \em path
+                 and return its position in the file, so that it can be read
+                 directly from the file.
+
+          Only the TIFF header, the offset of IFD1 at the end of IFD0 and
+          IFD1 are read from the file, the Exif data is not parsed.
+
+          @param path Path to the file
+          @param offset Set to the offset of the thumbnail from the start of
+                 the file
+          @param size Set to the size of the thumbnail in bytes
+          @return  0 if successful;<BR>
+                  -1 if the file can not be opened;<BR>
+                  -2 if the file contains an unknown image type;<BR>
+                   3 if the file contains no Exif data;<BR>
+                   6 if the Exif data contains a broken IFD;<BR>
+                   8 if the Exif data does not contain a JPEG thumbnail;<BR>
+                  the return code of Image::locateExifData()
+                    if the call to this function fails
+         */
+        static int findThumbnail(const std::string& path, 
+                                 long& offset, long& size);
         /*!
           @brief Convert the return code \em rc from \n 
                  int read(const std::string& path); \n
                  int write(const std::string& path); \n
                  int writeExifData(const std::string& path); \n
-                 int writeThumbnail(const std::string& path) const; and \n
+                 int writeThumbnail(const std::string& path) const; \n
+                 int findThumbnail(const std::string& path, ...); and \n
                  int erase(const std::string& path) const \n
                  into an error message.
 
@@ -795,32 +960,50 @@ namespace Exiv2 {
         //! @name Manipulators
         //@{
         /*!
-          @brief Read the thumbnail from the data buffer. Assigns the thumbnail
-                 data area with the appropriate Exif tags. Return 0 if successful,
-                 i.e., if there is a thumbnail.
+          @brief Read the metadata of \em pImage and the Exif data from its
+                 internal buffer. Return -2 if \em pImage is 0, else see
+                 read(const std::string& path).
+         */
+        int readFromImage(Image* pImage);
+        /*!
+          @brief Read the thumbnail from data buffer \em buf of size \em len.
+                 Assigns the thumbnail data area with the appropriate Exif
+                 tags. Return 0 if successful, i.e., if there is a thumbnail.
          */
-        int readThumbnail();
+        int readThumbnail(const byte* buf, long len);
+        /*!
+          @brief Add all IFD entries in the range from iterator position begin
+                 to iterator position end to the metadata. If the data buffer
+                 was copied, the metadata refers to the entries and their
+                 keys and values are only created when they are used.
+         */
+        void addEntries(Entries::const_iterator begin, 
+                        Entries::const_iterator end,
+                        ByteOrder byteOrder);
+        /*!
+          @brief Read the Exif data from \em buf in place, see read(). The
+                 metadata refers to the buffer, no internal IFDs are kept.
+         */
+        int readInPlace(const byte* buf, long len);
+        //! Release the data buffer
+        void releaseData();
         /*!
           @brief Check if the metadata changed and update the internal IFDs and
                  the MakerNote if the changes are compatible with the existing
                  data (non-intrusive write support). 
 
+          Each Exifdatum is paired with its entry through an index by IFD id
+          and idx. Only the metadata changed since they were read are
+          written to their entries; if there are none, the data buffer is
+          left as it is.
+
           @return True if only compatible changes were detected in the metadata
                   and the internal IFDs and MakerNote (and thus the data buffer)
                   were updated successfully. Return false, if non-intrusive
-                  writing is not possible. The internal IFDs and the MakerNote
-                  (and thus the data buffer) may or may not be modified in this
-                  case.
+                  writing is not possible. The internal IFDs, the MakerNote
+                  and the data buffer are not modified in this case.
          */
         bool updateEntries();
-        /*!
-          @brief Update the metadata for a range of entries. Called by
-                 updateEntries() for each of the internal IFDs and the MakerNote
-                 (if any).
-         */
-        bool updateRange(const Entries::iterator& begin,
-                         const Entries::iterator& end,
-                         ByteOrder byteOrder);
         /*!
           @brief Write the Exif data to a data buffer the hard way, return the
                  data buffer. The caller owns this data buffer and %DataBuf
@@ -840,24 +1023,11 @@ namespace Exiv2 {
         //! @name Accessors
         //@{
         /*!
-          @brief Check if the metadata is compatible with the internal IFDs for
-                 non-intrusive writing. Return true if compatible, false if not.
-
-          @note This function does not detect deleted metadata as incompatible,
-                although the deletion of metadata is not (yet) a supported
-                non-intrusive write operation.
-         */
-        bool compatible() const;
-        /*!
-          @brief Find the IFD or makernote entry corresponding to ifd id and idx.
-
-          @return A pair of which the first part determines if a match was found
-                  and, if true, the second contains an iterator to the entry.
+          @brief Return the position of the first Exifdatum with the given
+                 \em key, -1 if there is none. Uses the index and rebuilds
+                 it if it is not valid.
          */
-        std::pair<bool, Entries::const_iterator> 
-        findEntry(IfdId ifdId, int idx) const;
-        //! Return a pointer to the internal IFD identified by its IFD id
-        const Ifd* getIfd(IfdId ifdId) const;
+        long findPos(const ExifKey& key) const;
         /*! 
           @brief Check if IFD1, the IFD1 data and thumbnail data are located at 
                  the end of the Exif data. Return true, if they are or if there
@@ -869,6 +1039,8 @@ namespace Exiv2 {
         // DATA
         TiffHeader tiffHeader_;
         ExifMetadata exifMetadata_;
+        //! Index of the metadata by IFD id and tag
+        mutable MetadataIndex index_;
         //! Pointer to the MakerNote
         std::auto_ptr<MakerNote> makerNote_;
 
@@ -879,7 +1051,12 @@ namespace Exiv2 {
         Ifd ifd1_;
 
         long size_;              //!< Size of the Exif raw data in bytes
-        byte* pData_;            //!< Exif raw data buffer
+        byte* pData_;            //!< Exif raw data buffer, 0 if not copied
+        /*!
+          Entries the metadata was read from, 0 if not used. They own the
+          data buffer until a non-intrusive write which changes it takes it.
+         */
+        ExifEntries* pEntries_;
 
         /*!
           Can be set to false to indicate that non-intrusive writing is not
@@ -900,6 +1077,7 @@ namespace Exiv2 {
             = std::auto_ptr<ValueType<T> >(new ValueType<T>);
         v->value_.push_back(value);
         exifDatum.value_ = v;
+        exifDatum.release();
         return exifDatum;
     }
     /*!
@@ -77,8 +77,14 @@ namespace Exiv2 {
         MakerNote::MnTagInfo(0xffff, "(UnknownFujiMakerNoteTag)", "Unknown FujiMakerNote tag")
     };
 
+    // Index of the Fujifilm MakerNote Tag Info
+    static const TagIndex fujiMnTagIndex(fujiMnTagInfo,
+                                         &MakerNote::MnTagInfo::tag_,
+                                         &MakerNote::MnTagInfo::name_);
+
     FujiMakerNote::FujiMakerNote(bool alloc)
-        : IfdMakerNote(fujiMnTagInfo, alloc), ifdItem_("Fujifilm")
+        : IfdMakerNote(fujiMnTagInfo, alloc, &fujiMnTagIndex),
+          ifdItem_("Fujifilm")
     {
         byteOrder_ = littleEndian;
         absOffset_ = false;
@@ -298,25 +298,13 @@ namespace Exiv2 {
             offset_ = offset;
             int n = getUShort(buf, byteOrder);
             o = 2;
+            preEntries.reserve(n);
 
-            for (int i = 0; i < n; ++i) {
-                if (len < o + 12) {
-                    // Todo: How to handle debug output like this
-                    std::cerr << "Error: " << ExifTags::ifdName(ifdId_) 
-                              << " entry " << i
-                              << " lies outside of the IFD memory buffer.\n";
-                    rc = 6;
-                    break;
-                }
-                Ifd::PreEntry pe;
-                pe.tag_ = getUShort(buf + o, byteOrder);
-                pe.type_ = getUShort(buf + o + 2, byteOrder);
-                pe.count_ = getULong(buf + o + 4, byteOrder);
-                pe.size_ = pe.count_ * TypeInfo::typeSize(TypeId(pe.type_));
-                pe.offsetLoc_ = o + 8;
-                pe.offset_ = pe.size_ > 4 ? getULong(buf + o + 8, byteOrder) : 0;
-                preEntries.push_back(pe);
-                o += 12;
+            if (byteOrder == littleEndian) {
+                rc = readDirectory<littleEndian>(preEntries, buf, len, n, o);
+            }
+            else {
+                rc = readDirectory<bigEndian>(preEntries, buf, len, n, o);
             }
         }
         if (rc == 0) {
@@ -376,6 +364,7 @@ namespace Exiv2 {
         // start of the IFD
         if (rc == 0) {
             entries_.clear();
+            entries_.reserve(preEntries.size());
             int idx = 0;
             const Ifd::PreEntries::iterator begin = preEntries.begin();
             const Ifd::PreEntries::iterator end = preEntries.end();
@@ -445,6 +434,31 @@ namespace Exiv2 {
         std::sort(entries_.begin(), entries_.end(), cmpEntriesByTag);
     }
 
+    template<ByteOrder byteOrder>
+    int Ifd::readDirectory(PreEntries& preEntries, const byte* buf, long len,
+                           int n, long& o) const
+    {
+        for (int i = 0; i < n; ++i) {
+            if (len < o + 12) {
+                // Todo: How to handle debug output like this
+                std::cerr << "Error: " << ExifTags::ifdName(ifdId_) 
+                          << " entry " << i
+                          << " lies outside of the IFD memory buffer.\n";
+                return 6;
+            }
+            Ifd::PreEntry pe;
+            pe.tag_ = getUShort<byteOrder>(buf + o);
+            pe.type_ = getUShort<byteOrder>(buf + o + 2);
+            pe.count_ = getULong<byteOrder>(buf + o + 4);
+            pe.size_ = pe.count_ * TypeInfo::typeSize(TypeId(pe.type_));
+            pe.offsetLoc_ = o + 8;
+            pe.offset_ = pe.size_ > 4 ? getULong<byteOrder>(buf + o + 8) : 0;
+            preEntries.push_back(pe);
+            o += 12;
+        }
+        return 0;
+    } // Ifd::readDirectory
+
     int Ifd::readSubIfd(
         Ifd& dest, const byte* buf, long len, ByteOrder byteOrder, uint16_t tag
     ) const
@@ -473,8 +487,6 @@ namespace Exiv2 {
         long o = 2;
 
         // Add all directory entries to the data buffer
-        long dataSize = 0;
-        long dataAreaSize = 0;
         long totalDataSize = 0;
         const iterator b = entries_.begin();
         const iterator e = entries_.end();
@@ -484,27 +496,11 @@ namespace Exiv2 {
                 totalDataSize += i->size();
             }
         }
-        for (i = b; i != e; ++i) {
-            us2Data(buf + o, i->tag(), byteOrder);
-            us2Data(buf + o + 2, i->type(), byteOrder);
-            ul2Data(buf + o + 4, i->count(), byteOrder);
-            if (i->sizeDataArea() > 0) { 
-                long dataAreaOffset = offset_+size()+totalDataSize+dataAreaSize;
-                i->setDataAreaOffsets(dataAreaOffset, byteOrder);
-                dataAreaSize += i->sizeDataArea();
-            }
-            if (i->size() > 4) {
-                // Set the offset of the entry, data immediately follows the IFD
-                i->setOffset(size() + dataSize);
-                ul2Data(buf + o + 8, offset_ + i->offset(), byteOrder);
-                dataSize += i->size();
-            }
-            else {
-                // Copy data into the offset field
-                memset(buf + o + 8, 0x0, 4);
-                memcpy(buf + o + 8, i->data(), i->size());
-            }
-            o += 12;
+        if (byteOrder == littleEndian) {
+            o += copyDirectory<littleEndian>(buf + o, totalDataSize);
+        }
+        else {
+            o += copyDirectory<bigEndian>(buf + o, totalDataSize);
         }
 
         // Add the offset to the next IFD to the data buffer
@@ -535,6 +531,39 @@ namespace Exiv2 {
         return o;
     } // Ifd::copy
 
+    template<ByteOrder byteOrder>
+    long Ifd::copyDirectory(byte* buf, long totalDataSize)
+    {
+        long o = 0;
+        long dataSize = 0;
+        long dataAreaSize = 0;
+        const iterator b = entries_.begin();
+        const iterator e = entries_.end();
+        for (iterator i = b; i != e; ++i) {
+            us2Data<byteOrder>(buf + o, i->tag());
+            us2Data<byteOrder>(buf + o + 2, i->type());
+            ul2Data<byteOrder>(buf + o + 4, i->count());
+            if (i->sizeDataArea() > 0) { 
+                long dataAreaOffset = offset_+size()+totalDataSize+dataAreaSize;
+                i->setDataAreaOffsets(dataAreaOffset, byteOrder);
+                dataAreaSize += i->sizeDataArea();
+            }
+            if (i->size() > 4) {
+                // Set the offset of the entry, data immediately follows the IFD
+                i->setOffset(size() + dataSize);
+                ul2Data<byteOrder>(buf + o + 8, offset_ + i->offset());
+                dataSize += i->size();
+            }
+            else {
+                // Copy data into the offset field
+                memset(buf + o + 8, 0x0, 4);
+                memcpy(buf + o + 8, i->data(), i->size());
+            }
+            o += 12;
+        }
+        return o;
+    } // Ifd::copyDirectory
+
     void Ifd::clear()
     {
         entries_.clear();
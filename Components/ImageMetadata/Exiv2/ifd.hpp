@@ -443,6 +443,8 @@ namespace Exiv2 {
                  match.
          */
         void add(const Entry& entry);
+        //! Reserve room for \em n entries, so they can be added without copies
+        void reserve(long n) { entries_.reserve(n); }
         /*!
           @brief Delete the directory entry with the given tag. Return the index 
                  of the deleted entry or 0 if no entry with tag was found.
@@ -526,6 +528,25 @@ namespace Exiv2 {
         //! Container for 'pre-entries'
         typedef std::vector<PreEntry> PreEntries;
 
+        /*!
+          @brief Read the \em n directory entries of the IFD at \em buf into 
+                 \em preEntries and advance the offset \em o past them. The
+                 byte order is a template parameter, so that it is only
+                 decided once for all entries. Return 0 if successful, 6 if
+                 the entries lie outside of the buffer.
+         */
+        template<ByteOrder byteOrder>
+        int readDirectory(PreEntries& preEntries, const byte* buf, long len, 
+                          int n, long& o) const;
+        /*!
+          @brief Write the directory entries of the IFD to \em buf, in byte
+                 order \em byteOrder. The data of the entries follows the IFD,
+                 \em totalDataSize is the size of the data of all entries.
+                 Return the number of bytes written.
+         */
+        template<ByteOrder byteOrder>
+        long copyDirectory(byte* buf, long totalDataSize);
+
         // DATA
         /*!
           True:  requires memory allocation and deallocation,
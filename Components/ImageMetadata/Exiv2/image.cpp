@@ -43,23 +43,20 @@ EXIV2_RCSID("@(#) $Id: image.cpp 438 2004-12-07 16:45:04Z ahuggel $");
 
 #include "image.hpp"
 #include "types.hpp"
+#include "basicio.hpp"
 #include "error.hpp"
 
 // + standard includes
 #include <cstdio>
 #include <cstring>
-#include <cstdio>                               // for rename, remove
 #include <cassert>
 #include <sys/types.h>
 #include <sys/stat.h>
 #ifdef _MSC_VER
 # define S_ISREG(m)      (((m) & S_IFMT) == S_IFREG)
 #endif
-#ifdef HAVE_PROCESS_H
-# include <process.h>
-#endif
 #ifdef HAVE_UNISTD_H
-# include <unistd.h>                            // for getpid, stat
+# include <unistd.h>                            // for stat
 #endif
 
 // *****************************************************************************
@@ -73,17 +70,17 @@ namespace Exiv2 {
              Caller owns the returned object and the auto-pointer ensures that 
              it will be deleted.
      */
-    Image::AutoPtr newExvInstance(const std::string& path, bool create);
-    //! Check if the file ifp is an EXV file.
-    bool isExvType(FILE* ifp, bool advance);
+    Image::AutoPtr newExvInstance(BasicIo::AutoPtr io, bool create);
+    //! Check if the data in iIo is an EXV file.
+    bool isExvType(BasicIo& iIo, bool advance);
     /*!
       @brief Create a new JpegImage instance and return an auto-pointer to it.
              Caller owns the returned object and the auto-pointer ensures that 
              it will be deleted.
      */
-    Image::AutoPtr newJpegInstance(const std::string& path, bool create);
-    //! Check if the file ifp is a JPEG image.
-    bool isJpegType(FILE* ifp, bool advance);
+    Image::AutoPtr newJpegInstance(BasicIo::AutoPtr io, bool create);
+    //! Check if the data in iIo is a JPEG image.
+    bool isJpegType(BasicIo& iIo, bool advance);
 
     ImageFactory* ImageFactory::pInstance_ = 0;
 
@@ -111,15 +108,26 @@ namespace Exiv2 {
 
     Image::Type ImageFactory::getType(const std::string& path) const
     {
-        FileCloser closer(fopen(path.c_str(), "rb"));
-        if (!closer.fp_) return Image::none;
+        MmapIo mmapIo(path);
+        return getType(mmapIo);
+    } // ImageFactory::getType
+
+    Image::Type ImageFactory::getType(const byte* data, long size) const
+    {
+        MemIo memIo(data, size);
+        return getType(memIo);
+    } // ImageFactory::getType
 
+    Image::Type ImageFactory::getType(BasicIo& io) const
+    {
+        if (io.open() != 0) return Image::none;
+        IoCloser closer(io);
         Image::Type type = Image::none;
         Registry::const_iterator b = registry_.begin();
         Registry::const_iterator e = registry_.end();
         for (Registry::const_iterator i = b; i != e; ++i)
         {
-            if (i->second.isThisType(closer.fp_, false)) {
+            if (i->second.isThisType(io, false)) {
                 type = i->first;
                 break;
             }
@@ -129,16 +137,33 @@ namespace Exiv2 {
 
     Image::AutoPtr ImageFactory::open(const std::string& path) const
     {
-        Image::AutoPtr image;
-        FileCloser closer(fopen(path.c_str(), "rb"));
-        if (!closer.fp_) return image;
+        BasicIo::AutoPtr io(new MmapIo(path));
+        return open(io);
+    } // ImageFactory::open
+
+    Image::AutoPtr ImageFactory::open(const byte* data, long size) const
+    {
+        BasicIo::AutoPtr io(new MemIo(data, size));
+        return open(io);
+    } // ImageFactory::open
 
+    Image::AutoPtr ImageFactory::open(BasicIo::AutoPtr io) const
+    {
+        Image::AutoPtr image;
+        if (io->isopen()) {
+            if (io->seek(0, BasicIo::beg) != 0) return image;
+        }
+        else if (io->open() != 0) {
+            return image;
+        }
+        // The io is left open for the image, which reuses it to read (and
+        // later write) the metadata. If there is no image, io is destroyed.
         Registry::const_iterator b = registry_.begin();
         Registry::const_iterator e = registry_.end();
         for (Registry::const_iterator i = b; i != e; ++i)
         {
-            if (i->second.isThisType(closer.fp_, false)) {
-                image = i->second.newInstance(path, false);
+            if (i->second.isThisType(*io, false)) {
+                image = i->second.newInstance(io, false);
                 break;
             }
         }
@@ -147,10 +172,21 @@ namespace Exiv2 {
 
     Image::AutoPtr ImageFactory::create(Image::Type type, 
                                         const std::string& path) const
+    {
+        // Create or overwrite the file, then write the image to it
+        FileIo* fileIo = new FileIo(path);
+        BasicIo::AutoPtr io(fileIo);
+        if (fileIo->open("w+b") != 0) return Image::AutoPtr();
+        fileIo->close();
+        return create(type, io);
+    } // ImageFactory::create
+
+    Image::AutoPtr ImageFactory::create(Image::Type type, 
+                                        BasicIo::AutoPtr io) const
     {
         Registry::const_iterator i = registry_.find(type);
         if (i != registry_.end()) {
-            return i->second.newInstance(path, true);
+            return i->second.newInstance(io, true);
         }
         return Image::AutoPtr();
     } // ImageFactory::create
@@ -161,31 +197,31 @@ namespace Exiv2 {
     const byte JpegBase::app0_   = 0xe0;
     const byte JpegBase::app1_   = 0xe1;
     const byte JpegBase::app13_  = 0xed;
+    const byte JpegBase::app15_  = 0xef;
     const byte JpegBase::com_    = 0xfe;
     const uint16_t JpegBase::iptc_ = 0x0404;
     const char JpegBase::exifId_[] = "Exif\0\0";
     const char JpegBase::jfifId_[] = "JFIF\0";
     const char JpegBase::ps3Id_[]  = "Photoshop 3.0\0";
+    const char JpegBase::padId_[]  = "Padding\0";
     const char JpegBase::bimId_[]  = "8BIM";
 
-    JpegBase::JpegBase(const std::string& path, bool create, 
-                       const byte initData[], size_t dataSize) 
-        : path_(path), sizeExifData_(0), pExifData_(0),
-          sizeIptcData_(0), pIptcData_(0)
+    JpegBase::JpegBase(BasicIo::AutoPtr io, bool create, 
+                       const byte initData[], long dataSize) 
+        : io_(io), sizeExifData_(0), pExifData_(0),
+          sizeIptcData_(0), pIptcData_(0), padding_(0),
+          pixelWidth_(0), pixelHeight_(0), unread_(mdNone)
     {
         if (create) {
-            FILE* fp = fopen(path.c_str(), "w+b");
-            if (fp) {
-                initFile(fp, initData, dataSize);
-                fclose(fp);
-            }
+            initImage(initData, dataSize);
         }
     }
 
-    int JpegBase::initFile(FILE* fp, const byte initData[], size_t dataSize)
+    int JpegBase::initImage(const byte initData[], long dataSize)
     {
-        if (!fp || ferror(fp)) return 4;
-        if (fwrite(initData, 1, dataSize, fp) != dataSize) {
+        if (io_->open() != 0) return 4;
+        IoCloser closer(*io_);
+        if (io_->write(initData, dataSize) != dataSize) {
             return 4;
         }
         return 0;
@@ -199,9 +235,17 @@ namespace Exiv2 {
 
     bool JpegBase::good() const
     {
-        FileCloser closer(fopen(path_.c_str(), "rb"));
-        if (closer.fp_ == 0 ) return false;
-        return isThisType(closer.fp_, false);
+        if (io_->isopen()) {
+            // Probe the open io without disturbing its position
+            const long pos = io_->tell();
+            if (io_->seek(0, BasicIo::beg) != 0) return false;
+            bool rc = isThisType(*io_, false);
+            io_->seek(pos, BasicIo::beg);
+            return rc;
+        }
+        if (io_->open() != 0) return false;
+        IoCloser closer(*io_);
+        return isThisType(*io_, false);
     }
 
     void JpegBase::clearMetadata()
@@ -216,6 +260,7 @@ namespace Exiv2 {
         delete[] pIptcData_;
         pIptcData_ = 0;
         sizeIptcData_ = 0;
+        unread_ &= ~mdIptc;
     }
 
     void JpegBase::clearExifData()
@@ -223,11 +268,13 @@ namespace Exiv2 {
         delete[] pExifData_;
         pExifData_ = 0;
         sizeExifData_ = 0;
+        unread_ &= ~mdExif;
     }
 
     void JpegBase::clearComment()
     {
         comment_.erase();
+        unread_ &= ~mdComment;
     }
 
     void JpegBase::setExifData(const byte* buf, long size)
@@ -254,6 +301,12 @@ namespace Exiv2 {
     void JpegBase::setComment(const std::string& comment)
     { 
         comment_ = comment; 
+        unread_ &= ~mdComment;
+    }
+
+    void JpegBase::setPadding(long size)
+    {
+        padding_ = size;
     }
 
     void JpegBase::setMetadata(const Image& image)
@@ -263,16 +316,16 @@ namespace Exiv2 {
         setComment(image.comment());
     }
 
-    int JpegBase::advanceToMarker(FILE *fp) const
+    int JpegBase::advanceToMarker(BasicIo& iIo) const
     {
         int c = -1;
         // Skips potential padding between markers
-        while ((c=fgetc(fp)) != 0xff) {
+        while ((c=iIo.getb()) != 0xff) {
             if (c == EOF) return -1;
         }
             
         // Markers can start with any number of 0xff
-        while ((c=fgetc(fp)) == 0xff) {
+        while ((c=iIo.getb()) == 0xff) {
             if (c == EOF) return -1;
         }
         return c;
@@ -280,38 +333,63 @@ namespace Exiv2 {
 
     int JpegBase::readMetadata()
     {
-        FileCloser closer(fopen(path_.c_str(), "rb"));
-        if (!closer.fp_) return 1;
+        return readMetadata(mdExif | mdIptc | mdComment);
+    }
+
+    int JpegBase::readMetadata(int mask)
+    {
+        // The io is left open, a subsequent writeMetadata() reuses it
+        if (io_->isopen()) {
+            if (io_->seek(0, BasicIo::beg) != 0) return 1;
+        }
+        else if (io_->open() != 0) {
+            return 1;
+        }
+        segments_.clear();
 
         // Ensure that this is the correct image type
-        if (!isThisType(closer.fp_, true)) {
-            if (ferror(closer.fp_) || feof(closer.fp_)) return 1;
+        if (!isThisType(*io_, true)) {
+            if (io_->error() || io_->eof()) return 1;
             return 2;
         }
         clearMetadata();
-        int search = 3;
+        pixelWidth_ = 0;
+        pixelHeight_ = 0;
+        unread_ = ~mask & (mdExif | mdIptc | mdComment);
+        int search = 0;
+        if (mask & mdExif) ++search;
+        if (mask & mdIptc) ++search;
+        if (mask & mdComment) ++search;
+        if (mask & mdDimensions) ++search;
         const long bufMinSize = 16;
         long bufRead = 0;
         DataBuf buf(bufMinSize);
 
         // Read section marker
-        int marker = advanceToMarker(closer.fp_);
+        int marker = advanceToMarker(*io_);
         if (marker < 0) return 2;
+        Segments segments;
         
-        while (marker != sos_ && marker != eoi_ && search > 0) {
+        // Padding following the metadata is recorded for writeInPlace
+        while (   marker != sos_ && marker != eoi_ 
+               && (search > 0 || marker == app15_)) {
             // Read size and signature (ok if this hits EOF)
-            bufRead = (long)fread(buf.pData_, 1, bufMinSize, closer.fp_);
-            if (ferror(closer.fp_)) return 1;
+            const long offset = io_->tell();
+            bufRead = io_->read(buf.pData_, bufMinSize);
+            if (io_->error()) return 1;
             uint16_t size = getUShort(buf.pData_, bigEndian);
+            segments.push_back(Segment(marker, offset, size, false));
 
-            if (marker == app1_ && memcmp(buf.pData_ + 2, exifId_, 6) == 0) {
+            if (   marker == app1_ && memcmp(buf.pData_ + 2, exifId_, 6) == 0
+                && (mask & mdExif)) {
                 if (size < 8) return 2;
+                segments.back().signature_ = true;
                 // Seek to begining and read the Exif data
-                fseek(closer.fp_, 8-bufRead, SEEK_CUR); 
+                io_->seek(8-bufRead, BasicIo::cur); 
                 long sizeExifData = size - 8;
                 pExifData_ = new byte[sizeExifData];
-                fread(pExifData_, 1, sizeExifData, closer.fp_);
-                if (ferror(closer.fp_) || feof(closer.fp_)) {
+                io_->read(pExifData_, sizeExifData);
+                if (io_->error() || io_->eof()) {
                     delete[] pExifData_;
                     pExifData_ = 0;
                     return 1;
@@ -320,13 +398,15 @@ namespace Exiv2 {
                 sizeExifData_ = sizeExifData;
                 --search;
             }
-            else if (marker == app13_ && memcmp(buf.pData_ + 2, ps3Id_, 14) == 0) {
+            else if (   marker == app13_ && memcmp(buf.pData_ + 2, ps3Id_, 14) == 0
+                     && (mask & mdIptc)) {
                 if (size < 16) return 2;
+                segments.back().signature_ = true;
                 // Read the rest of the APP13 segment
-                // needed if bufMinSize!=16: fseek(closer.fp_, 16-bufRead, SEEK_CUR);
+                // needed if bufMinSize!=16: io_->seek(16-bufRead, BasicIo::cur);
                 DataBuf psData(size - 16);
-                fread(psData.pData_, 1, psData.size_, closer.fp_);
-                if (ferror(closer.fp_) || feof(closer.fp_)) return 1;
+                io_->read(psData.pData_, psData.size_);
+                if (io_->error() || io_->eof()) return 1;
                 const byte *record = 0;
                 uint16_t sizeIptc = 0;
                 uint16_t sizeHdr = 0;
@@ -340,16 +420,16 @@ namespace Exiv2 {
                 }
                 --search;
             }
-            else if (marker == com_ && comment_.empty())
+            else if (marker == com_ && (mask & mdComment) && comment_.empty())
             {
                 if (size < 2) return 2;
                 // Jpegs can have multiple comments, but for now only read
                 // the first one (most jpegs only have one anyway). Comments
                 // are simple single byte ISO-8859-1 strings.
-                fseek(closer.fp_, 2-bufRead, SEEK_CUR);
+                io_->seek(2-bufRead, BasicIo::cur);
                 buf.alloc(size-2);
-                fread(buf.pData_, 1, size-2, closer.fp_);
-                if (ferror(closer.fp_) || feof(closer.fp_)) return 1;
+                io_->read(buf.pData_, size-2);
+                if (io_->error() || io_->eof()) return 1;
                 comment_.assign(reinterpret_cast<char*>(buf.pData_), size-2);
                 while (   comment_.length()
                        && comment_.at(comment_.length()-1) == '\0') {
@@ -357,18 +437,79 @@ namespace Exiv2 {
                 }
                 --search;
             }
+            else if (   marker >= 0xc0 && marker <= 0xcf
+                     && marker != 0xc4 && marker != 0xc8 && marker != 0xcc
+                     && (mask & mdDimensions) && pixelWidth_ == 0) {
+                // Start of frame, has the dimensions of the image
+                if (size < 7) return 2;
+                pixelHeight_ = getUShort(buf.pData_ + 3, bigEndian);
+                pixelWidth_ = getUShort(buf.pData_ + 5, bigEndian);
+                if (io_->seek(size-bufRead, BasicIo::cur)) return 2;
+                --search;
+            }
             else {
                 if (size < 2) return 2;
-                // Skip the remainder of the unknown segment
-                if (fseek(closer.fp_, size-bufRead, SEEK_CUR)) return 2;
+                if (   (marker == app1_ && memcmp(buf.pData_ + 2, exifId_, 6) == 0)
+                    || (marker == app13_ && memcmp(buf.pData_ + 2, ps3Id_, 14) == 0)
+                    || (marker == app15_ && memcmp(buf.pData_ + 2, padId_, 8) == 0)) {
+                    segments.back().signature_ = true;
+                }
+                // Skip the remainder of the segment
+                if (io_->seek(size-bufRead, BasicIo::cur)) return 2;
             }
             // Read the beginning of the next segment
-            marker = advanceToMarker(closer.fp_);
+            marker = advanceToMarker(*io_);
             if (marker < 0) return 2;
         }
+        if (marker == sos_ || marker == eoi_) {
+            segments.push_back(Segment(marker, io_->tell(), 0, false));
+        }
+        // Only remember the segments if the whole scan succeeded
+        segments_.swap(segments);
         return 0;
     } // JpegBase::readMetadata
 
+    int JpegBase::locateExifData(long& offset, long& size)
+    {
+        if (io_->isopen()) {
+            if (io_->seek(0, BasicIo::beg) != 0) return 1;
+        }
+        else if (io_->open() != 0) {
+            return 1;
+        }
+
+        // Ensure that this is the correct image type
+        if (!isThisType(*io_, true)) {
+            if (io_->error() || io_->eof()) return 1;
+            return 2;
+        }
+        const long bufMinSize = 8;
+        byte buf[bufMinSize];
+
+        int marker = advanceToMarker(*io_);
+        if (marker < 0) return 2;
+        while (marker != sos_ && marker != eoi_) {
+            // Read size and signature (ok if this hits EOF)
+            const long pos = io_->tell();
+            long bufRead = io_->read(buf, bufMinSize);
+            if (io_->error()) return 1;
+            if (bufRead < 2) return 2;
+            uint16_t segSize = getUShort(buf, bigEndian);
+            if (   marker == app1_ && bufRead == bufMinSize
+                && memcmp(buf + 2, exifId_, 6) == 0) {
+                if (segSize < 8) return 2;
+                offset = pos + 8;
+                size = segSize - 8;
+                return 0;
+            }
+            if (segSize < 2) return 2;
+            if (io_->seek(pos + segSize, BasicIo::beg)) return 2;
+            marker = advanceToMarker(*io_);
+            if (marker < 0) return 2;
+        }
+        return 3;
+    } // JpegBase::locateExifData
+
 
     // Operates on raw data (rather than file streams) to simplify reuse
     int JpegBase::locateIptcData(const byte *pPsData, 
@@ -415,243 +556,455 @@ namespace Exiv2 {
 
     int JpegBase::writeMetadata()
     {
-        FileCloser reader(fopen(path_.c_str(), "rb"));
-        if (!reader.fp_) return 1;
+        // Reuse the io if it is still open from readMetadata()
+        if (io_->isopen()) {
+            if (io_->seek(0, BasicIo::beg) != 0) return 1;
+        }
+        else if (io_->open() != 0) {
+            return 1;
+        }
+        IoCloser closer(*io_);
+
+        // Overwrite the existing segments if the new metadata fits
+        int rc = writeInPlace();
+        if (rc != -1) {
+            closer.close();
+            segments_.clear();
+            return rc;
+        }
 
-        // Write the output to a temporary file
-        pid_t pid = getpid();
-        std::string tmpname = path_ + toString(pid);
-        FileCloser writer(fopen(tmpname.c_str(), "wb"));
-        if (!writer.fp_) return -3;
+        if (io_->seek(0, BasicIo::beg) != 0) return 1;
 
-        int rc = doWriteMetadata(reader.fp_, writer.fp_);
-        writer.close();
-        reader.close();
-        if (rc == 0) {
-            // Workaround for MSVCRT rename that does not overwrite existing files
-            if (remove(path_.c_str()) != 0) rc = -4;
-        }
+        // Write the output to a temporary (file, memory buffer, ...)
+        BasicIo::AutoPtr tempIo(io_->temporary());
+        if (!tempIo->isopen()) return -3;
+
+        rc = doWriteMetadata(*io_, *tempIo);
+        closer.close();
+        // The segment positions are stale once the image is rewritten
+        segments_.clear();
         if (rc == 0) {
-            // rename temporary file
-            if (rename(tmpname.c_str(), path_.c_str()) == -1) rc = -4;
-        }
-        if (rc != 0) {
-            // remove temporary file
-            remove(tmpname.c_str());
+            // Replace the original with the temporary, the temporary is
+            // removed if it could not be transferred
+            rc = io_->transfer(*tempIo);
         }
         return rc;
     } // JpegBase::writeMetadata
 
-    int JpegBase::doWriteMetadata(FILE *ifp, FILE* ofp) const
+    int JpegBase::writeComSegment(BasicIo& oIo) const
     {
-        if (!ifp) return 1;
-        if (!ofp) return 4;
+        // Write COM marker, size of comment, and string
+        byte tmpBuf[4];
+        tmpBuf[0] = 0xff;
+        tmpBuf[1] = com_;
+        us2Data(tmpBuf + 2, 
+                static_cast<uint16_t>(comment_.length()+3), bigEndian);
+        if (oIo.write(tmpBuf, 4) != 4) return 4;
+        if (oIo.write((byte*)comment_.data(), (long)comment_.length())
+            != (long)comment_.length()) return 4;
+        if (oIo.putb(0)==EOF) return 4;
+        if (oIo.error()) return 4;
+        return 0;
+    } // JpegBase::writeComSegment
 
-        // Ensure that this is the correct image type
-        if (!isThisType(ifp, true)) {
-            if (ferror(ifp) || feof(ifp)) return 1;
-            return 2;
+    int JpegBase::writeExifSegment(BasicIo& oIo) const
+    {
+        // Write APP1 marker, size of APP1 field, Exif id and Exif data
+        byte tmpBuf[10];
+        tmpBuf[0] = 0xff;
+        tmpBuf[1] = app1_;
+        us2Data(tmpBuf + 2, 
+                static_cast<uint16_t>(sizeExifData_+8), 
+                bigEndian);
+        memcpy(tmpBuf + 4, exifId_, 6);
+        if (oIo.write(tmpBuf, 10) != 10) return 4;
+        if (oIo.write(pExifData_, sizeExifData_) 
+            != sizeExifData_) return 4;
+        if (oIo.error()) return 4;
+        return 0;
+    } // JpegBase::writeExifSegment
+
+    int JpegBase::writePs3Segment(BasicIo& oIo, const DataBuf& psData) const
+    {
+        const byte *record = psData.pData_;
+        uint16_t sizeIptc = 0;
+        uint16_t sizeHdr = 0;
+        // Safe to call with zero psData.size_
+        locateIptcData(psData.pData_, psData.size_, &record, &sizeHdr, &sizeIptc);
+
+        // Data is rounded to be even
+        const int sizeOldData = sizeHdr + sizeIptc + (sizeIptc & 1);
+        if (psData.size_ <= sizeOldData && !pIptcData_) return 0;
+
+        // write app13 marker, new size, and ps3Id
+        byte tmpBuf[18];
+        tmpBuf[0] = 0xff;
+        tmpBuf[1] = app13_;
+        const int sizeNewData = sizeIptcData_ ? 
+                sizeIptcData_+(sizeIptcData_&1)+12 : 0;
+        us2Data(tmpBuf + 2, 
+                static_cast<uint16_t>(psData.size_-sizeOldData+sizeNewData+16),
+                bigEndian);
+        memcpy(tmpBuf + 4, ps3Id_, 14);
+        if (oIo.write(tmpBuf, 18) != 18) return 4;
+        if (oIo.error()) return 4;
+
+        const long sizeFront = (long)(record - psData.pData_);
+        const long sizeEnd = psData.size_ - sizeFront - sizeOldData;
+        // write data before old record.
+        if (oIo.write(psData.pData_, sizeFront) != sizeFront) return 4;
+
+        // write new iptc record if we have it
+        if (pIptcData_) {
+            memcpy(tmpBuf, bimId_, 4);
+            us2Data(tmpBuf+4, iptc_, bigEndian);
+            tmpBuf[6] = 0;
+            tmpBuf[7] = 0;
+            ul2Data(tmpBuf + 8, sizeIptcData_, bigEndian);
+            if (oIo.write(tmpBuf, 12) != 12) return 4;
+            if (oIo.write(pIptcData_, sizeIptcData_) 
+                != sizeIptcData_) return 4;
+            // data is padded to be even (but not included in size)
+            if (sizeIptcData_ & 1) {
+                if (oIo.putb(0)==EOF) return 4;
+            }
+            if (oIo.error()) return 4;
         }
-        
+            
+        // write existing stuff after record
+        if (oIo.write(record+sizeOldData, sizeEnd) 
+            != sizeEnd) return 4;
+        if (oIo.error()) return 4;
+        return 0;
+    } // JpegBase::writePs3Segment
+
+    int JpegBase::writePadding(BasicIo& oIo, long size) const
+    {
+        // Write APP15 marker, size of APP15 field, padding id and zeros
+        const long sizeHdr = 12;
+        const long sizeMax = 0xffff + 2;
+        DataBuf buf(size < sizeMax ? size : sizeMax);
+        while (size >= sizeHdr) {
+            long sizeSeg = size;
+            if (sizeSeg > sizeMax) {
+                // Leave enough for the header of the next segment
+                sizeSeg = size - sizeMax < sizeHdr ? size - sizeHdr : sizeMax;
+            }
+            memset(buf.pData_, 0, sizeSeg);
+            buf.pData_[0] = 0xff;
+            buf.pData_[1] = app15_;
+            us2Data(buf.pData_ + 2, static_cast<uint16_t>(sizeSeg - 2), bigEndian);
+            memcpy(buf.pData_ + 4, padId_, 8);
+            if (oIo.write(buf.pData_, sizeSeg) != sizeSeg) return 4;
+            size -= sizeSeg;
+        }
+        // Fill bytes may precede any marker
+        for (; size > 0; --size) {
+            if (oIo.putb(0xff) == EOF) return 4;
+        }
+        if (oIo.error()) return 4;
+        return 0;
+    } // JpegBase::writePadding
+
+    bool JpegBase::isPadding(const Segment& segment) const
+    {
+        return segment.marker_ == app15_ && segment.signature_;
+    }
+
+    int JpegBase::scanSegments(BasicIo& iIo, Segments& segments) const
+    {
         const long bufMinSize = 16;
         long bufRead = 0;
         DataBuf buf(bufMinSize);
-        const long seek = ftell(ifp);
-        int count = 0;
-        int search = 0;
-        int insertPos = 0;
-        int skipApp1Exif = -1;
-        int skipApp13Ps3 = -1;
-        int skipCom = -1;
-        DataBuf psData;
-
-        // Write image header
-        if (writeHeader(ofp)) return 4;
 
-        // Read section marker
-        int marker = advanceToMarker(ifp);
+        int marker = advanceToMarker(iIo);
         if (marker < 0) return 2;
-        
-        // First find segments of interest. Normally app0 is first and we want
-        // to insert after it. But if app0 comes after com, app1 and app13 then
-        // don't bother.
-        while (marker != sos_ && marker != eoi_ && search < 3) {
+
+        while (marker != sos_ && marker != eoi_) {
             // Read size and signature (ok if this hits EOF)
-            bufRead = (long)fread(buf.pData_, 1, bufMinSize, ifp);
-            if (ferror(ifp)) return 1;
+            const long offset = iIo.tell();
+            bufRead = iIo.read(buf.pData_, bufMinSize);
+            if (iIo.error()) return 1;
             uint16_t size = getUShort(buf.pData_, bigEndian);
+            bool signature = false;
 
-            if (marker == app0_) {
-                if (size < 2) return 2;
+            if (marker == app1_ && memcmp(buf.pData_ + 2, exifId_, 6) == 0) {
+                if (size < 8) return 2;
+                signature = true;
+            }
+            else if (marker == app13_ && memcmp(buf.pData_ + 2, ps3Id_, 14) == 0) {
+                if (size < 16) return 2;
+                signature = true;
+            }
+            else if (size < 2) {
+                return 2;
+            }
+            else if (marker == app15_ && memcmp(buf.pData_ + 2, padId_, 8) == 0) {
+                signature = true;
+            }
+            segments.push_back(Segment(marker, offset, size, signature));
+            if (iIo.seek(size-bufRead, BasicIo::cur)) return 2;
+            marker = advanceToMarker(iIo);
+            if (marker < 0) return 2;
+        }
+        segments.push_back(Segment(marker, iIo.tell(), 0, false));
+        return 0;
+    } // JpegBase::scanSegments
+
+    bool JpegBase::findSegments(const Segments& segments,
+                                int& insertPos,
+                                int& skipApp1Exif,
+                                int& skipApp13Ps3,
+                                int& skipCom,
+                                int& search) const
+    {
+        insertPos = 0;
+        skipApp1Exif = -1;
+        skipApp13Ps3 = -1;
+        skipCom = -1;
+        search = 0;
+        // Normally app0 is first and we want to insert after it. But if app0
+        // comes after com, app1 and app13 then don't bother.
+        int count = 0;
+        Segments::const_iterator i = segments.begin();
+        for (; i != segments.end() && search < 3; ++i, ++count) {
+            if (i->marker_ == sos_ || i->marker_ == eoi_) return true;
+            if (i->marker_ == app0_) {
                 insertPos = count + 1;
-                if (fseek(ifp, size-bufRead, SEEK_CUR)) return 2;
             }
-            else if (marker == app1_ && memcmp(buf.pData_ + 2, exifId_, 6) == 0) {
-                if (size < 8) return 2;
+            else if (i->marker_ == app1_ && i->signature_) {
                 skipApp1Exif = count;
                 ++search;
-                if (fseek(ifp, size-bufRead, SEEK_CUR)) return 2;
             }
-            else if (marker == app13_ && memcmp(buf.pData_ + 2, ps3Id_, 14) == 0) {
-                if (size < 16) return 2;
+            else if (i->marker_ == app13_ && i->signature_) {
                 skipApp13Ps3 = count;
                 ++search;
-                // needed if bufMinSize!=16: fseek(ifp, 16-bufRead, SEEK_CUR);
-                psData.alloc(size - 16);
-                // Load PS data now to allow reinsertion at any point
-                fread(psData.pData_, 1, psData.size_, ifp);
-                if (ferror(ifp) || feof(ifp)) return 1;
             }
-            else if (marker == com_ && skipCom == -1) {
-                if (size < 2) return 2;
+            else if (i->marker_ == com_ && skipCom == -1) {
                 // Jpegs can have multiple comments, but for now only handle
                 // the first one (most jpegs only have one anyway).
                 skipCom = count;
                 ++search;
-                if (fseek(ifp, size-bufRead, SEEK_CUR)) return 2;
             }
-            else {
-                if (size < 2) return 2;
-                if (fseek(ifp, size-bufRead, SEEK_CUR)) return 2;
+        }
+        return search == 3;
+    } // JpegBase::findSegments
+
+    void JpegBase::keepUnread(int& skipApp1Exif,
+                              int& skipApp13Ps3,
+                              int& skipCom) const
+    {
+        if (unread_ & mdExif) skipApp1Exif = -1;
+        if (unread_ & mdIptc) skipApp13Ps3 = -1;
+        if (unread_ & mdComment) skipCom = -1;
+    }
+
+    int JpegBase::readPsData(BasicIo& iIo, 
+                             const Segment& ps3, 
+                             DataBuf& psData) const
+    {
+        psData.alloc(ps3.size_ - 16);
+        if (iIo.seek(ps3.offset_ + 16, BasicIo::beg)) return 1;
+        iIo.read(psData.pData_, psData.size_);
+        if (iIo.error() || iIo.eof()) return 1;
+        return 0;
+    } // JpegBase::readPsData
+
+    int JpegBase::writeInPlace()
+    {
+        // Ensure that this is the correct image type
+        if (io_->seek(0, BasicIo::beg) != 0) return -1;
+        if (!isThisType(*io_, true)) return -1;
+
+        int search = 0;
+        int insertPos = 0;
+        int skip[3] = { -1, -1, -1 };
+        Segments scanned;
+        const Segments* segments = &segments_;
+        if (!findSegments(segments_, insertPos, skip[0], 
+                          skip[1], skip[2], search)) {
+            if (scanSegments(*io_, scanned)) return -1;
+            segments = &scanned;
+            findSegments(scanned, insertPos, skip[0], 
+                         skip[1], skip[2], search);
+        }
+        keepUnread(skip[0], skip[1], skip[2]);
+
+        // Build the new segments in memory
+        MemIo newSeg[3];
+        DataBuf psData;
+        if (skip[1] != -1 && readPsData(*io_, (*segments)[skip[1]], psData)) {
+            return -1;
+        }
+        if (pExifData_ && writeExifSegment(newSeg[0])) return -1;
+        if (writePs3Segment(newSeg[1], psData)) return -1;
+        if (!comment_.empty() && writeComSegment(newSeg[2])) return -1;
+
+        // Each of them must fit into the segment it replaces, which may grow
+        // into padding following it. New segments are put into padding.
+        const int n = static_cast<int>(segments->size());
+        std::vector<bool> used(n, false);
+        long offset[3] = { 0, 0, 0 };
+        for (int i = 0; i < 3; ++i) {
+            const long size = newSeg[i].size();
+            int first = skip[i];
+            if (first == -1) {
+                if (size == 0) continue;
+                for (int j = 0; j < n && first == -1; ++j) {
+                    if (isPadding((*segments)[j]) && !used[j]) first = j;
+                }
+                if (first == -1) return -1;
             }
-            marker = advanceToMarker(ifp);
-            if (marker < 0) return 2;
-            ++count;
+            int last = first;
+            // The segment starts with the 0xff byte before its marker
+            offset[i] = (*segments)[first].offset_ - 2;
+            long sizeOld = (*segments)[first].size_ + 2;
+            if (   size > sizeOld && first + 1 < n 
+                && isPadding((*segments)[first + 1]) && !used[first + 1]) {
+                last = first + 1;
+                sizeOld = (*segments)[last].offset_ + (*segments)[last].size_ 
+                        - offset[i];
+            }
+            if (size > sizeOld) return -1;
+            used[first] = used[last] = true;
+            skip[i] = first;
+            // Unused bytes become padding
+            if (writePadding(newSeg[i], sizeOld - size)) return -1;
+        }
+
+        // Overwrite the segments which changed
+        bool written = false;
+        for (int i = 0; i < 3; ++i) {
+            if (skip[i] == -1) continue;
+            const byte* pData = newSeg[i].data();
+            const long size = newSeg[i].size();
+            if (io_->seek(offset[i], BasicIo::beg)) return 1;
+            DataBuf cur = io_->read(size);
+            if (io_->error()) return 1;
+            if (cur.size_ == size && memcmp(cur.pData_, pData, size) == 0) {
+                continue;
+            }
+            if (io_->seek(offset[i], BasicIo::beg)) return 1;
+            long writeCount = io_->write(pData, size);
+            // Rewrite the image if it can not be written to at all
+            if (writeCount == 0 && !written) return -1;
+            if (writeCount != size || io_->error()) return 4;
+            written = true;
+        }
+        return 0;
+    } // JpegBase::writeInPlace
+
+    int JpegBase::doWriteMetadata(BasicIo& iIo, BasicIo& oIo) const
+    {
+        if (!iIo.isopen()) return 1;
+        if (!oIo.isopen()) return 4;
+
+        // Ensure that this is the correct image type
+        if (!isThisType(iIo, true)) {
+            if (iIo.error() || iIo.eof()) return 1;
+            return 2;
+        }
+        
+        const long bufMinSize = 16;
+        long bufRead = 0;
+        DataBuf buf(bufMinSize);
+        const long seek = iIo.tell();
+        int search = 0;
+        int insertPos = 0;
+        int skipApp1Exif = -1;
+        int skipApp13Ps3 = -1;
+        int skipCom = -1;
+        DataBuf psData;
+
+        // Write image header
+        if (writeHeader(oIo)) return 4;
+
+        // First find segments of interest. Use the segments found by
+        // readMetadata if they cover all of them, else scan the input.
+        Segments scanned;
+        const Segments* segments = &segments_;
+        if (   &iIo != io_.get()
+            || !findSegments(segments_, insertPos, skipApp1Exif, 
+                             skipApp13Ps3, skipCom, search)) {
+            int rc = scanSegments(iIo, scanned);
+            if (rc) return rc;
+            segments = &scanned;
+            findSegments(scanned, insertPos, skipApp1Exif, 
+                         skipApp13Ps3, skipCom, search);
+        }
+        keepUnread(skipApp1Exif, skipApp13Ps3, skipCom);
+        if (skipApp13Ps3 != -1) {
+            // Load PS data now to allow reinsertion at any point
+            if (readPsData(iIo, (*segments)[skipApp13Ps3], psData)) return 1;
         }
 
         if (pExifData_) ++search;
         if (pIptcData_) ++search;
         if (!comment_.empty()) ++search;
 
-        fseek(ifp, seek, SEEK_SET);
-        count = 0;
-        marker = advanceToMarker(ifp);
+        iIo.seek(seek, BasicIo::beg);
+        int count = 0;
+        int marker = advanceToMarker(iIo);
         if (marker < 0) return 2;
         
         // To simplify this a bit, new segments are inserts at either the start
         // or right after app0. This is standard in most jpegs, but has the
         // potential to change segment ordering (which is allowed).
         // Segments are erased if there is no assigned metadata.
-        while (marker != sos_ && search > 0) {
+        // Existing padding is replaced if new padding is written.
+        while (marker != sos_ && (search > 0 || padding_ > 0)) {
             // Read size and signature (ok if this hits EOF)
-            bufRead = (long)fread(buf.pData_, 1, bufMinSize, ifp);
-            if (ferror(ifp)) return 1;
+            bufRead = iIo.read(buf.pData_, bufMinSize);
+            if (iIo.error()) return 1;
             // Careful, this can be a meaningless number for empty
             // images with only an eoi_ marker
             uint16_t size = getUShort(buf.pData_, bigEndian);
 
             if (insertPos == count) {
-                byte tmpBuf[18];
                 if (!comment_.empty()) {
-                    // Write COM marker, size of comment, and string
-                    tmpBuf[0] = 0xff;
-                    tmpBuf[1] = com_;
-                    us2Data(tmpBuf + 2, 
-                            static_cast<uint16_t>(comment_.length()+3), bigEndian);
-                    if (fwrite(tmpBuf, 1, 4, ofp) != 4) return 4;
-                    if (   fwrite(comment_.data(), 1, comment_.length(), ofp)
-                        != comment_.length()) return 4;
-                    if (fputc(0, ofp)==EOF) return 4;
-                    if (ferror(ofp)) return 4;
+                    if (writeComSegment(oIo)) return 4;
                     --search;
                 }
                 if (pExifData_) {
-                    // Write APP1 marker, size of APP1 field, Exif id and Exif data
-                    tmpBuf[0] = 0xff;
-                    tmpBuf[1] = app1_;
-                    us2Data(tmpBuf + 2, 
-                            static_cast<uint16_t>(sizeExifData_+8), 
-                            bigEndian);
-                    memcpy(tmpBuf + 4, exifId_, 6);
-                    if (fwrite(tmpBuf, 1, 10, ofp) != 10) return 4;
-                    if (   fwrite(pExifData_, 1, sizeExifData_, ofp) 
-                        != (size_t)sizeExifData_) return 4;
-                    if (ferror(ofp)) return 4;
+                    if (writeExifSegment(oIo)) return 4;
                     --search;
                 }
-                
-                const byte *record = psData.pData_;
-                uint16_t sizeIptc = 0;
-                uint16_t sizeHdr = 0;
-                // Safe to call with zero psData.size_
-                locateIptcData(psData.pData_, psData.size_, &record, &sizeHdr, &sizeIptc);
-
-                // Data is rounded to be even
-                const int sizeOldData = sizeHdr + sizeIptc + (sizeIptc & 1);
-                if (psData.size_ > sizeOldData || pIptcData_) {
-                    // write app13 marker, new size, and ps3Id
-                    tmpBuf[0] = 0xff;
-                    tmpBuf[1] = app13_;
-                    const int sizeNewData = sizeIptcData_ ? 
-                            sizeIptcData_+(sizeIptcData_&1)+12 : 0;
-                    us2Data(tmpBuf + 2, 
-                            static_cast<uint16_t>(psData.size_-sizeOldData+sizeNewData+16),
-                            bigEndian);
-                    memcpy(tmpBuf + 4, ps3Id_, 14);
-                    if (fwrite(tmpBuf, 1, 18, ofp) != 18) return 4;
-                    if (ferror(ofp)) return 4;
-
-                    const long sizeFront = (long)(record - psData.pData_);
-                    const long sizeEnd = psData.size_ - sizeFront - sizeOldData;
-                    // write data before old record.
-                    if (fwrite(psData.pData_, 1, sizeFront, ofp) != (size_t)sizeFront) return 4;
-
-                    // write new iptc record if we have it
-                    if (pIptcData_) {
-                        memcpy(tmpBuf, bimId_, 4);
-                        us2Data(tmpBuf+4, iptc_, bigEndian);
-                        tmpBuf[6] = 0;
-                        tmpBuf[7] = 0;
-                        ul2Data(tmpBuf + 8, sizeIptcData_, bigEndian);
-                        if (fwrite(tmpBuf, 1, 12, ofp) != 12) return 4;
-                        if (   fwrite(pIptcData_, 1, sizeIptcData_ , ofp) 
-                            != (size_t)sizeIptcData_) return 4;
-                        // data is padded to be even (but not included in size)
-                        if (sizeIptcData_ & 1) {
-                            if (fputc(0, ofp)==EOF) return 4;
-                        }
-                        if (ferror(ofp)) return 4;
-                        --search;
-                    }
-                    
-                    // write existing stuff after record
-                    if (   fwrite(record+sizeOldData, 1, sizeEnd, ofp) 
-                        != (size_t)sizeEnd) return 4;
-                    if (ferror(ofp)) return 4;
-                }
+                if (writePs3Segment(oIo, psData)) return 4;
+                if (pIptcData_) --search;
+                // Reserve space for later edits after the metadata
+                if (padding_ > 0 && writePadding(oIo, padding_)) return 4;
             }
             if (marker == eoi_) {
                 break;
             }
             else if (skipApp1Exif==count || skipApp13Ps3==count || skipCom==count) {
                 --search;
-                fseek(ifp, size-bufRead, SEEK_CUR);
+                iIo.seek(size-bufRead, BasicIo::cur);
+            }
+            else if (   padding_ > 0 && marker == app15_ 
+                     && memcmp(buf.pData_ + 2, padId_, 8) == 0) {
+                iIo.seek(size-bufRead, BasicIo::cur);
             }
             else {
                 if (size < 2) return 2;
                 buf.alloc(size+2);
-                fseek(ifp, -bufRead-2, SEEK_CUR);
-                fread(buf.pData_, 1, size+2, ifp);
-                if (ferror(ifp) || feof(ifp)) return 1;
-                if (fwrite(buf.pData_, 1, size+2, ofp) != (size_t)size+2) return 4;
-                if (ferror(ofp)) return 4;
+                iIo.seek(-bufRead-2, BasicIo::cur);
+                iIo.read(buf.pData_, size+2);
+                if (iIo.error() || iIo.eof()) return 1;
+                if (oIo.write(buf.pData_, size+2) != size+2) return 4;
+                if (oIo.error()) return 4;
             }
 
             // Next marker
-            marker = advanceToMarker(ifp);
+            marker = advanceToMarker(iIo);
             if (marker < 0) return 2;
             ++count;
         }
 
-        // Copy rest of the stream
-        fseek(ifp, -2, SEEK_CUR);
-        fflush( ofp );
-        buf.alloc(4096);
-        size_t readSize = 0;
-        while ((readSize=fread(buf.pData_, 1, buf.size_, ifp))) {
-            if (fwrite(buf.pData_, 1, readSize, ofp) != readSize) return 4;
-        }
-        if (ferror(ofp)) return 4;
+        // Copy rest of the Io
+        iIo.seek(-2, BasicIo::cur);
+        oIo.write(iIo);
+        if (oIo.error()) return 4;
         
         return 0;
     }// JpegBase::doWriteMetadata
@@ -676,106 +1029,94 @@ namespace Exiv2 {
         0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFF,0xDA,0x00,0x0C,0x03,0x01,0x00,0x02,
         0x11,0x03,0x11,0x00,0x3F,0x00,0xA0,0x00,0x0F,0xFF,0xD9 };
 
-    JpegImage::JpegImage(const std::string& path, bool create) 
-        : JpegBase(path, create, blank_, sizeof(blank_))
+    JpegImage::JpegImage(BasicIo::AutoPtr io, bool create) 
+        : JpegBase(io, create, blank_, sizeof(blank_))
     {
     }
 
-    int JpegImage::writeHeader(FILE* ofp) const
+    int JpegImage::writeHeader(BasicIo& oIo) const
     {
         // Jpeg header
         byte tmpBuf[2];
         tmpBuf[0] = 0xff;
         tmpBuf[1] = soi_;
-        if (fwrite(tmpBuf, 1, 2, ofp) != 2) return 4;
-        if (ferror(ofp)) return 4;
+        if (oIo.write(tmpBuf, 2) != 2) return 4;
+        if (oIo.error()) return 4;
         return 0;
     }
 
-    bool JpegImage::isThisType(FILE* ifp, bool advance) const
+    bool JpegImage::isThisType(BasicIo& iIo, bool advance) const
     {
-        return isJpegType(ifp, advance);
+        return isJpegType(iIo, advance);
     }
 
-    Image::AutoPtr newJpegInstance(const std::string& path, bool create)
+    Image::AutoPtr newJpegInstance(BasicIo::AutoPtr io, bool create)
     {
-        Image::AutoPtr image;
-        if (create) {
-            image = Image::AutoPtr(new JpegImage(path, true));
-        }
-        else {
-            image = Image::AutoPtr(new JpegImage(path, false));
-        }
+        Image::AutoPtr image(new JpegImage(io, create));
         if (!image->good()) {
             image.reset();
         }
         return image;
     }
 
-    bool isJpegType(FILE* ifp, bool advance)
+    bool isJpegType(BasicIo& iIo, bool advance)
     {
         bool result = true;
         byte tmpBuf[2];
-        fread(tmpBuf, 1, 2, ifp);
-        if (ferror(ifp) || feof(ifp)) return false;
+        iIo.read(tmpBuf, 2);
+        if (iIo.error() || iIo.eof()) return false;
 
         if (0xff!=tmpBuf[0] || JpegImage::soi_!=tmpBuf[1]) {
             result = false;
         }
-        if (!advance || !result ) fseek(ifp, -2, SEEK_CUR);
+        if (!advance || !result ) iIo.seek(-2, BasicIo::cur);
         return result;
     }
    
     const char ExvImage::exiv2Id_[] = "Exiv2";
     const byte ExvImage::blank_[] = { 0xff,0x01,'E','x','i','v','2',0xff,0xd9 };
 
-    ExvImage::ExvImage(const std::string& path, bool create) 
-        : JpegBase(path, create, blank_, sizeof(blank_))
+    ExvImage::ExvImage(BasicIo::AutoPtr io, bool create) 
+        : JpegBase(io, create, blank_, sizeof(blank_))
     {
     }
 
-    int ExvImage::writeHeader(FILE* ofp) const
+    int ExvImage::writeHeader(BasicIo& oIo) const
     {
         // Exv header
         byte tmpBuf[7];
         tmpBuf[0] = 0xff;
         tmpBuf[1] = 0x01;
         memcpy(tmpBuf + 2, exiv2Id_, 5);
-        if (fwrite(tmpBuf, 1, 7, ofp) != 7) return 4;
-        if (ferror(ofp)) return 4;
+        if (oIo.write(tmpBuf, 7) != 7) return 4;
+        if (oIo.error()) return 4;
         return 0;
     }
 
-    bool ExvImage::isThisType(FILE* ifp, bool advance) const
+    bool ExvImage::isThisType(BasicIo& iIo, bool advance) const
     {
-        return isExvType(ifp, advance);
+        return isExvType(iIo, advance);
     }
 
-    Image::AutoPtr newExvInstance(const std::string& path, bool create)
+    Image::AutoPtr newExvInstance(BasicIo::AutoPtr io, bool create)
     {
-        Image::AutoPtr image;
-        if (create) {
-            image = Image::AutoPtr(new ExvImage(path, true));
-        }
-        else {
-            image = Image::AutoPtr(new ExvImage(path, false));
-        }
+        Image::AutoPtr image(new ExvImage(io, create));
         if (!image->good()) image.reset();
         return image;
     }
 
-    bool isExvType(FILE* ifp, bool advance)
+    bool isExvType(BasicIo& iIo, bool advance)
     {
         bool result = true;
         byte tmpBuf[7];
-        fread(tmpBuf, 1, 7, ifp);
-        if (ferror(ifp) || feof(ifp)) return false;
+        iIo.read(tmpBuf, 7);
+        if (iIo.error() || iIo.eof()) return false;
 
         if (0xff!=tmpBuf[0] || 0x01!=tmpBuf[1] || 
                     memcmp(tmpBuf + 2, ExvImage::exiv2Id_, 5) != 0) {
             result = false;
         }
-        if (!advance || !result ) fseek(ifp, -7, SEEK_CUR);
+        if (!advance || !result ) iIo.seek(-7, BasicIo::cur);
         return result;
     }
 
@@ -36,10 +36,12 @@
 // *****************************************************************************
 // included header files
 #include "types.hpp"
+#include "basicio.hpp"
 
 // + standard includes
 #include <string>
 #include <map>
+#include <vector>
 #include <memory>
 
 // *****************************************************************************
@@ -74,6 +76,27 @@ namespace Exiv2 {
           @return 0 if successful.
          */
         virtual int readMetadata() =0;
+        /*!
+          @brief Read only the metadata selected by \em mask from the image
+                 file into internal buffers. The other metadata types are
+                 left empty, and are kept unchanged in the file by
+                 writeMetadata unless they are set.
+          @param mask Bitwise or of MetadataId values.
+          @return 0 if successful.
+         */
+        virtual int readMetadata(int mask) =0;
+        /*!
+          @brief Find the position of the Exif data in the image without
+                 reading it.
+          @param offset Set to the offset of the Exif data, i.e., of the
+                 TIFF header, from the start of the image.
+          @param size Set to the size of the Exif data in bytes.
+          @return 0 if successful;<BR>
+                  1 if reading from the image failed;<BR>
+                  2 if the image is not valid;<BR>
+                  3 if the image contains no Exif data;<BR>
+         */
+        virtual int locateExifData(long& offset, long& size) =0;
         /*!
           @brief Write metadata from internal buffers into to the image fle.
           @return 0 if successful.
@@ -126,6 +149,14 @@ namespace Exiv2 {
                  from the actual file until writeMetadata is called.
          */
         virtual void clearMetadata() =0;
+        /*!
+          @brief Set the number of bytes to reserve for later metadata
+                 edits when the image is rewritten. Metadata that grows
+                 into the reserved space can be written in place. The
+                 default is to reserve nothing.
+          @param size Size of the reserved space in bytes.
+         */
+        virtual void setPadding(long size) =0;
         //@}
 
         //! @name Accessors
@@ -154,6 +185,28 @@ namespace Exiv2 {
           @brief Return a copy of the image comment. May be an empty string.
          */
         virtual std::string comment() const =0;
+        /*!
+          @brief Return the width of the image in pixels, 0 if it was not
+                 read. Read with mask mdDimensions.
+         */
+        virtual long pixelWidth() const =0;
+        //! Return the height of the image in pixels, 0 if it was not read.
+        virtual long pixelHeight() const =0;
+        /*!
+          @brief Return a reference to the BasicIo instance being used for Io.
+
+          This refence is particularly useful to reading the results of
+          operations on a MemIo instance. For example after metadata has
+          been modified and the writeMetadata() method has been called,
+          this method can be used to get access to the modified image.
+
+          @return BasicIo instance that can be used to read or write image
+                  data directly.
+          @note If the returned BasicIo is used to write to the image, the
+                %Image class will not see those changes until the
+                readMetadata() method is called.
+         */
+        virtual BasicIo& io() const =0;
         //@}
 
     protected:
@@ -173,10 +226,10 @@ namespace Exiv2 {
     }; // class Image
 
     //! Type for function pointer that creates new Image instances
-    typedef Image::AutoPtr (*NewInstanceFct)(const std::string& path, 
-                                                   bool create);
+    typedef Image::AutoPtr (*NewInstanceFct)(BasicIo::AutoPtr io, 
+                                             bool create);
     //! Type for function pointer that checks image types
-    typedef bool (*IsThisTypeFct)(FILE* ifp, bool advance);
+    typedef bool (*IsThisTypeFct)(BasicIo& iIo, bool advance);
 
     /*!
       @brief Image factory.
@@ -211,13 +264,40 @@ namespace Exiv2 {
         /*!
           @brief  Create an %Image of the appropriate type by opening the
                   specified file. File type is derived from the contents of the
-                  file.
+                  file. The file is accessed through a memory mapped MmapIo.
           @param  path %Image file. The contents of the file are tested to
                   determine the image type to open. File extension is ignored.
           @return An auto-pointer that owns an %Image of the type derived from
                   the file. If no image type could be determined, the pointer is 0.
          */
         Image::AutoPtr open(const std::string& path) const;
+        /*!
+          @brief  Create an %Image of the appropriate type by reading
+                  the provided BasicIo instance. %Image type is derived
+                  from the data provided by \em io. The passed in \em io
+                  instance is opened by this method unless it is already
+                  open, and is left open for the image to read from.
+          @param  io An auto-pointer that owns a BasicIo instance that provides
+                  image data. The contents of the image data are tested to
+                  determine the type. The image takes ownership of \em io.
+          @return An auto-pointer that owns an %Image of the type derived from
+                  the data. If no image type could be determined, the pointer
+                  is 0.
+         */
+        Image::AutoPtr open(BasicIo::AutoPtr io) const;
+        /*!
+          @brief  Create an %Image of the appropriate type by reading the
+                  provided memory, e.g., the contents of an image file. %Image
+                  type is derived from the data. The data is accessed in place
+                  through a MemIo and is only copied if the image is written to.
+          @param  data Pointer to a data buffer containing an image. The data
+                  must remain valid as long as the %Image is used.
+          @param  size Number of bytes pointed to by \em data.
+          @return An auto-pointer that owns an %Image of the type derived from
+                  the data. If no image type could be determined, the pointer
+                  is 0.
+         */
+        Image::AutoPtr open(const byte* data, long size) const;
         /*!
           @brief  Create an %Image of the requested type by creating a new
                   file. If the file already exists, it will be overwritten.
@@ -228,6 +308,17 @@ namespace Exiv2 {
                   If the image type is not supported, the pointer is 0.
          */
         Image::AutoPtr create(Image::Type type, const std::string& path) const;
+        /*!
+          @brief  Create an %Image of the requested type by writing a new
+                  image to a BasicIo instance. Existing data in \em io is
+                  overwritten.
+          @param  type Type of the image to be created.
+          @param  io An auto-pointer that owns a BasicIo instance that will
+                  be written to when creating a new image.
+          @return An auto-pointer that owns an %Image of the requested type. 
+                  If the image type is not supported, the pointer is 0.
+         */
+        Image::AutoPtr create(Image::Type type, BasicIo::AutoPtr io) const;
         /*!
           @brief  Returns the image type of the provided file. 
           @param  path %Image file. The contents of the file are tested to
@@ -235,6 +326,22 @@ namespace Exiv2 {
           @return %Image type of Image::none if the type is not recognized.
          */
         Image::Type getType(const std::string& path) const;
+        /*!
+          @brief  Returns the image type of the provided data. The passed in
+                  \em io instance is (re)opened by this method.
+          @param  io A BasicIo instance that provides image data. The contents
+                  of the image data are tested to determine the type.
+          @return %Image type of Image::none if the type is not recognized.
+         */
+        Image::Type getType(BasicIo& io) const;
+        /*!
+          @brief  Returns the image type of the provided data. 
+          @param  data Pointer to a data buffer containing an image. The contents
+                  of the image data are tested to determine the type.
+          @param  size Number of bytes pointed to by \em data.
+          @return %Image type of Image::none if the type is not recognized.
+         */
+        Image::Type getType(const byte* data, long size) const;
         //@}
 
         /*!
@@ -296,18 +403,40 @@ namespace Exiv2 {
                   1 if reading from the file failed 
                     (could be caused by invalid image);<BR>
                   2 if the file does not contain a valid image;<BR>
+
+          The image stays open after this call and the positions of the
+          segments read are kept, so that a subsequent writeMetadata call
+          does not need to reopen and rescan the image.
          */
         int readMetadata();
+        /*!
+          @brief Read the metadata selected by \em mask. Segments of other
+                 metadata are skipped, and reading stops as soon as all
+                 selected metadata has been found. See readMetadata().
+          @param mask Bitwise or of MetadataId values.
+         */
+        int readMetadata(int mask);
+        /*!
+          @brief Find the position of the Exif data in the image. Only the
+                 headers of the segments up to the Exif segment are read.
+                 See Image::locateExifData().
+         */
+        int locateExifData(long& offset, long& size);
         /*!
           @brief Write all buffered metadata to associated file. All existing
                 metadata sections in the file are either replaced or erased.
                 If data for a given metadata type has not been assigned,
                 then that metadata type will be erased from the file.
+
+          If the new metadata fits into the existing segments and padding,
+          they are overwritten in place. Otherwise the image is rewritten to
+          a temporary, which then replaces the original. When rewriting,
+          a padding segment of the size set with setPadding() is written
+          after the metadata, replacing any existing padding.
           @return 0 if successful;<br>
                   1 if reading from the file failed;<BR>
                   2 if the file does not contain a valid image;<BR>
                   4 if the temporary output file can not be written to;<BR>
-                  -1 if the newly created file could not be reopened;<BR>
                   -3 if the temporary output file can not be opened;<BR>
                   -4 if renaming the temporary file fails;<br>
          */
@@ -329,6 +458,7 @@ namespace Exiv2 {
         void clearComment();
         void setMetadata(const Image& image);
         void clearMetadata();
+        void setPadding(long size);
         //@}
 
         //! @name Accessors
@@ -339,6 +469,9 @@ namespace Exiv2 {
         long sizeIptcData() const { return sizeIptcData_; }
         const byte* iptcData() const { return pIptcData_; }
         std::string comment() const { return comment_; }
+        long pixelWidth() const { return pixelWidth_; }
+        long pixelHeight() const { return pixelHeight_; }
+        BasicIo& io() const { return *io_; }
         //@}
 
     protected:
@@ -347,30 +480,33 @@ namespace Exiv2 {
         /*! 
           @brief Constructor that can either open an existing image or create
                  a new image from scratch. If a new image is to be created, any
-                 existing file is overwritten
-          @param path Full path to image file.
-          @param create Specifies if an existing file should be opened (false)
-                 or if a new file should be created (true).
-          @param initData Data to initialize newly created files. Only used
+                 existing data is overwritten.
+          @param io An auto-pointer that owns a BasicIo instance used for
+                 reading and writing image metadata. \b Important: The
+                 constructor takes ownership of the passed in BasicIo instance
+                 through the auto-pointer.
+          @param create Specifies if an existing image should be read (false)
+                 or if a new image should be created (true).
+          @param initData Data to initialize newly created images. Only used
                  when %create is true. Should contain the data for the smallest
                  valid image of the calling subclass.
           @param dataSize Size of initData in bytes.
          */
-        JpegBase(const std::string& path, bool create,
-                 const byte initData[], size_t dataSize);
+        JpegBase(BasicIo::AutoPtr io, bool create,
+                 const byte initData[], long dataSize);
         //@}
         //! @name Accessors
         //@{
         /*!
-          @brief Writes the image header (aka signature) to the file stream.
-          @param ofp File stream that the header is written to.
+          @brief Writes the image header (aka signature) to the BasicIo instance.
+          @param oIo BasicIo instance that the header is written to.
           @return 0 if successful;<BR>
                  4 if the output file can not be written to;<BR>
          */
-        virtual int writeHeader(FILE* ofp) const =0;
+        virtual int writeHeader(BasicIo& oIo) const =0;
         /*!
-          @brief Determine if the content of the stream is of the type of this
-                 class.
+          @brief Determine if the content of the BasicIo instance is of the
+                 type of this class.
 
           The advance flag determines if the read position in the stream is
           moved (see below). This applies only if the type matches and the
@@ -379,7 +515,7 @@ namespace Exiv2 {
           the stream position is undefined. Consult the stream state to obtain 
           more information in this case.
           
-          @param ifp Input file stream.
+          @param iIo BasicIo instance to read from.
           @param advance Flag indicating whether the read position in the stream
                          should be advanced by the number of characters read to
                          analyse the stream (true) or left at its original
@@ -387,7 +523,7 @@ namespace Exiv2 {
           @return  true  if the stream data matches the type of this class;<BR>
                    false if the stream data does not match;<BR>
          */
-        virtual bool isThisType(FILE* ifp, bool advance) const =0;
+        virtual bool isThisType(BasicIo& iIo, bool advance) const =0;
         //@}
 
         // Constant Data
@@ -396,32 +532,54 @@ namespace Exiv2 {
         static const byte app0_;                //!< JPEG APP0 marker
         static const byte app1_;                //!< JPEG APP1 marker
         static const byte app13_;               //!< JPEG APP13 marker
+        static const byte app15_;               //!< JPEG APP15 marker
         static const byte com_;                 //!< JPEG Comment marker
         static const char exifId_[];            //!< Exif identifier
         static const char jfifId_[];            //!< JFIF identifier
         static const char ps3Id_[];             //!< Photoshop marker
+        static const char padId_[];             //!< Padding identifier
         static const char bimId_[];             //!< Photoshop marker
         static const uint16_t iptc_;              //!< Photoshop Iptc marker
 
     private:
+        //! Position of a Jpeg segment in the image
+        struct Segment {
+            //! Constructor
+            Segment(int marker, long offset, uint16_t size, bool signature)
+                : marker_(marker), offset_(offset), 
+                  size_(size), signature_(signature) {}
+            int marker_;                        //!< Segment marker
+            long offset_;                       //!< Offset of the size field
+            uint16_t size_;                     //!< Segment size
+            bool signature_;                    //!< Exif, Photoshop or padding
+        };
+        //! Container for the segment positions of an image
+        typedef std::vector<Segment> Segments;
+
         // DATA
-        const std::string path_;                //!< Image file name
+        BasicIo::AutoPtr io_;                   //!< Image data io pointer
+        Segments segments_;                     //!< Segments found by readMetadata
         long sizeExifData_;                     //!< Size of the Exif data buffer
         byte* pExifData_;                       //!< Exif data buffer
         long sizeIptcData_;                     //!< Size of the Iptc data buffer
         byte* pIptcData_;                       //!< Iptc data buffer
         std::string comment_;                   //!< JPEG comment
+        long padding_;                          //!< Space to reserve on rewrite
+        long pixelWidth_;                       //!< Width of the image
+        long pixelHeight_;                      //!< Height of the image
+        int unread_;                            //!< Metadata to keep on write
 
         // METHODS
         /*!
-          @brief Advances file stream to one byte past the next Jpeg marker
-                 and returns the marker. This method should be called when the
-                 file stream is positioned one byte past the end of a Jpeg segment.
-          @param fp File stream to advance
+          @brief Advances associated io instance to one byte past the next
+                 Jpeg marker and returns the marker. This method should be
+                 called when the BasicIo instance is positioned one byte past
+                 the end of a Jpeg segment.
+          @param iIo BasicIo instance to advance
           @return the next Jpeg segment marker if successful;<BR>
                  -1 if a maker was not found before EOF;<BR>
          */
-        int advanceToMarker(FILE *fp) const;
+        int advanceToMarker(BasicIo& iIo) const;
         /*!
           @brief Locates Photoshop formated Iptc data in a memory buffer.
                  Operates on raw data (rather than file streams) to simplify reuse.
@@ -446,25 +604,105 @@ namespace Exiv2 {
                            uint16_t *const sizeHdr,
                            uint16_t *const sizeIptc) const;
         /*!
-          @brief Write to the specified file stream with the provided data.
-          @param fp File stream to be written to (should be "w+b" mode)
-          @param initData Data to be written to the associated file
+          @brief Initialize the image with the provided data.
+          @param initData Data to be written to the associated BasicIo
           @param dataSize Size in bytes of data to be written
           @return 0 if successful;<BR>
-                  4 if the output file can not be written to;<BR>
+                  4 if the image can not be written to;<BR>
+         */
+        int initImage(const byte initData[], long dataSize);
+        /*!
+          @brief Record the position of all segments up to the SOS or EOI
+                 marker. The last entry is the SOS or EOI marker.
+          @param iIo BasicIo instance positioned right after the image header.
+          @param segments Container to append the segment positions to.
+          @return 0 if successful;<BR>
+                  1 if reading from the input failed;<BR>
+                  2 if the input does not contain a valid image;<BR>
+         */
+        int scanSegments(BasicIo& iIo, Segments& segments) const;
+        /*!
+          @brief Find the segments replaced by doWriteMetadata and the
+                 position to insert new segments at.
+          @return true if all segments of interest are in \em segments;<BR>
+                  false if \em segments ends before they were all found;<BR>
+         */
+        bool findSegments(const Segments& segments,
+                          int& insertPos,
+                          int& skipApp1Exif,
+                          int& skipApp13Ps3,
+                          int& skipCom,
+                          int& search) const;
+        /*!
+          @brief Ignore the segments of metadata that was not read, so that
+                 they are kept unchanged when the image is written.
+         */
+        void keepUnread(int& skipApp1Exif,
+                        int& skipApp13Ps3,
+                        int& skipCom) const;
+        /*!
+          @brief Read the Photoshop data of an APP13 segment, i.e., the
+                 payload following the Photoshop identifier.
+          @return 0 if successful;<BR>
+                  1 if reading from the input failed;<BR>
+         */
+        int readPsData(BasicIo& iIo, 
+                       const Segment& ps3, 
+                       DataBuf& psData) const;
+        /*!
+          @brief Write a COM segment with the buffered comment.
+          @return 0 if successful;<BR>
+                  4 if the output can not be written to;<BR>
+         */
+        int writeComSegment(BasicIo& oIo) const;
+        /*!
+          @brief Write an APP1 segment with the buffered Exif data.
+          @return 0 if successful;<BR>
+                  4 if the output can not be written to;<BR>
+         */
+        int writeExifSegment(BasicIo& oIo) const;
+        /*!
+          @brief Write an APP13 segment with the Photoshop data \em psData,
+                 its Iptc record replaced by the buffered Iptc data. Nothing
+                 is written if the segment would be empty.
+          @return 0 if successful;<BR>
+                  4 if the output can not be written to;<BR>
+         */
+        int writePs3Segment(BasicIo& oIo, const DataBuf& psData) const;
+        /*!
+          @brief Write \em size bytes of padding, as APP15 padding segments
+                 and 0xff fill bytes for a remainder too small for one.
+          @return 0 if successful;<BR>
+                  4 if the output can not be written to;<BR>
+         */
+        int writePadding(BasicIo& oIo, long size) const;
+        //! Return true if \em segment is a padding segment
+        bool isPadding(const Segment& segment) const;
+        /*!
+          @brief Overwrite the existing Exif, Photoshop and comment segments
+                 in place if the new metadata fits into them. A segment can
+                 grow into the padding segment following it, and new
+                 segments are put into padding. Unused bytes become padding.
+                 Nothing is written unless all of them fit.
+          @return 0 if successful;<BR>
+                  1 if reading from the image failed;<BR>
+                  4 if the image can not be written to;<BR>
+                  -1 if the image needs to be rewritten;<BR>
          */
-        int initFile(FILE* fp, const byte initData[], size_t dataSize);
+        int writeInPlace();
         /*!
           @brief Provides the main implementation of writeMetadata by 
-                writing all buffered metadata to associated file. 
-          @param ifp Input file stream. Non-metadata is copied to output file.
-          @param ofp Output file stream to write to (e.g., a temporary file).
+                writing all buffered metadata to associated BasicIo instance. 
+          @param iIo Input BasicIo instance. Non-metadata is copied to the
+                 output.
+          @param oIo Output BasicIo instance to write to (e.g., a temporary
+                 file).
           @return 0 if successful;<br>
                   1 if reading from input file failed;<BR>
                   2 if the input file does not contain a valid image;<BR>
                   4 if the output file can not be written to;<BR>
          */
-        int doWriteMetadata(FILE *ifp, FILE* ofp) const;
+        int doWriteMetadata(BasicIo& iIo, BasicIo& oIo) const;
 
         // NOT Implemented
         //! Default constructor.
@@ -479,21 +717,24 @@ namespace Exiv2 {
       @brief Helper class to access JPEG images
      */
     class JpegImage : public JpegBase {
-        friend bool isJpegType(FILE* ifp, bool advance);
+        friend bool isJpegType(BasicIo& iIo, bool advance);
     public:
         //! @name Creators
         //@{
         /*! 
           @brief Constructor that can either open an existing Jpeg image or create
                  a new image from scratch. If a new image is to be created, any
-                 existing file is overwritten. Since the constructor can not return
+                 existing data is overwritten. Since the constructor can not return
                  a result, callers should check the %good method after object
                  construction to determine success or failure.
-          @param path Full path to image file.
-          @param create Specifies if an existing file should be opened (false)
+          @param io An auto-pointer that owns a BasicIo instance used for
+                 reading and writing image metadata. \b Important: The
+                 constructor takes ownership of the passed in BasicIo instance
+                 through the auto-pointer.
+          @param create Specifies if an existing image should be read (false)
                  or if a new file should be created (true).
          */
-        JpegImage(const std::string& path, bool create);
+        JpegImage(BasicIo::AutoPtr io, bool create);
         //! Destructor
         ~JpegImage() {}
         //@}
@@ -501,24 +742,24 @@ namespace Exiv2 {
         //! @name Accessors
         //@{
         /*!
-          @brief Writes a Jpeg header (aka signature) to the file stream.
-          @param ofp File stream that the header is written to.
+          @brief Writes a Jpeg header (aka signature) to the BasicIo instance.
+          @param oIo BasicIo instance that the header is written to.
           @return 0 if successful;<BR>
                  4 if the output file can not be written to;<BR>
          */
-        int writeHeader(FILE* ofp) const;
+        int writeHeader(BasicIo& oIo) const;
         /*!
-          @brief Determine if the content of the file stream is a Jpeg image.
+          @brief Determine if the content of the BasicIo instance is a Jpeg image.
                  See base class for more details.
-          @param ifp Input file stream.
+          @param iIo BasicIo instance to read from.
           @param advance Flag indicating whether the read position in the stream
                          should be advanced by the number of characters read to
                          analyse the stream (true) or left at its original
                          position (false). This applies only if the type matches.
-          @return  true  if the file stream data matches a Jpeg image;<BR>
+          @return  true  if the data matches a Jpeg image;<BR>
                    false if the stream data does not match;<BR>
          */
-        bool isThisType(FILE* ifp, bool advance) const;
+        bool isThisType(BasicIo& iIo, bool advance) const;
         //@}
     private:
         // Constant data
@@ -536,21 +777,24 @@ namespace Exiv2 {
 
     //! Helper class to access %Exiv2 files
     class ExvImage : public JpegBase {
-        friend bool isExvType(FILE* ifp, bool advance);
+        friend bool isExvType(BasicIo& iIo, bool advance);
     public:
         //! @name Creators
         //@{
         /*! 
           @brief Constructor that can either open an existing Exv image or create
                  a new image from scratch. If a new image is to be created, any
-                 existing file is overwritten. Since the constructor can not return
+                 existing data is overwritten. Since the constructor can not return
                  a result, callers should check the %good method after object
                  construction to determine success or failure.
-          @param path Full path to image file.
-          @param create Specifies if an existing file should be opened (false)
+          @param io An auto-pointer that owns a BasicIo instance used for
+                 reading and writing image metadata. \b Important: The
+                 constructor takes ownership of the passed in BasicIo instance
+                 through the auto-pointer.
+          @param create Specifies if an existing image should be read (false)
                  or if a new file should be created (true).
          */
-        ExvImage(const std::string& path, bool create);
+        ExvImage(BasicIo::AutoPtr io, bool create);
         //! Destructor
         ~ExvImage() {}
         //@}
@@ -558,24 +802,24 @@ namespace Exiv2 {
         //! @name Accessors
         //@{
         /*!
-          @brief Writes an Exv header (aka signature) to the file stream.
-          @param ofp File stream that the header is written to.
+          @brief Writes an Exv header (aka signature) to the BasicIo instance.
+          @param oIo BasicIo instance that the header is written to.
           @return 0 if successful;<BR>
                   4 if the output file can not be written to;<BR>
          */
-        int writeHeader(FILE* ofp) const;
+        int writeHeader(BasicIo& oIo) const;
         /*!
-          @brief Determine if the content of the file stream is a Exv image.
+          @brief Determine if the content of the BasicIo instance is a Exv image.
                  See base class for more details.
-          @param ifp Input file stream.
+          @param iIo BasicIo instance to read from.
           @param advance Flag indicating whether the read position in the stream
                          should be advanced by the number of characters read to
                          analyse the stream (true) or left at its original
                          position (false). This applies only if the type matches.
-          @return  true  if the file stream data matches a Exv image;<BR>
+          @return  true  if the data matches a Exv image;<BR>
                    false if the stream data does not match;<BR>
          */
-        virtual bool isThisType(FILE* ifp, bool advance) const;
+        virtual bool isThisType(BasicIo& iIo, bool advance) const;
         //@}
     private:
         // Constant data
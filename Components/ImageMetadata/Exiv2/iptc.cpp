@@ -44,6 +44,15 @@ EXIV2_RCSID("@(#) $Id: iptc.cpp 486 2005-01-16 14:50:33Z ahuggel $");
 #include <iostream>
 #include <algorithm>
 
+// *****************************************************************************
+// local declarations
+namespace {
+
+    // Return the id of a dataset in a record, used as key of the metadata index
+    uint32_t indexId(uint16_t dataSet, uint16_t record);
+
+}
+
 // *****************************************************************************
 // class member definitions
 namespace Exiv2 {
@@ -123,64 +132,89 @@ namespace Exiv2 {
         iterator pos = findKey(iptcKey);
         if (pos == end()) {
             add(Iptcdatum(iptcKey));
-            pos = findKey(iptcKey);
+            pos = end() - 1;
         }
         return *pos;
     }
 
     int IptcData::read(const std::string& path)
     {
-        if (!fileExists(path, true)) return -1;
-        Image::AutoPtr image = ImageFactory::instance().open(path);
-        if (image.get() == 0) {
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
+        return readFromImage(image.get());
+    }
+
+    int IptcData::read(Image& image)
+    {
+        return readFromImage(&image);
+    }
+
+    int IptcData::readImage(const byte* data, long size)
+    {
+        Image::AutoPtr image = ImageFactory::instance().open(data, size);
+        return readFromImage(image.get());
+    }
+
+    int IptcData::readFromImage(Image* pImage)
+    {
+        if (pImage == 0) {
             // We don't know this type of file
             return -2;
         }
         
-        int rc = image->readMetadata();
+        int rc = pImage->readMetadata(mdIptc);
         if (rc == 0) {
-            if (image->sizeIptcData() > 0) {
-                rc = read(image->iptcData(), image->sizeIptcData());
+            if (pImage->sizeIptcData() > 0) {
+                rc = read(pImage->iptcData(), pImage->sizeIptcData());
             }
             else {
                 rc = 3;
             }
         }
         return rc;
+    } // IptcData::readFromImage
+
+    IptcData::IptcData(const IptcData& rhs)
+        : iptcMetadata_(rhs.iptcMetadata_), index_(rhs.index_)
+    {
+    }
+
+    IptcData& IptcData::operator=(const IptcData& rhs)
+    {
+        if (this == &rhs) return *this;
+        iptcMetadata_ = rhs.iptcMetadata_;
+        index_ = rhs.index_;
+        // The copies are on the heap, the arena is not used anymore
+        arena_.reset();
+        return *this;
     }
 
     int IptcData::read(const byte* buf, long len)
     {
-        const byte* pRead = buf;
         iptcMetadata_.clear();
+        index_.reset();
+        arena_.reset();
 
         int rc = 0;
         uint16_t record = 0;
         uint16_t dataSet = 0;
         uint32_t sizeData = 0;
-        byte extTest = 0;
 
+        // Count the datasets first, so that the metadata is not moved
+        const byte* pRead = buf;
+        long count = 0;
+        while (   pRead < buf + len 
+               && readHeader(pRead, record, dataSet, sizeData) == 0) {
+            ++count;
+            pRead += sizeData;
+        }
+        iptcMetadata_.reserve(count);
+
+        pRead = buf;
         while (pRead < buf + len) {
-            if (*pRead++ != marker_) return 5;
-            record = *pRead++;
-            dataSet = *pRead++;
-            
-            extTest = *pRead;
-            if (extTest & 0x80) {
-                // extended dataset
-                uint16_t sizeOfSize = (getUShort(pRead, bigEndian) & 0x7FFF);
-                if (sizeOfSize > 4) return 5;
-                pRead += 2;
-                sizeData = 0;
-                for (; sizeOfSize > 0; --sizeOfSize) {
-                    sizeData |= *pRead++ << (8 *(sizeOfSize-1));
-                }
-            }
-            else {
-                // standard dataset
-                sizeData = getUShort(pRead, bigEndian);
-                pRead += 2;
-            }
+            rc = readHeader(pRead, record, dataSet, sizeData);
+            if (rc) return rc;
 			
 			try 
 			{
@@ -198,26 +232,62 @@ namespace Exiv2 {
         return rc;
     } // IptcData::read
 
+    int IptcData::readHeader(const byte*& pRead, uint16_t& record,
+                             uint16_t& dataSet, uint32_t& sizeData) const
+    {
+        if (*pRead++ != marker_) return 5;
+        record = *pRead++;
+        dataSet = *pRead++;
+
+        byte extTest = *pRead;
+        if (extTest & 0x80) {
+            // extended dataset
+            uint16_t sizeOfSize = (getUShort(pRead, bigEndian) & 0x7FFF);
+            if (sizeOfSize > 4) return 5;
+            pRead += 2;
+            sizeData = 0;
+            for (; sizeOfSize > 0; --sizeOfSize) {
+                sizeData |= *pRead++ << (8 *(sizeOfSize-1));
+            }
+        }
+        else {
+            // standard dataset
+            sizeData = getUShort(pRead, bigEndian);
+            pRead += 2;
+        }
+        return 0;
+    } // IptcData::readHeader
+
     int IptcData::readData(uint16_t dataSet, uint16_t record, 
                            const byte* data, uint32_t sizeData)
     {
-        Value::AutoPtr value;
+        // The key and value are created in the arena and the metadatum in
+        // place, instead of copying them
         TypeId type = IptcDataSets::dataSetType(dataSet, record);
-        value = Value::create(type);
+        Value::AutoPtr value = Value::create(type, &arena_);
         value->read(data, sizeData, bigEndian);
-        IptcKey key(dataSet, record);
-        add(key, value.get());
+        IptcKey::AutoPtr key(new (&arena_) IptcKey(dataSet, record));
+        // Same check as in add(const Iptcdatum&)
+        if (   !IptcDataSets::dataSetRepeatable(dataSet, record)
+            && findId(dataSet, record) != end()) {
+            return 0;
+        }
+        iptcMetadata_.push_back(Iptcdatum());
+        iptcMetadata_.back().key_ = key;
+        iptcMetadata_.back().value_ = value;
+        index_.add(indexId(dataSet, record), count() - 1);
         return 0;
     }
 
     int IptcData::erase(const std::string& path) const
     {
-        if (!fileExists(path, true)) return -1;
-        Image::AutoPtr image = ImageFactory::instance().open(path);
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
         if (image.get() == 0) return -2;
 
-        // Read all metadata then erase only Iptc data
-        int rc = image->readMetadata();
+        // Other metadata is not read, it is kept unchanged
+        int rc = image->readMetadata(mdNone);
         if (rc == 0) {
             image->clearIptcData();
             rc = image->writeMetadata();
@@ -225,25 +295,32 @@ namespace Exiv2 {
         return rc;
     } // IptcData::erase
 
-    int IptcData::write(const std::string& path) 
+    int IptcData::write(const std::string& path, long padding) 
     {
         // Remove the Iptc section from the file if there is no metadata 
         if (count() == 0) return erase(path);
 
-        if (!fileExists(path, true)) return -1;
-        Image::AutoPtr image = ImageFactory::instance().open(path);
+        BasicIo::AutoPtr io(new MmapIo(path));
+        if (io->open() != 0) return -1;
+        Image::AutoPtr image = ImageFactory::instance().open(io);
         if (image.get() == 0) return -2;
 
-        DataBuf buf(copy());
-
-        // Read all metadata to preserve non-Iptc data
-        int rc = image->readMetadata();
+        // Other metadata is not read, it is kept unchanged
+        int rc = image->readMetadata(mdNone);
         if (rc == 0) {
-            image->setIptcData(buf.pData_, buf.size_);
-            rc = image->writeMetadata();
+            rc = write(*image, padding);
         }
         return rc;
     } // IptcData::write
+
+    int IptcData::write(Image& image, long padding)
+    {
+        DataBuf buf(copy());
+        // An empty buffer removes the Iptc section
+        image.setIptcData(buf.pData_, buf.size_);
+        image.setPadding(padding);
+        return image.writeMetadata();
+    } // IptcData::write
     
     DataBuf IptcData::copy()
     {
@@ -300,10 +377,10 @@ namespace Exiv2 {
     int IptcData::writeIptcData(const std::string& path)
     {
         DataBuf buf(copy());
-        ExvImage exvImage(path, true);
-        if (!exvImage.good()) return -1;
-        exvImage.setIptcData(buf.pData_, buf.size_);
-        return exvImage.writeMetadata();
+        Image::AutoPtr image = ImageFactory::instance().create(Image::exv, path);
+        if (image.get() == 0) return -1;
+        image->setIptcData(buf.pData_, buf.size_);
+        return image->writeMetadata();
     } // IptcData::writeIptcData
 
     int IptcData::add(const IptcKey& key, Value* value)
@@ -320,48 +397,145 @@ namespace Exiv2 {
         }
         // allow duplicates
         iptcMetadata_.push_back(iptcDatum);
+        index_.add(indexId(iptcDatum.tag(), iptcDatum.record()), count() - 1);
         return 0;
     }
 
     IptcData::const_iterator IptcData::findKey(const IptcKey& key) const
     {
-        return std::find_if(iptcMetadata_.begin(), iptcMetadata_.end(),
-                            FindMetadatumById(key.tag(), key.record()));
+        return findId(key.tag(), key.record());
     }
 
     IptcData::iterator IptcData::findKey(const IptcKey& key)
     {
-        return std::find_if(iptcMetadata_.begin(), iptcMetadata_.end(),
-                            FindMetadatumById(key.tag(), key.record()));
+        return findId(key.tag(), key.record());
     }
 
     IptcData::const_iterator IptcData::findId(uint16_t dataset, uint16_t record) const
     {
-        return std::find_if(iptcMetadata_.begin(), iptcMetadata_.end(),
-                            FindMetadatumById(dataset, record));
+        long pos = findPos(dataset, record);
+        return pos == -1 ? end() : begin() + pos;
     }
 
     IptcData::iterator IptcData::findId(uint16_t dataset, uint16_t record)
     {
-        return std::find_if(iptcMetadata_.begin(), iptcMetadata_.end(),
-                            FindMetadatumById(dataset, record));
+        long pos = findPos(dataset, record);
+        return pos == -1 ? end() : begin() + pos;
     }
 
+    long IptcData::findPos(uint16_t dataset, uint16_t record) const
+    {
+        const uint32_t id = indexId(dataset, record);
+        if (index_.valid()) {
+            long pos = index_.find(id);
+            if (pos != -1) {
+                const Iptcdatum& iptcDatum = iptcMetadata_[pos];
+                if (   iptcDatum.tag() == dataset
+                    && iptcDatum.record() == record) return pos;
+            }
+            else {
+                // The key of a metadatum may have been changed through an
+                // iterator, so a miss is only trusted if no metadatum has
+                // the key
+                IptcMetadata::const_iterator md = iptcMetadata_.begin();
+                IptcMetadata::const_iterator end = iptcMetadata_.end();
+                for (; md != end; ++md) {
+                    if (md->tag() == dataset && md->record() == record) break;
+                }
+                if (md == end) return -1;
+            }
+        }
+        // The index is invalid or out of date: rebuild it
+        index_.reset();
+        for (long i = 0; i < count(); ++i) {
+            index_.add(indexId(iptcMetadata_[i].tag(),
+                               iptcMetadata_[i].record()), i);
+        }
+        return index_.find(id);
+    } // IptcData::findPos
+
     void IptcData::sortByKey()
     {
         std::sort(iptcMetadata_.begin(), iptcMetadata_.end(), cmpMetadataByKey);
+        index_.invalidate();
     }
 
     void IptcData::sortByTag()
     {
         std::sort(iptcMetadata_.begin(), iptcMetadata_.end(), cmpMetadataByTag);
+        index_.invalidate();
     }
 
     IptcData::iterator IptcData::erase(IptcData::iterator pos)
     {
+        index_.invalidate();
         return iptcMetadata_.erase(pos);
     }
 
+    IptcData::iterator IptcData::erase(IptcData::iterator beg,
+                                       IptcData::iterator end)
+    {
+        index_.invalidate();
+        return iptcMetadata_.erase(beg, end);
+    }
+
+    long IptcData::eraseAll(uint16_t dataset, uint16_t record)
+    {
+        const long n = count();
+        iptcMetadata_.erase(std::remove_if(iptcMetadata_.begin(),
+                                           iptcMetadata_.end(),
+                                           FindMetadatumById(dataset, record)),
+                            iptcMetadata_.end());
+        index_.invalidate();
+        return n - count();
+    } // IptcData::eraseAll
+
+    int IptcData::replaceAll(uint16_t dataset, uint16_t record,
+                             const std::vector<std::string>& values)
+    {
+        if (   values.size() > 1
+            && !IptcDataSets::dataSetRepeatable(dataset, record)) return 6;
+
+        FindMetadatumById match(dataset, record);
+        const long first = static_cast<long>(
+            std::find_if(iptcMetadata_.begin(), iptcMetadata_.end(), match)
+            - iptcMetadata_.begin());
+        IptcMetadata iptcMetadata;
+        iptcMetadata.reserve(count() + values.size());
+        for (long i = 0; i <= count(); ++i) {
+            if (i == first) {
+                Iptcdatum iptcDatum(IptcKey(dataset, record));
+                std::vector<std::string>::const_iterator end = values.end();
+                for (std::vector<std::string>::const_iterator v = values.begin();
+                     v != end; ++v) {
+                    iptcDatum = *v;
+                    iptcMetadata.push_back(iptcDatum);
+                }
+            }
+            if (i < count() && !match(iptcMetadata_[i])) {
+                iptcMetadata.push_back(iptcMetadata_[i]);
+            }
+        }
+        iptcMetadata_.swap(iptcMetadata);
+        index_.invalidate();
+        return 0;
+    } // IptcData::replaceAll
+
+    std::pair<IptcData::iterator, IptcData::iterator> IptcData::equalRange(
+        uint16_t dataset, uint16_t record)
+    {
+        FindMetadatumById match(dataset, record);
+        iterator first = std::find_if(begin(), end(), match);
+        iterator last = first;
+        while (last != end() && match(*last)) ++last;
+        if (std::find_if(last, end(), match) != end()) {
+            // Move the others next to the first ones, keeping the order
+            last = std::stable_partition(last, end(), match);
+            index_.invalidate();
+        }
+        return std::make_pair(first, last);
+    } // IptcData::equalRange
+
     std::string IptcData::strError(int rc, const std::string& path)
     {
         std::string error = path + ": ";
@@ -412,3 +586,14 @@ namespace Exiv2 {
     }
 
 }                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    uint32_t indexId(uint16_t dataSet, uint16_t record)
+    {
+        return (static_cast<uint32_t>(record) << 16) | dataSet;
+    }
+
+}
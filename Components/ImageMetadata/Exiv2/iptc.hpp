@@ -45,6 +45,10 @@
 // namespace extensions
 namespace Exiv2 {
 
+// *****************************************************************************
+// class declarations
+    class Image;
+
 // *****************************************************************************
 // class definitions
 
@@ -53,6 +57,7 @@ namespace Exiv2 {
              of an IptcKey and a Value and provides methods to manipulate these.
      */
     class Iptcdatum : public Metadatum {
+        friend class IptcData;
     public:
         //! @name Creators
         //@{
@@ -233,6 +238,9 @@ namespace Exiv2 {
         //@}
 
     private:
+        //! Default constructor, used by IptcData to create metadata in place
+        Iptcdatum() {}
+
         // DATA
         IptcKey::AutoPtr key_;                  //!< Key
         Value::AutoPtr   value_;                //!< Value
@@ -285,10 +293,18 @@ namespace Exiv2 {
         //! IptcMetadata const iterator type
         typedef IptcMetadata::const_iterator const_iterator;
 
-        // Use the compiler generated constructors and assignment operator
+        //! @name Creators
+        //@{
+        //! Default constructor
+        IptcData() {}
+        //! Copy constructor
+        IptcData(const IptcData& rhs);
+        //@}
 
         //! @name Manipulators
         //@{
+        //! Assignment operator
+        IptcData& operator=(const IptcData& rhs);
         /*!
           @brief Read the Iptc data from file path.
           @param path Path to the file
@@ -309,18 +325,65 @@ namespace Exiv2 {
                  5 if Iptc data is invalid or corrupt;<BR>
          */
         int read(const byte* buf, long len);
+        /*!
+          @brief Read the Iptc data from an image held in memory, e.g., the
+                 contents of a JPEG file. The image type is derived from the
+                 data, which is read in place without a temporary file.
+          @param data Pointer to the image data
+          @param size Number of bytes of image data
+          @return  0 if successful;<BR>
+                  -2 if the data is not of a known image type;<BR>
+                   3 if the image contains no Iptc data;<BR>
+                  the return code of Image::readMetadata()
+                    if the call to this function fails;<BR>
+                  the return code of read(const char* buf, long len)
+                    if the call to this function fails;<BR>
+         */
+        int readImage(const byte* data, long size);
+        /*!
+          @brief Read the Iptc data from \em image, e.g., opened with
+                 ImageFactory::open(). The image keeps the file open and
+                 remembers the position of its metadata, so that a
+                 write(Image& image, long padding) to the same image does
+                 not open and scan the file again.
+          @param image Image to read from
+          @return  0 if successful;<BR>
+                   3 if the image contains no Iptc data;<BR>
+                  the return code of Image::readMetadata()
+                    if the call to this function fails;<BR>
+                  the return code of read(const char* buf, long len)
+                    if the call to this function fails;<BR>
+         */
+        int read(Image& image);
         /*!
           @brief Write the Iptc data to file path. If an Iptc data section
                  already exists in the file, it is replaced.  If there is no
                  metadata to write, the Iptc data section is
                  deleted from the file.  Otherwise, an Iptc data section is
                  created.
+          @param path Path to the file.
+          @param padding Number of bytes to reserve for later edits if the
+                 file needs to be rewritten, see Image::setPadding().
           @return 0 if successful;<BR>
                 -2 if the file contains an unknown image type;<BR>
                 the return code of Image::writeMetadata()
                     if the call to this function fails;<BR>
          */
-        int write(const std::string& path);
+        int write(const std::string& path, long padding =0);
+        /*!
+          @brief Write the Iptc data to \em image like
+                 write(const std::string& path, long padding). The metadata
+                 of the image must have been read before, e.g., with
+                 read(Image& image); metadata which was not read is kept
+                 unchanged.
+          @param image Image to write to.
+          @param padding Number of bytes to reserve for later edits if the
+                 file needs to be rewritten, see Image::setPadding().
+          @return 0 if successful;<BR>
+                the return code of Image::writeMetadata()
+                    if the call to this function fails;<BR>
+         */
+        int write(Image& image, long padding =0);
         /*!
           @brief Write the Iptc data to a binary file. By convention, the
                  filename extension should be ".exv". This file format contains
@@ -370,6 +433,40 @@ namespace Exiv2 {
                  by this call.
          */
         iterator erase(iterator pos);
+        /*!
+          @brief Delete the Iptcdata in the range [\em beg, \em end) in one
+                 pass, return the position of the next Iptcdatum. Note that
+                 iterators into the metadata are potentially invalidated by
+                 this call.
+         */
+        iterator erase(iterator beg, iterator end);
+        /*!
+          @brief Delete all Iptcdata with the given record and dataset number
+                 in one pass. Return the number of Iptcdata deleted.
+         */
+        long eraseAll(uint16_t dataset,
+                      uint16_t record = IptcDataSets::application2);
+        /*!
+          @brief Replace all Iptcdata with the given record and dataset
+                 number by one Iptcdatum for each of \em values, in one pass
+                 which allocates the metadata once. The new metadata take
+                 the place of the first one replaced, or are appended.
+          @return 0 if successful;<BR>
+                  6 if there is more than one value and the dataset is not
+                    repeatable
+         */
+        int replaceAll(uint16_t dataset, uint16_t record,
+                       const std::vector<std::string>& values);
+        /*!
+          @brief Return the range of all Iptcdata with the given record and
+                 dataset number. The metadata are first moved next to the
+                 first one in one pass, if they are not already, as the IPTC
+                 IIM standard requires for repeated datasets; the order of
+                 the other metadata is kept. Iterators into the metadata are
+                 potentially invalidated by this call.
+         */
+        std::pair<iterator, iterator> equalRange(
+            uint16_t dataset, uint16_t record = IptcDataSets::application2);
         //! Sort metadata by key
         void sortByKey();
         //! Sort metadata by tag (aka dataset)
@@ -445,6 +542,12 @@ namespace Exiv2 {
         static std::string strError(int rc, const std::string& path);
 
     private:
+        /*!
+          @brief Read the metadata of \em pImage and the Iptc data from its
+                 internal buffer. Return -2 if \em pImage is 0, else see
+                 read(const std::string& path).
+         */
+        int readFromImage(Image* pImage);
         /*!
           @brief Read a single dataset payload and create a new metadata entry
           @param dataSet DataSet number
@@ -455,12 +558,30 @@ namespace Exiv2 {
          */
         int readData(uint16_t dataSet, uint16_t record, 
                      const byte* data, uint32_t sizeData);
+        /*!
+          @brief Read the header of the dataset at \em pRead and advance
+                 \em pRead to the dataset payload.
+          @return 0 if successful;<BR>
+                  5 if there is no valid dataset header at \em pRead.
+         */
+        int readHeader(const byte*& pRead, uint16_t& record,
+                       uint16_t& dataSet, uint32_t& sizeData) const;
+        /*!
+          @brief Return the position of the first Iptcdatum with the given
+                 record and dataset number, -1 if there is none. Uses the
+                 index and rebuilds it if it is not valid.
+         */
+        long findPos(uint16_t dataset, uint16_t record) const;
 
         // Constant data
         static const byte marker_;          // Dataset marker
         
         // DATA
+        //! Arena for the metadata that is read, must outlive the metadata
+        Arena arena_;
         IptcMetadata iptcMetadata_;
+        //! Index of the metadata by record and dataset number
+        mutable MetadataIndex index_;
     }; // class IptcData
 
 }                                       // namespace Exiv2
@@ -0,0 +1,371 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      keywordindex.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#include "keywordindex.hpp"
+#include "iptc.hpp"
+#include "datasets.hpp"
+#include "basicio.hpp"
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>                               // for rename, remove
+#include <cctype>
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    using namespace Exiv2;
+
+    // Identifies an index file, followed by the version of the format
+    const char indexMagic[] = { 'E', 'x', 'v', '2', 'K', 'w', 'i', 'x' };
+    const uint32_t indexVersion = 1;
+
+    // Append a number in little endian byte order to buf
+    void putULong(std::string& buf, uint32_t l);
+
+    // Read a number in little endian byte order, return false at the end
+    bool readULong(const byte*& p, const byte* end, uint32_t& l);
+
+    // Read a string of size len, return false at the end
+    bool readString(const byte*& p, const byte* end, uint32_t len,
+                    std::string& s);
+
+    // Compare postings by size, the smallest first
+    bool shorter(const KeywordIndex::Postings* lhs,
+                 const KeywordIndex::Postings* rhs);
+
+}
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    int KeywordIndex::update(const std::string& path)
+    {
+        IptcData iptcData;
+        int rc = iptcData.read(path);
+        if (rc != 0 && rc != 3) return rc;
+        update(path, iptcData);
+        return 0;
+    }
+
+    void KeywordIndex::update(const std::string& path, const IptcData& iptcData)
+    {
+        std::vector<std::string> keywords;
+        IptcData::const_iterator end = iptcData.end();
+        for (IptcData::const_iterator i = iptcData.begin(); i != end; ++i) {
+            if (   i->record() == IptcDataSets::application2
+                && i->tag() == IptcDataSets::Keywords) {
+                keywords.push_back(i->toString());
+            }
+        }
+        setKeywords(path, keywords);
+    } // KeywordIndex::update
+
+    int KeywordIndex::write(const std::string& path, IptcData& iptcData)
+    {
+        int rc = iptcData.write(path);
+        if (rc == 0) update(path, iptcData);
+        return rc;
+    }
+
+    void KeywordIndex::erase(const std::string& path)
+    {
+        std::map<std::string, uint32_t>::iterator pos = pathMap_.find(path);
+        if (pos == pathMap_.end()) return;
+        File& file = files_[pos->second];
+        post(pos->second, false);
+        file.keywords_.clear();
+        file.path_.erase();
+        pathMap_.erase(pos);
+    } // KeywordIndex::erase
+
+    void KeywordIndex::clear()
+    {
+        files_.clear();
+        pathMap_.clear();
+        keywords_.clear();
+    }
+
+    int KeywordIndex::load(const std::string& path)
+    {
+        FileIo io(path);
+        if (io.open() != 0) return -1;
+        DataBuf buf = io.read(io.size());
+        if (io.error() || buf.size_ != io.size()) return 1;
+        io.close();
+
+        const byte* p = buf.pData_;
+        const byte* end = buf.pData_ + buf.size_;
+        uint32_t version = 0;
+        uint32_t n = 0;
+        if (   end - p < 8 || memcmp(p, indexMagic, 8) != 0) return 1;
+        p += 8;
+        if (   !readULong(p, end, version) || version != indexVersion
+            || !readULong(p, end, n)) return 1;
+
+        KeywordIndex index;
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t len = 0;
+            uint32_t count = 0;
+            std::string filePath;
+            if (   !readULong(p, end, len)
+                || !readString(p, end, len, filePath)
+                || !readULong(p, end, count)) return 1;
+            std::vector<std::string> keywords;
+            for (uint32_t k = 0; k < count; ++k) {
+                std::string keyword;
+                if (   !readULong(p, end, len)
+                    || !readString(p, end, len, keyword)) return 1;
+                keywords.push_back(keyword);
+            }
+            // Erased files keep their number
+            if (filePath.empty()) {
+                index.files_.push_back(File());
+            }
+            else {
+                index.setKeywords(filePath, keywords);
+            }
+        }
+        files_.swap(index.files_);
+        pathMap_.swap(index.pathMap_);
+        keywords_.swap(index.keywords_);
+        return 0;
+    } // KeywordIndex::load
+
+    int KeywordIndex::save(const std::string& path) const
+    {
+        std::string buf(indexMagic, 8);
+        putULong(buf, indexVersion);
+        putULong(buf, static_cast<uint32_t>(files_.size()));
+        std::vector<File>::const_iterator end = files_.end();
+        for (std::vector<File>::const_iterator i = files_.begin(); i != end; ++i) {
+            putULong(buf, static_cast<uint32_t>(i->path_.size()));
+            buf += i->path_;
+            putULong(buf, static_cast<uint32_t>(i->keywords_.size()));
+            for (std::vector<std::string>::const_iterator k = i->keywords_.begin();
+                 k != i->keywords_.end(); ++k) {
+                putULong(buf, static_cast<uint32_t>(k->size()));
+                buf += *k;
+            }
+        }
+
+        // Write a new file and replace the old one with it
+        const std::string tmpPath = path + ".tmp";
+        FileIo io(tmpPath);
+        if (   io.open("wb") != 0
+            || io.write(reinterpret_cast<const byte*>(buf.data()),
+                        static_cast<long>(buf.size()))
+               != static_cast<long>(buf.size())
+            || io.close() != 0
+            || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            return 4;
+        }
+        return 0;
+    } // KeywordIndex::save
+
+    const KeywordIndex::Postings& KeywordIndex::find(
+        const std::string& keyword) const
+    {
+        static const Postings none;
+        Keywords::const_iterator pos = keywords_.find(normalize(keyword));
+        return pos == keywords_.end() ? none : pos->second.files_;
+    }
+
+    void KeywordIndex::findAll(const std::vector<std::string>& keywords,
+                               Postings& result) const
+    {
+        result.clear();
+        std::vector<const Postings*> lists;
+        for (std::vector<std::string>::const_iterator i = keywords.begin();
+             i != keywords.end(); ++i) {
+            const Postings& postings = find(*i);
+            if (postings.empty()) return;
+            lists.push_back(&postings);
+        }
+        if (lists.empty()) return;
+
+        // Intersect the shortest lists first to keep the result small
+        std::sort(lists.begin(), lists.end(), shorter);
+        result = *lists[0];
+        Postings tmp;
+        for (std::vector<const Postings*>::size_type i = 1;
+             i < lists.size() && !result.empty(); ++i) {
+            tmp.clear();
+            std::set_intersection(result.begin(), result.end(),
+                                  lists[i]->begin(), lists[i]->end(),
+                                  std::back_inserter(tmp));
+            result.swap(tmp);
+        }
+    } // KeywordIndex::findAll
+
+    void KeywordIndex::findAny(const std::vector<std::string>& keywords,
+                               Postings& result) const
+    {
+        result.clear();
+        Postings tmp;
+        for (std::vector<std::string>::const_iterator i = keywords.begin();
+             i != keywords.end(); ++i) {
+            const Postings& postings = find(*i);
+            tmp.clear();
+            std::set_union(result.begin(), result.end(),
+                           postings.begin(), postings.end(),
+                           std::back_inserter(tmp));
+            result.swap(tmp);
+        }
+    } // KeywordIndex::findAny
+
+    void KeywordIndex::complete(const std::string& prefix,
+                                std::vector<std::string>& keywords,
+                                long max) const
+    {
+        keywords.clear();
+        const std::string key = normalize(prefix);
+        Keywords::const_iterator end = keywords_.end();
+        for (Keywords::const_iterator i = keywords_.lower_bound(key);
+             i != end && i->first.compare(0, key.size(), key) == 0; ++i) {
+            if (max != 0 && static_cast<long>(keywords.size()) == max) break;
+            keywords.push_back(i->second.name_);
+        }
+    } // KeywordIndex::complete
+
+    const std::string& KeywordIndex::path(uint32_t fileNo) const
+    {
+        static const std::string none;
+        return fileNo < files_.size() ? files_[fileNo].path_ : none;
+    }
+
+    std::string KeywordIndex::normalize(const std::string& keyword)
+    {
+        std::string::size_type b = keyword.find_first_not_of(" \t\r\n");
+        if (b == std::string::npos) return "";
+        std::string::size_type e = keyword.find_last_not_of(" \t\r\n");
+        std::string key(keyword, b, e - b + 1);
+        for (std::string::iterator i = key.begin(); i != key.end(); ++i) {
+            if (static_cast<unsigned char>(*i) < 0x80) {
+                *i = static_cast<char>(std::tolower(*i));
+            }
+        }
+        return key;
+    } // KeywordIndex::normalize
+
+    void KeywordIndex::setKeywords(const std::string& path,
+                                   const std::vector<std::string>& keywords)
+    {
+        std::map<std::string, uint32_t>::iterator pos = pathMap_.find(path);
+        uint32_t fileNo = 0;
+        if (pos == pathMap_.end()) {
+            fileNo = static_cast<uint32_t>(files_.size());
+            files_.push_back(File());
+            files_.back().path_ = path;
+            pathMap_[path] = fileNo;
+        }
+        else {
+            fileNo = pos->second;
+            post(fileNo, false);
+        }
+        files_[fileNo].keywords_ = keywords;
+        post(fileNo, true);
+    } // KeywordIndex::setKeywords
+
+    void KeywordIndex::post(uint32_t fileNo, bool add)
+    {
+        const std::vector<std::string>& keywords = files_[fileNo].keywords_;
+        for (std::vector<std::string>::const_iterator i = keywords.begin();
+             i != keywords.end(); ++i) {
+            const std::string key = normalize(*i);
+            if (key.empty()) continue;
+            if (add) {
+                Keyword& keyword = keywords_[key];
+                if (keyword.name_.empty()) keyword.name_ = *i;
+                // New files have the largest number, they are appended
+                Postings& files = keyword.files_;
+                Postings::iterator p = std::lower_bound(files.begin(),
+                                                        files.end(), fileNo);
+                if (p == files.end() || *p != fileNo) files.insert(p, fileNo);
+            }
+            else {
+                Keywords::iterator keyword = keywords_.find(key);
+                if (keyword == keywords_.end()) continue;
+                Postings& files = keyword->second.files_;
+                Postings::iterator p = std::lower_bound(files.begin(),
+                                                        files.end(), fileNo);
+                if (p != files.end() && *p == fileNo) files.erase(p);
+                if (files.empty()) keywords_.erase(keyword);
+            }
+        }
+    } // KeywordIndex::post
+
+}                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    void putULong(std::string& buf, uint32_t l)
+    {
+        byte b[4];
+        ul2Data(b, l, littleEndian);
+        buf.append(reinterpret_cast<const char*>(b), 4);
+    }
+
+    bool readULong(const byte*& p, const byte* end, uint32_t& l)
+    {
+        if (end - p < 4) return false;
+        l = getULong(p, littleEndian);
+        p += 4;
+        return true;
+    }
+
+    bool readString(const byte*& p, const byte* end, uint32_t len,
+                    std::string& s)
+    {
+        if (static_cast<uint32_t>(end - p) < len) return false;
+        s.assign(reinterpret_cast<const char*>(p), len);
+        p += len;
+        return true;
+    }
+
+    bool shorter(const KeywordIndex::Postings* lhs,
+                 const KeywordIndex::Postings* rhs)
+    {
+        return lhs->size() < rhs->size();
+    }
+
+}
@@ -0,0 +1,172 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    keywordindex.hpp
+  @brief   Index of the image files by their Iptc keywords
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef KEYWORDINDEX_HPP_
+#define KEYWORDINDEX_HPP_
+
+// *****************************************************************************
+// included header files
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+#include <map>
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class declarations
+    class IptcData;
+
+// *****************************************************************************
+// class definitions
+
+    /*!
+      @brief An inverted index of the Iptc keywords (Iptc.Application2.Keywords)
+             of image files.
+
+      Each file in the index has a number, which stays the same until the
+      index is cleared. The index maps each keyword to the sorted list of
+      the numbers of the files which have it (its postings). Keywords are
+      compared case insensitively (ASCII only) and without leading and
+      trailing white space; the spelling of the keyword that was seen
+      first is kept for completion.
+
+      The index is updated per file, from the file or from its Iptc data,
+      and can be saved to and loaded from a file.
+     */
+    class KeywordIndex {
+    public:
+        //! Sorted list of file numbers
+        typedef std::vector<uint32_t> Postings;
+
+        //! @name Creators
+        //@{
+        //! Default constructor
+        KeywordIndex() {}
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Set the keywords of file \em path to those of its Iptc data,
+                 read from the file. A file without Iptc data has no keywords.
+          @return 0 if successful;<BR>
+                  the return code of IptcData::read() if the Iptc data can
+                    not be read
+         */
+        int update(const std::string& path);
+        /*!
+          @brief Set the keywords of file \em path to those in \em iptcData.
+         */
+        void update(const std::string& path, const IptcData& iptcData);
+        /*!
+          @brief Write \em iptcData to file \em path with IptcData::write()
+                 and update the keywords of the file if successful.
+          @return The return code of IptcData::write()
+         */
+        int write(const std::string& path, IptcData& iptcData);
+        //! Remove file \em path from the index.
+        void erase(const std::string& path);
+        //! Remove all files from the index.
+        void clear();
+        /*!
+          @brief Replace the index with the one saved to file \em path.
+          @return 0 if successful;<BR>
+                 -1 if the file can not be opened;<BR>
+                  1 if the file can not be read or is not an index;<BR>
+         */
+        int load(const std::string& path);
+        //@}
+
+        //! @name Accessors
+        //@{
+        /*!
+          @brief Save the index to file \em path, replacing it.
+          @return 0 if successful;<BR>
+                  4 if writing the file failed;<BR>
+         */
+        int save(const std::string& path) const;
+        //! Return the files with \em keyword
+        const Postings& find(const std::string& keyword) const;
+        //! Set \em result to the files with all of the \em keywords
+        void findAll(const std::vector<std::string>& keywords,
+                     Postings& result) const;
+        //! Set \em result to the files with any of the \em keywords
+        void findAny(const std::vector<std::string>& keywords,
+                     Postings& result) const;
+        /*!
+          @brief Set \em keywords to the keywords starting with \em prefix,
+                 in order, at most \em max of them if max is not 0.
+         */
+        void complete(const std::string& prefix,
+                      std::vector<std::string>& keywords,
+                      long max =0) const;
+        //! Return the path of file number \em fileNo, empty if it is erased.
+        const std::string& path(uint32_t fileNo) const;
+        //! Return the number of files in the index
+        long count() const { return static_cast<long>(pathMap_.size()); }
+        //! Return the normalized form of \em keyword, which is compared
+        static std::string normalize(const std::string& keyword);
+        //@}
+
+    private:
+        //! A keyword with its first spelling and the files which have it
+        struct Keyword {
+            std::string name_;                  //!< Spelling
+            Postings files_;                    //!< Files with the keyword
+        };
+        //! A file and its keywords
+        struct File {
+            std::string path_;                  //!< Path, empty if erased
+            std::vector<std::string> keywords_; //!< Keywords as spelled
+        };
+        //! Keywords by their normalized form
+        typedef std::map<std::string, Keyword> Keywords;
+
+        //! @name Manipulators
+        //@{
+        //! Set the keywords of file \em path
+        void setKeywords(const std::string& path,
+                         const std::vector<std::string>& keywords);
+        //! Add or remove file \em fileNo to the postings of its keywords
+        void post(uint32_t fileNo, bool add);
+        //@}
+
+        // DATA
+        std::vector<File> files_;               //!< Files by number
+        std::map<std::string, uint32_t> pathMap_; //!< File numbers by path
+        Keywords keywords_;                     //!< The inverted index
+
+    }; // class KeywordIndex
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef KEYWORDINDEX_HPP_
@@ -46,13 +46,35 @@ EXIV2_RCSID("@(#) $Id: makernote.cpp 410 2004-11-24 12:27:21Z ahuggel $");
 # include <iostream>
 #endif
 #include <cassert>
+#include <cctype>
+#ifndef _MSC_VER
+# include <pthread.h>
+#endif
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    // Return a copy of str converted to upper case
+    std::string upper(const std::string& str);
+    // Lock and unlock the cache of the MakerNoteFactory
+    void lockCache();
+    void unlockCache();
+
+#ifndef _MSC_VER
+    // Protects the cache of the MakerNoteFactory
+    pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+}
 
 // *****************************************************************************
 // class member definitions
 namespace Exiv2 {
 
-    MakerNote::MakerNote(const MnTagInfo* pMnTagInfo, bool alloc) 
-        : pMnTagInfo_(pMnTagInfo), alloc_(alloc),
+    MakerNote::MakerNote(const MnTagInfo* pMnTagInfo, bool alloc,
+                         const TagIndex* pMnTagIndex) 
+        : pMnTagInfo_(pMnTagInfo), pMnTagIndex_(pMnTagIndex), alloc_(alloc),
           offset_(0), byteOrder_(invalidByteOrder)
     {
     }
@@ -65,14 +87,8 @@ namespace Exiv2 {
     std::string MakerNote::tagName(uint16_t tag) const
     {
         std::string tagName;
-        if (pMnTagInfo_) {
-            for (int i = 0; pMnTagInfo_[i].tag_ != 0xffff; ++i) {
-                if (pMnTagInfo_[i].tag_ == tag) {
-                    tagName = pMnTagInfo_[i].name_;
-                    break;
-                }
-            }
-        }
+        int idx = tagInfoIdx(tag);
+        if (idx != -1) tagName = pMnTagInfo_[idx].name_;
         if (tagName.empty()) {
             std::ostringstream os;
             os << "0x" << std::setw(4) << std::setfill('0') << std::right
@@ -85,14 +101,8 @@ namespace Exiv2 {
     uint16_t MakerNote::tag(const std::string& tagName) const
     {
         uint16_t tag = 0xffff;
-        if (pMnTagInfo_) {
-            for (int i = 0; pMnTagInfo_[i].tag_ != 0xffff; ++i) {
-                if (pMnTagInfo_[i].name_ == tagName) {
-                    tag = pMnTagInfo_[i].tag_;
-                    break;
-                }
-            }
-        }
+        int idx = tagInfoIdx(tagName);
+        if (idx != -1) tag = pMnTagInfo_[idx].tag_;
         if (tag == 0xffff) {
             std::istringstream is(tagName);
             is >> std::hex >> tag;
@@ -103,16 +113,32 @@ namespace Exiv2 {
     std::string MakerNote::tagDesc(uint16_t tag) const
     {
         std::string tagDesc;
+        int idx = tagInfoIdx(tag);
+        if (idx != -1) tagDesc = pMnTagInfo_[idx].desc_;
+        return tagDesc;
+    } // MakerNote::tagDesc
+
+    int MakerNote::tagInfoIdx(uint16_t tag) const
+    {
+        if (pMnTagIndex_) return pMnTagIndex_->find(tag);
         if (pMnTagInfo_) {
             for (int i = 0; pMnTagInfo_[i].tag_ != 0xffff; ++i) {
-                if (pMnTagInfo_[i].tag_ == tag) {
-                    tagDesc = pMnTagInfo_[i].desc_;
-                    break;
-                }
+                if (pMnTagInfo_[i].tag_ == tag) return i;
             }
         }
-        return tagDesc;
-    } // MakerNote::tagDesc
+        return -1;
+    } // MakerNote::tagInfoIdx
+
+    int MakerNote::tagInfoIdx(const std::string& tagName) const
+    {
+        if (pMnTagIndex_) return pMnTagIndex_->find(tagName);
+        if (pMnTagInfo_) {
+            for (int i = 0; pMnTagInfo_[i].tag_ != 0xffff; ++i) {
+                if (pMnTagInfo_[i].name_ == tagName) return i;
+            }
+        }
+        return -1;
+    } // MakerNote::tagInfoIdx
 
     void MakerNote::taglist(std::ostream& os) const
     {
@@ -136,8 +162,9 @@ namespace Exiv2 {
     } // MakerNote::writeMnTagInfo
 
     IfdMakerNote::IfdMakerNote(const MakerNote::MnTagInfo* pMnTagInfo,
-                               bool alloc)
-        : MakerNote(pMnTagInfo, alloc),
+                               bool alloc,
+                               const TagIndex* pMnTagIndex)
+        : MakerNote(pMnTagInfo, alloc, pMnTagIndex),
           absOffset_(true), adjOffset_(0), ifd_(makerIfdId, 0, alloc)
     {
     }
@@ -265,6 +292,13 @@ namespace Exiv2 {
         return i->second->clone(alloc);
     } // MakerNoteFactory::create
 
+    const MakerNote* MakerNoteFactory::prototype(const std::string& ifdItem) const
+    {
+        IfdItemRegistry::const_iterator i = ifdItemRegistry_.find(ifdItem);
+        if (i == ifdItemRegistry_.end()) return 0;
+        return i->second;
+    } // MakerNoteFactory::prototype
+
     void MakerNoteFactory::registerMakerNote(const std::string& make, 
                                              const std::string& model, 
                                              CreateFct createMakerNote)
@@ -274,34 +308,42 @@ namespace Exiv2 {
                   << make << "\" and \"" << model << "\".\n";
 #endif
 
-        // Todo: use case insensitive make and model comparisons
+        // Registry entries are stored in upper case for case insensitive
+        // comparisons
+        const std::string uMake = upper(make);
+        const std::string uModel = upper(model);
 
         // Find or create a registry entry for make
         ModelRegistry* pModelRegistry = 0;
         Registry::const_iterator end1 = registry_.end();
         Registry::const_iterator pos1;
         for (pos1 = registry_.begin(); pos1 != end1; ++pos1) {
-            if (pos1->first == make) break;
+            if (pos1->first == uMake) break;
         }
         if (pos1 != end1) {
             pModelRegistry = pos1->second;
         }
         else {
             pModelRegistry = new ModelRegistry;
-            registry_.push_back(std::make_pair(make, pModelRegistry));
+            registry_.push_back(std::make_pair(uMake, pModelRegistry));
         }
         // Find or create a registry entry for model
         ModelRegistry::iterator end2 = pModelRegistry->end();
         ModelRegistry::iterator pos2;
         for (pos2 = pModelRegistry->begin(); pos2 != end2; ++pos2) {
-            if (pos2->first == model) break;
+            if (pos2->first == uModel) break;
         }
         if (pos2 != end2) {
             pos2->second = createMakerNote;
         }
         else {
-            pModelRegistry->push_back(std::make_pair(model, createMakerNote));
+            pModelRegistry->push_back(std::make_pair(uModel, createMakerNote));
         }
+
+        // The best matches may have changed
+        lockCache();
+        cache_.clear();
+        unlockCache();
     } // MakerNoteFactory::registerMakerNote
 
     MakerNote::AutoPtr MakerNoteFactory::create(const std::string& make, 
@@ -317,6 +359,31 @@ namespace Exiv2 {
                   << make << "\", \"" << model << "\", "
                   << (alloc == true ? "true" : "false") << ")\n";
 #endif
+        // The same make and model strings are looked up again and again
+        const CacheKey cacheKey(make, model);
+        lockCache();
+        CreateFctCache::const_iterator pos = cache_.find(cacheKey);
+        bool cached = pos != cache_.end();
+        CreateFct createMakerNote = cached ? pos->second : 0;
+        unlockCache();
+
+        if (!cached) {
+            createMakerNote = findCreateFct(make, model);
+            lockCache();
+            cache_[cacheKey] = createMakerNote;
+            unlockCache();
+        }
+        if (createMakerNote == 0) return MakerNote::AutoPtr(0);
+
+        return createMakerNote(alloc, buf, len, byteOrder, offset);
+    } // MakerNoteFactory::create
+
+    CreateFct MakerNoteFactory::findCreateFct(const std::string& make, 
+                                              const std::string& model) const
+    {
+        const std::string uMake = upper(make);
+        const std::string uModel = upper(model);
+
         // loop through each make of the registry to find the best matching make
         int score = 0;
         ModelRegistry* pModelRegistry = 0;
@@ -327,7 +394,7 @@ namespace Exiv2 {
         Registry::const_iterator end1 = registry_.end();
         Registry::const_iterator pos1;
         for (pos1 = registry_.begin(); pos1 != end1; ++pos1) {
-            int rc = match(pos1->first, make);
+            int rc = matchUpper(pos1->first, uMake);
             if (rc > score) {
                 score = rc;
 #ifdef DEBUG_REGISTRY
@@ -336,7 +403,7 @@ namespace Exiv2 {
                 pModelRegistry = pos1->second;
             }
         }
-        if (pModelRegistry == 0) return MakerNote::AutoPtr(0);
+        if (pModelRegistry == 0) return 0;
 #ifdef DEBUG_REGISTRY
         std::cerr << "Best match is \"" << makeMatch << "\".\n";
 #endif
@@ -351,7 +418,7 @@ namespace Exiv2 {
         ModelRegistry::const_iterator end2 = pModelRegistry->end();
         ModelRegistry::const_iterator pos2;
         for (pos2 = pModelRegistry->begin(); pos2 != end2; ++pos2) {
-            int rc = match(pos2->first, model);
+            int rc = matchUpper(pos2->first, uModel);
             if (rc > score) {
                 score = rc;
 #ifdef DEBUG_REGISTRY
@@ -360,34 +427,36 @@ namespace Exiv2 {
                 createMakerNote = pos2->second;
             }
         }
-        if (createMakerNote == 0) return MakerNote::AutoPtr(0);
 #ifdef DEBUG_REGISTRY
-        std::cerr << "Best match is \"" << modelMatch << "\".\n";
+        if (createMakerNote != 0) {
+            std::cerr << "Best match is \"" << modelMatch << "\".\n";
+        }
 #endif
-
-        return createMakerNote(alloc, buf, len, byteOrder, offset);
-    } // MakerNoteFactory::create
+        return createMakerNote;
+    } // MakerNoteFactory::findCreateFct
 
     int MakerNoteFactory::match(const std::string& regEntry,
                                 const std::string& key)
     {
+        return matchUpper(upper(regEntry), upper(key));
+    } // MakerNoteFactory::match
+
+    int MakerNoteFactory::matchUpper(const std::string& uReg,
+                                     const std::string& uKey)
+    {
 #ifdef DEBUG_REGISTRY
-        std::cerr << "   Matching registry entry \"" << regEntry << "\" (" 
-                  << (int)regEntry.size() << ") with key \"" << key << "\" ("
-                  << (int)key.size() << "): ";
+        std::cerr << "   Matching registry entry \"" << uReg << "\" (" 
+                  << (int)uReg.size() << ") with key \"" << uKey << "\" ("
+                  << (int)uKey.size() << "): ";
 #endif
-        // Todo: make the comparisons case insensitive
-
         // Handle exact match (this is only necessary because of the different
         // return value - the following algorithm also finds exact matches)
-        if (regEntry == key) {
+        if (uReg == uKey) {
 #ifdef DEBUG_REGISTRY
-            std::cerr << "Exact match (score: " << (int)key.size() + 2 << ")\n";
+            std::cerr << "Exact match (score: " << (int)uKey.size() + 2 << ")\n";
 #endif
-            return static_cast<int>(key.size()) + 2;
+            return static_cast<int>(uKey.size()) + 2;
         }
-        std::string uKey = key;
-        std::string uReg = regEntry;
 
         int count = 0;                          // number of matching characters
         std::string::size_type ei = 0;          // index in the registry entry
@@ -465,6 +534,36 @@ namespace Exiv2 {
 #endif
         return count + 1;
         
-    } // MakerNoteFactory::match
+    } // MakerNoteFactory::matchUpper
 
 }                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    std::string upper(const std::string& str)
+    {
+        std::string result(str);
+        for (std::string::size_type i = 0; i < result.size(); ++i) {
+            result[i] = static_cast<char>(
+                std::toupper(static_cast<unsigned char>(result[i])));
+        }
+        return result;
+    }
+
+    void lockCache()
+    {
+#ifndef _MSC_VER
+        pthread_mutex_lock(&cacheMutex);
+#endif
+    }
+
+    void unlockCache()
+    {
+#ifndef _MSC_VER
+        pthread_mutex_unlock(&cacheMutex);
+#endif
+    }
+
+}
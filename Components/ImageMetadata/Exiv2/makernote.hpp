@@ -120,9 +120,11 @@ namespace Exiv2 {
         /*!
           @brief Constructor. Takes an optional makernote info tag array and
                  allows to choose whether or not memory management is required
-                 for the Entries.
+                 for the Entries. An optional index of the tag info array
+                 speeds up the lookup of tags and tag names.
          */
-        explicit MakerNote(const MnTagInfo* pMnTagInfo =0, bool alloc =true);
+        explicit MakerNote(const MnTagInfo* pMnTagInfo =0, bool alloc =true,
+                           const TagIndex* pMnTagIndex =0);
         //! Virtual destructor.
         virtual ~MakerNote() {}
         //@}
@@ -229,6 +231,8 @@ namespace Exiv2 {
         // DATA
         //! Pointer to an array of makernote tag infos
         const MnTagInfo* pMnTagInfo_;   
+        //! Index of the makernote tag infos, 0 if there is none
+        const TagIndex* pMnTagIndex_;
         /*!
           @brief Flag to control the memory management: <BR>
                  True:  requires memory allocation and deallocation, <BR>
@@ -247,6 +251,10 @@ namespace Exiv2 {
         ByteOrder byteOrder_;
 
     private:
+        //! Return the position of \em tag in the tag infos, -1 if not found
+        int tagInfoIdx(uint16_t tag) const;
+        //! Return the position of \em tagName in the tag infos, -1 if not found
+        int tagInfoIdx(const std::string& tagName) const;
         //! Internal virtual copy constructor.
         virtual MakerNote* clone_(bool alloc =true) const =0;
 
@@ -273,10 +281,12 @@ namespace Exiv2 {
         /*!
           @brief Constructor. Takes an optional makernote info tag array and
                  allows to choose whether or not memory management is required
-                 for the Entries.
+                 for the Entries. An optional index of the tag info array
+                 speeds up the lookup of tags and tag names.
          */
         explicit IfdMakerNote(const MakerNote::MnTagInfo* pMnTagInfo =0, 
-                              bool alloc =true);
+                              bool alloc =true,
+                              const TagIndex* pMnTagIndex =0);
         //! Virtual destructor
         virtual ~IfdMakerNote() {}
         //@}
@@ -417,8 +427,7 @@ namespace Exiv2 {
 
           The method searches the make-model tree for a make and model
           combination in the registry that matches the search key. The search is
-          case insensitive (Todo: implement case-insensitive comparisons) and
-          wildcards in the registry entries are supported. First the best
+          case insensitive and wildcards in the registry entries are supported. First the best
           matching make is searched, then the best matching model for this make
           is searched. If there is no matching make or no matching model within
           the models registered for the best matching make, then no makernote
@@ -433,6 +442,11 @@ namespace Exiv2 {
           makernote required. This is used, e.g., to determine which of the
           three Nikon makernotes to create.
 
+          The create function found for a make and model is cached, so that
+          the search is done only once for the same make and model strings.
+          This method can be called from several threads at a time, but not
+          while a %MakerNote is registered.
+
           @param make Camera manufacturer. (Typically the string from the Exif
                  make tag.)
           @param model Camera model. (Typically the string from the Exif
@@ -463,6 +477,17 @@ namespace Exiv2 {
         //! Create a %MakerNote based on its IFD item string.
         MakerNote::AutoPtr create(const std::string& ifdItem, 
                                   bool alloc =true) const;
+        /*!
+          @brief Return the registered %MakerNote prototype for an IFD item
+                 string, 0 if there is none. 
+
+          The prototype is an empty %MakerNote, owned by the factory and
+          never modified. It can be shared to look up the tag names,
+          descriptions and print functions of the %MakerNote, e.g., by all
+          keys of %MakerNote tags, instead of creating a %MakerNote for
+          each of them.
+         */
+        const MakerNote* prototype(const std::string& ifdItem) const;
         //@}
 
         /*!
@@ -493,12 +518,31 @@ namespace Exiv2 {
         MakerNoteFactory(const MakerNoteFactory& rhs);
         //@}
 
+        //! @name Accessors
+        //@{
+        /*!
+          @brief Search the registry for the create function that best
+                 matches make and model, return 0 if there is none.
+         */
+        CreateFct findCreateFct(const std::string& make, 
+                                const std::string& model) const;
+        /*!
+          @brief Match a registry entry with a key like match(), both are 
+                 already in upper case.
+         */
+        static int matchUpper(const std::string& uReg, const std::string& uKey);
+        //@}
+
         //! Type used to store model labels and %MakerNote create functions
         typedef std::vector<std::pair<std::string, CreateFct> > ModelRegistry;
         //! Type used to store a list of make labels and model registries
         typedef std::vector<std::pair<std::string, ModelRegistry*> > Registry;
         //! Type used to store a list of IFD items and %MakerNote prototypes
         typedef std::map<std::string, MakerNote*> IfdItemRegistry;
+        //! Type of the key of the cache, a make and a model string
+        typedef std::pair<std::string, std::string> CacheKey;
+        //! Type used to cache the create functions found for make and model
+        typedef std::map<CacheKey, CreateFct> CreateFctCache;
 
         // DATA
         //! Pointer to the one and only instance of this class.
@@ -507,6 +551,8 @@ namespace Exiv2 {
         Registry registry_;
         //! List of makernote IfdItems and corresponding create functions.
         IfdItemRegistry ifdItemRegistry_;
+        //! Create functions found for make and model, 0 if there is none
+        mutable CreateFctCache cache_;
 
     }; // class MakerNoteFactory
    
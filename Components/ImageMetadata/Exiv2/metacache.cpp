@@ -0,0 +1,235 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      metacache.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#include "metacache.hpp"
+#include "exif.hpp"
+#include "iptc.hpp"
+#include "tags.hpp"
+#include "datasets.hpp"
+#include "value.hpp"
+#include "types.hpp"
+#include "error.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+#include <set>
+#include <cstring>
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    using namespace Exiv2;
+
+    /*
+      Encode the metadata to buf. The entry is a hash of the Exif keys,
+      the number of Exif metadata, each as key length (1 byte), key, type
+      (2) and size (4) of the value and the value, followed by the number
+      of Iptc metadata, each as record (2), dataset (2), type (2), size
+      (4) and value. Numbers and values are in little endian byte order.
+     */
+    void encode(DataBuf& buf, uint32_t keysHash,
+                const ExifData& exifData, const IptcData& iptcData);
+
+    // Decode an entry made by encode(), return false if it is broken
+    bool decode(const byte* buf, long len, uint32_t keysHash,
+                ExifData& exifData, IptcData& iptcData);
+
+    // Return the FNV-1a hash of size bytes at p, continuing from hash
+    uint32_t hashBytes(uint32_t hash, const void* p, long size);
+
+}
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    MetadataCache::MetadataCache(const std::string& path,
+                                 const std::vector<std::string>& exifKeys)
+        : PackCache(path), keysHash_(2166136261u)
+    {
+        // Normalize the keys, their order doesn't matter
+        std::set<std::string> keySet;
+        for (std::vector<std::string>::const_iterator i = exifKeys.begin();
+             i != exifKeys.end(); ++i) {
+            keySet.insert(ExifKey(*i).key());
+        }
+        for (std::set<std::string>::const_iterator i = keySet.begin();
+             i != keySet.end(); ++i) {
+            exifKeys_.push_back(*i);
+            keysHash_ = hashBytes(keysHash_, i->c_str(), i->size() + 1);
+        }
+    }
+
+    int MetadataCache::metadata(const std::string& path,
+                                ExifData& exifData,
+                                IptcData& iptcData)
+    {
+        FileId id;
+        if (fileId(path, id) != 0) return -1;
+        DataBuf buf;
+        if (   find(id, buf) == 0
+            && decode(buf.pData_, buf.size_, keysHash_, exifData, iptcData)) {
+            return 0;
+        }
+
+        ExifData exif;
+        IptcData iptc;
+        int rc = 0;
+        if (!exifKeys_.empty()) {
+            rc = exif.quickRead(path, exifKeys_);
+            if (rc == 3) rc = 0;
+        }
+        if (rc == 0) {
+            rc = iptc.read(path);
+            if (rc == 3) rc = 0;
+        }
+        if (rc) return rc;
+        // Don't add the metadata if the file changed while it was read
+        FileId after;
+        if (fileId(path, after) == 0 && after == id) {
+            encode(buf, keysHash_, exif, iptc);
+            add(id, buf.pData_, buf.size_);
+        }
+        exifData = exif;
+        iptcData = iptc;
+        return 0;
+    } // MetadataCache::metadata
+
+}                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    void encode(DataBuf& buf, uint32_t keysHash,
+                const ExifData& exifData, const IptcData& iptcData)
+    {
+        long size = 4 + 2 + 2;
+        ExifData::const_iterator e;
+        for (e = exifData.begin(); e != exifData.end(); ++e) {
+            size += 1 + static_cast<long>(e->key().size()) + 2 + 4 + e->size();
+        }
+        IptcData::const_iterator i;
+        for (i = iptcData.begin(); i != iptcData.end(); ++i) {
+            size += 2 + 2 + 2 + 4 + i->size();
+        }
+
+        DataBuf tmp(size);
+        byte* p = tmp.pData_;
+        p += ul2Data(p, keysHash, littleEndian);
+        p += us2Data(p, static_cast<uint16_t>(exifData.count()), littleEndian);
+        for (e = exifData.begin(); e != exifData.end(); ++e) {
+            const std::string key = e->key();
+            *p++ = static_cast<byte>(key.size());
+            memcpy(p, key.data(), key.size());
+            p += key.size();
+            p += us2Data(p, static_cast<uint16_t>(e->typeId()), littleEndian);
+            p += ul2Data(p, static_cast<uint32_t>(e->size()), littleEndian);
+            p += e->copy(p, littleEndian);
+        }
+        p += us2Data(p, static_cast<uint16_t>(iptcData.count()), littleEndian);
+        for (i = iptcData.begin(); i != iptcData.end(); ++i) {
+            p += us2Data(p, i->record(), littleEndian);
+            p += us2Data(p, i->tag(), littleEndian);
+            p += us2Data(p, static_cast<uint16_t>(i->typeId()), littleEndian);
+            p += ul2Data(p, static_cast<uint32_t>(i->size()), littleEndian);
+            p += i->copy(p, littleEndian);
+        }
+        buf = tmp;
+    } // encode
+
+    bool decode(const byte* buf, long len, uint32_t keysHash,
+                ExifData& exifData, IptcData& iptcData)
+    {
+        // A broken entry must not throw, it is read again from the file
+        try {
+            const byte* p = buf;
+            const byte* end = buf + len;
+            if (   end - p < 6
+                || getULong(p, littleEndian) != keysHash) return false;
+            p += 4;
+
+            ExifData exif;
+            long n = getUShort(p, littleEndian);
+            p += 2;
+            for (long k = 0; k < n; ++k) {
+                if (end - p < 1 || end - p < 1 + *p + 6) return false;
+                const std::string key(reinterpret_cast<const char*>(p + 1), *p);
+                p += 1 + *p;
+                uint16_t type = getUShort(p, littleEndian);
+                long size = getULong(p + 2, littleEndian);
+                p += 6;
+                if (type >= lastTypeId || size < 0 || end - p < size) return false;
+                Value::AutoPtr value = Value::create(TypeId(type));
+                value->read(p, size, littleEndian);
+                exif.add(ExifKey(key), value.get());
+                p += size;
+            }
+
+            IptcData iptc;
+            if (end - p < 2) return false;
+            n = getUShort(p, littleEndian);
+            p += 2;
+            for (long k = 0; k < n; ++k) {
+                if (end - p < 10) return false;
+                uint16_t record = getUShort(p, littleEndian);
+                uint16_t dataset = getUShort(p + 2, littleEndian);
+                uint16_t type = getUShort(p + 4, littleEndian);
+                long size = getULong(p + 6, littleEndian);
+                p += 10;
+                if (type >= lastTypeId || size < 0 || end - p < size) return false;
+                Value::AutoPtr value = Value::create(TypeId(type));
+                value->read(p, size, littleEndian);
+                iptc.add(IptcKey(dataset, record), value.get());
+                p += size;
+            }
+            exifData = exif;
+            iptcData = iptc;
+            return true;
+        }
+        catch (const Error&) {
+            return false;
+        }
+    } // decode
+
+    uint32_t hashBytes(uint32_t hash, const void* p, long size)
+    {
+        const byte* b = static_cast<const byte*>(p);
+        for (long i = 0; i < size; ++i) {
+            hash = (hash ^ b[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+}
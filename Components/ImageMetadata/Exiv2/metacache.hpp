@@ -0,0 +1,107 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    metacache.hpp
+  @brief   Persistent cache of the parsed metadata of image files
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef METACACHE_HPP_
+#define METACACHE_HPP_
+
+// *****************************************************************************
+// included header files
+#include "types.hpp"
+#include "packcache.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class declarations
+    class ExifData;
+    class IptcData;
+
+// *****************************************************************************
+// class definitions
+
+    /*!
+      @brief A persistent cache of the metadata of image files: the Iptc
+             data and the Exif metadata with the keys given to the
+             constructor.
+
+      The metadata is kept in a compact form, each metadatum as its key
+      and value. A cache hit costs one stat() of the image file and one
+      read from the pack file; the image itself is not opened. The entries
+      of a pack file are only used for the same Exif keys they were made
+      with.
+     */
+    class MetadataCache : public PackCache {
+    public:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor. Does not open the pack file.
+          @param path Path of the pack file.
+          @param exifKeys Keys of the Exif metadata to cache, the same as
+                 for ExifData::quickRead().
+          @throw Error if a key is not a valid Exif key.
+         */
+        MetadataCache(const std::string& path,
+                      const std::vector<std::string>& exifKeys);
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Get the metadata of the image file \em path. If the cache
+                 does not have it, it is read with ExifData::quickRead() and
+                 IptcData::read() and added. An image without Exif or Iptc
+                 data gets empty metadata.
+          @param path Path of the image file
+          @param exifData Set to the Exif metadata with the keys of the cache
+          @param iptcData Set to the Iptc data
+          @return 0 if successful;<BR>
+                 -1 if the file can not be accessed;<BR>
+                  the return code of ExifData::quickRead() or
+                    IptcData::read() if the metadata can not be read
+         */
+        int metadata(const std::string& path,
+                     ExifData& exifData,
+                     IptcData& iptcData);
+        //@}
+
+    private:
+        // DATA
+        std::vector<std::string> exifKeys_;     //!< Keys of the Exif metadata
+        uint32_t keysHash_;                     //!< Hash of the keys
+
+    }; // class MetadataCache
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef METACACHE_HPP_
@@ -61,6 +61,55 @@ namespace Exiv2 {
         return os;
     }
 
+    void MetadataIndex::reset()
+    {
+        slots_.clear();
+        count_ = 0;
+        valid_ = true;
+    }
+
+    void MetadataIndex::add(uint32_t id, long pos)
+    {
+        if (!valid_) return;
+        // Keep the load factor below 1/2
+        if (2 * (count_ + 1) > static_cast<long>(slots_.size())) grow();
+        Slot& s = slots_[slot(id)];
+        if (s.pos_ != -1) return;
+        s.id_ = id;
+        s.pos_ = pos;
+        ++count_;
+    }
+
+    long MetadataIndex::find(uint32_t id) const
+    {
+        if (slots_.empty()) return -1;
+        return slots_[slot(id)].pos_;
+    }
+
+    long MetadataIndex::slot(uint32_t id) const
+    {
+        // Fibonacci hashing and linear probing, the size is a power of 2
+        const long mask = static_cast<long>(slots_.size()) - 1;
+        long i = static_cast<long>((id * 2654435761U) >> 8) & mask;
+        while (slots_[i].pos_ != -1 && slots_[i].id_ != id) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void MetadataIndex::grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        Slot empty;
+        empty.id_ = 0;
+        empty.pos_ = -1;
+        slots_.resize(old.empty() ? 32 : 2 * old.size(), empty);
+        for (std::vector<Slot>::size_type i = 0; i < old.size(); ++i) {
+            if (old[i].pos_ != -1) slots_[slot(old[i].id_)] = old[i];
+        }
+    } // MetadataIndex::grow
+
     bool cmpMetadataByTag(const Metadatum& lhs, const Metadatum& rhs)
     {
         return lhs.tag() < rhs.tag();
@@ -40,6 +40,7 @@
 
 // + standard includes
 #include <string>
+#include <vector>
 #include <memory>
 
 // *****************************************************************************
@@ -64,6 +65,22 @@ namespace Exiv2 {
         virtual ~Key() {}
         //@}
 
+        //! @name Memory management
+        //@{
+        //! Allocate a key on the heap
+        static void* operator new(std::size_t size)
+            { return Arena::newObject(size, 0); }
+        //! Allocate a key in arena \em pArena, or on the heap if it is 0
+        static void* operator new(std::size_t size, Arena* pArena)
+            { return Arena::newObject(size, pArena); }
+        //! Free a key, memory in an arena is released with the arena
+        static void operator delete(void* p)
+            { Arena::deleteObject(p); }
+        //! Free a key if its constructor throws
+        static void operator delete(void* p, Arena*)
+            { Arena::deleteObject(p); }
+        //@}
+
         //! @name Accessors
         //@{
         /*!
@@ -272,6 +289,66 @@ namespace Exiv2 {
         
     }; // class FindMetadatumByTag
 
+    /*!
+      @brief Hash index from the id of a metadatum, e.g., its IFD id and tag,
+             to the position of the first metadatum with this id in a
+             container. Used by ExifData and IptcData to find metadata by key
+             without comparing key strings.
+
+      The container keeps the index up to date when it adds metadata and
+      invalidates it when it erases or reorders metadata. An invalid index
+      is rebuilt by the container before the next lookup. The key of a
+      metadatum can also be changed through an iterator, which the container
+      does not notice, so it verifies the result of each lookup against the
+      metadata and rebuilds the index if it is out of date.
+     */
+    class MetadataIndex {
+    public:
+        //! @name Creators
+        //@{
+        //! Default constructor, creates an invalid index
+        MetadataIndex() : count_(0), valid_(false) {}
+        //@}
+
+        //! @name Manipulators
+        //@{
+        //! Remove all ids and mark the index valid (for an empty container)
+        void reset();
+        //! Mark the index invalid
+        void invalidate() { valid_ = false; }
+        /*!
+          @brief Add \em id at position \em pos, unless the id already has a
+                 position. Does nothing if the index is invalid.
+         */
+        void add(uint32_t id, long pos);
+        //@}
+
+        //! @name Accessors
+        //@{
+        //! Return true if the index is valid
+        bool valid() const { return valid_; }
+        //! Return the position of the first metadatum with \em id, -1 if none
+        long find(uint32_t id) const;
+        //@}
+
+    private:
+        //! An entry of the hash table, pos_ is -1 if the slot is empty
+        struct Slot {
+            uint32_t id_;
+            long pos_;
+        };
+        //! Return the slot for \em id, i.e., its slot or an empty one
+        long slot(uint32_t id) const;
+        //! Double the size of the hash table
+        void grow();
+
+        // DATA
+        std::vector<Slot> slots_;               //!< Hash table
+        long count_;                            //!< Number of ids
+        bool valid_;                            //!< Index is up to date
+
+    }; // class MetadataIndex
+
 
     /*!
       @brief Output operator for Metadatum types, printing the interpreted
@@ -72,8 +72,14 @@ namespace Exiv2 {
         MakerNote::MnTagInfo(0xffff, "(UnknownNikon1MnTag)", "Unknown Nikon1MakerNote tag")
     };
 
+    // Index of the Nikon1 MakerNote Tag Info
+    static const TagIndex nikon1MnTagIndex(nikon1MnTagInfo,
+                                           &MakerNote::MnTagInfo::tag_,
+                                           &MakerNote::MnTagInfo::name_);
+
     Nikon1MakerNote::Nikon1MakerNote(bool alloc)
-        : IfdMakerNote(nikon1MnTagInfo, alloc), ifdItem_("Nikon1")
+        : IfdMakerNote(nikon1MnTagInfo, alloc, &nikon1MnTagIndex),
+          ifdItem_("Nikon1")
     {
     }
 
@@ -204,8 +210,14 @@ namespace Exiv2 {
         MakerNote::MnTagInfo(0xffff, "(UnknownNikon2MnTag)", "Unknown Nikon2MakerNote tag")
     };
 
+    // Index of the Nikon2 MakerNote Tag Info
+    static const TagIndex nikon2MnTagIndex(nikon2MnTagInfo,
+                                           &MakerNote::MnTagInfo::tag_,
+                                           &MakerNote::MnTagInfo::name_);
+
     Nikon2MakerNote::Nikon2MakerNote(bool alloc)
-        : IfdMakerNote(nikon2MnTagInfo, alloc), ifdItem_("Nikon2")
+        : IfdMakerNote(nikon2MnTagInfo, alloc, &nikon2MnTagIndex),
+          ifdItem_("Nikon2")
     {
         byte buf[] = {
             'N', 'i', 'k', 'o', 'n', '\0', 0x00, 0x01
@@ -400,8 +412,14 @@ namespace Exiv2 {
         MakerNote::MnTagInfo(0xffff, "(UnknownNikon3MnTag)", "Unknown Nikon3MakerNote tag")
     };
 
+    // Index of the Nikon3 MakerNote Tag Info
+    static const TagIndex nikon3MnTagIndex(nikon3MnTagInfo,
+                                           &MakerNote::MnTagInfo::tag_,
+                                           &MakerNote::MnTagInfo::name_);
+
     Nikon3MakerNote::Nikon3MakerNote(bool alloc)
-        : IfdMakerNote(nikon3MnTagInfo, alloc), ifdItem_("Nikon3")
+        : IfdMakerNote(nikon3MnTagInfo, alloc, &nikon3MnTagIndex),
+          ifdItem_("Nikon3")
     {
         absOffset_ = false;
         byte buf[] = {
@@ -0,0 +1,437 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      packcache.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#include "packcache.hpp"
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>                               // for rename, remove
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _MSC_VER
+# include <fcntl.h>
+# include <unistd.h>                            // for pread, pwrite, close
+# include <sys/mman.h>                          // for mmap, munmap
+# include <sys/file.h>                          // for flock
+#endif
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    // Identifies a pack file, followed by the version of the format
+    const char packMagic[] = { 'E', 'x', 'v', '2', 'P', 'a', 'c', 'k' };
+    const uint32_t packVersion = 1;
+    // Smallest number of slots of the hash table
+    const uint32_t minSlots = 1024;
+    // Replaced entries may take this many bytes before compacting
+    const uint64_t maxDead = 1024 * 1024;
+
+    // Return the number of hash table slots for capacity entries
+    uint32_t slotsFor(long capacity);
+
+    // Return the hash of the device and inode of a file
+    uint64_t hashId(uint64_t dev, uint64_t ino);
+
+}
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    int fileId(const std::string& path, FileId& id)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return -1;
+        id.dev_ = st.st_dev;
+        id.ino_ = st.st_ino;
+        id.size_ = st.st_size;
+        id.mtime_ = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#if defined(__APPLE__)
+        id.mtime_ += st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+        id.mtime_ += st.st_mtim.tv_nsec;
+#endif
+        return 0;
+    } // fileId
+
+    /*
+      Header of the pack file. It is followed by the hash table with
+      slots_ Slots and the entries.
+     */
+    struct PackCache::Header {
+        char magic_[8];                         // packMagic
+        uint32_t version_;                      // packVersion
+        uint32_t slots_;                        // Size of the hash table
+        uint32_t count_;                        // Used slots
+        uint32_t reserved1_;
+        uint64_t end_;                          // End of the entries
+        uint64_t dead_;                         // Bytes of replaced ones
+        byte reserved2_[24];
+    };
+
+    /*
+      Slot of the hash table, the position of the entry of one image
+      file. Slots are never freed, the table uses linear probing.
+     */
+    struct PackCache::Slot {
+        uint64_t dev_;                          // FileId of the image
+        uint64_t ino_;
+        uint64_t size_;
+        int64_t mtime_;
+        uint64_t offset_;                       // Position of the entry
+        uint32_t length_;                       // Size of the entry
+        uint32_t used_;                         // 1 if the slot is used
+    };
+
+    PackCache::PackCache(const std::string& path)
+        : path_(path), fd_(-1), readOnly_(false),
+          pHeader_(0), pSlots_(0), mapSize_(0)
+    {
+    }
+
+    PackCache::~PackCache()
+    {
+        close();
+    }
+
+    int PackCache::open()
+    {
+        close();
+        return openFile();
+    }
+
+    void PackCache::close()
+    {
+        closeFile();
+    }
+
+#ifndef _MSC_VER
+    int PackCache::find(const FileId& id, DataBuf& buf)
+    {
+        if (lock(LOCK_SH) != 0) return -1;
+        int rc = 1;
+        const Slot* pSlot = findSlot(id);
+        if (   pSlot != 0 && pSlot->used_
+            && pSlot->size_ == id.size_ && pSlot->mtime_ == id.mtime_) {
+            if (pSlot->length_ == 0) {
+                DataBuf empty;
+                buf = empty;
+                rc = 0;
+            }
+            else {
+                DataBuf entry(pSlot->length_);
+                rc = pread(fd_, entry.pData_, entry.size_, pSlot->offset_)
+                     == entry.size_ ? 0 : -1;
+                if (rc == 0) buf = entry;
+            }
+        }
+        unlock();
+        return rc;
+    } // PackCache::find
+
+    int PackCache::add(const FileId& id, const byte* buf, long size)
+    {
+        if (readOnly_ || lock(LOCK_EX) != 0) return -1;
+        Slot* pSlot = findSlot(id);
+        if (   pSlot == 0
+            || (!pSlot->used_ && (pHeader_->count_ + 1) * 4 > pHeader_->slots_ * 3)) {
+            // Grow the hash table
+            int rc = compactLocked(2 * (pHeader_->count_ + 1));
+            if (rc) {
+                unlock();
+                return rc;
+            }
+            pSlot = findSlot(id);
+        }
+        // Append the entry, then update the slot
+        uint64_t offset = pHeader_->end_;
+        if (size > 0 && pwrite(fd_, buf, size, offset) != size) {
+            unlock();
+            return 4;
+        }
+        if (pSlot->used_) {
+            pHeader_->dead_ += pSlot->length_;
+        }
+        else {
+            pSlot->dev_ = id.dev_;
+            pSlot->ino_ = id.ino_;
+            ++pHeader_->count_;
+        }
+        pSlot->size_ = id.size_;
+        pSlot->mtime_ = id.mtime_;
+        pSlot->offset_ = offset;
+        pSlot->length_ = static_cast<uint32_t>(size);
+        pSlot->used_ = 1;
+        pHeader_->end_ += size;
+        // Remove the holes once they take half of the entries
+        if (   pHeader_->dead_ > maxDead
+            && pHeader_->dead_ * 2 > pHeader_->end_ - mapSize_) {
+            compactLocked(pHeader_->count_);
+        }
+        unlock();
+        return 0;
+    } // PackCache::add
+
+    int PackCache::compact(long capacity)
+    {
+        if (readOnly_ || lock(LOCK_EX) != 0) return -1;
+        if (capacity < static_cast<long>(pHeader_->count_)) {
+            capacity = pHeader_->count_;
+        }
+        int rc = compactLocked(capacity);
+        unlock();
+        return rc;
+    } // PackCache::compact
+
+    long PackCache::count() const
+    {
+        return pHeader_ == 0 ? 0 : static_cast<long>(pHeader_->count_);
+    }
+
+    int PackCache::openFile()
+    {
+        for (;;) {
+            readOnly_ = false;
+            fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0) {
+                readOnly_ = true;
+                fd_ = ::open(path_.c_str(), O_RDONLY);
+            }
+            if (fd_ < 0) return -1;
+            if (flock(fd_, readOnly_ ? LOCK_SH : LOCK_EX) != 0) {
+                closeFile();
+                return -1;
+            }
+            // Start over if the pack file was replaced in the meantime
+            struct stat st;
+            struct stat fst;
+            if (   stat(path_.c_str(), &st) == 0 && fstat(fd_, &fst) == 0
+                && st.st_dev == fst.st_dev && st.st_ino == fst.st_ino) break;
+            closeFile();
+        }
+
+        struct stat st;
+        Header header;
+        bool valid =    fstat(fd_, &st) == 0
+                     && pread(fd_, &header, sizeof(header), 0) == sizeof(header)
+                     && std::memcmp(header.magic_, packMagic, 8) == 0
+                     && header.version_ == packVersion
+                     && header.slots_ >= minSlots;
+        long mapSize = 0;
+        if (valid) {
+            mapSize = sizeof(Header) + header.slots_ * sizeof(Slot);
+            valid =    header.end_ >= static_cast<uint64_t>(mapSize)
+                    && header.end_ <= static_cast<uint64_t>(st.st_size);
+        }
+        if (!valid && !readOnly_) {
+            // New or broken pack file, initialize it
+            mapSize = sizeof(Header) + minSlots * sizeof(Slot);
+            std::memset(&header, 0x0, sizeof(header));
+            std::memcpy(header.magic_, packMagic, 8);
+            header.version_ = packVersion;
+            header.slots_ = minSlots;
+            header.end_ = mapSize;
+            valid =    ftruncate(fd_, 0) == 0 && ftruncate(fd_, mapSize) == 0
+                    && pwrite(fd_, &header, sizeof(header), 0) == sizeof(header);
+        }
+        if (!valid) {
+            closeFile();
+            return readOnly_ ? 2 : -1;
+        }
+
+        void* map = mmap(0, mapSize, readOnly_ ? PROT_READ : PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) {
+            closeFile();
+            return -1;
+        }
+        mapSize_ = mapSize;
+        pHeader_ = static_cast<Header*>(map);
+        pSlots_ = reinterpret_cast<Slot*>(pHeader_ + 1);
+        unlock();
+        return 0;
+    } // PackCache::openFile
+
+    void PackCache::closeFile()
+    {
+        if (pHeader_ != 0) munmap(pHeader_, mapSize_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        pHeader_ = 0;
+        pSlots_ = 0;
+        mapSize_ = 0;
+    }
+
+    int PackCache::lock(int op)
+    {
+        for (;;) {
+            if (fd_ < 0) return -1;
+            if (flock(fd_, op) != 0) return -1;
+            // Reopen the pack file if it was replaced by compaction
+            struct stat st;
+            struct stat fst;
+            if (   stat(path_.c_str(), &st) == 0 && fstat(fd_, &fst) == 0
+                && st.st_dev == fst.st_dev && st.st_ino == fst.st_ino) {
+                return 0;
+            }
+            closeFile();
+            int rc = openFile();
+            if (rc) return rc;
+        }
+    } // PackCache::lock
+
+    void PackCache::unlock()
+    {
+        if (fd_ >= 0) flock(fd_, LOCK_UN);
+    }
+
+    int PackCache::compactLocked(long capacity)
+    {
+        const uint32_t slots = slotsFor(capacity);
+        const long mapSize = sizeof(Header) + slots * sizeof(Slot);
+        std::vector<Slot> table(slots);
+        std::memset(&table[0], 0x0, slots * sizeof(Slot));
+
+        // The new pack file is locked before anybody else can open it
+        const std::string tmpPath = path_ + ".tmp";
+        int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return 4;
+        int rc = flock(fd, LOCK_EX) == 0 ? 0 : 4;
+
+        // Copy the entries and fill the new hash table
+        uint64_t end = mapSize;
+        DataBuf buf;
+        for (uint32_t i = 0; rc == 0 && i < pHeader_->slots_; ++i) {
+            const Slot& slot = pSlots_[i];
+            if (!slot.used_) continue;
+            const uint32_t mask = slots - 1;
+            uint32_t pos = static_cast<uint32_t>(hashId(slot.dev_, slot.ino_)) & mask;
+            while (table[pos].used_) pos = (pos + 1) & mask;
+            table[pos] = slot;
+            table[pos].offset_ = end;
+            if (slot.length_ == 0) continue;
+            buf.alloc(slot.length_);
+            if (pread(fd_, buf.pData_, slot.length_, slot.offset_) != slot.length_) {
+                rc = 1;
+            }
+            else if (pwrite(fd, buf.pData_, slot.length_, end) != slot.length_) {
+                rc = 4;
+            }
+            end += slot.length_;
+        }
+        Header header = *pHeader_;
+        header.slots_ = slots;
+        header.end_ = end;
+        header.dead_ = 0;
+        if (   rc == 0
+            && (   ftruncate(fd, end) != 0
+                || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)
+                || pwrite(fd, &table[0], slots * sizeof(Slot), sizeof(header))
+                   != static_cast<ssize_t>(slots * sizeof(Slot)))) {
+            rc = 4;
+        }
+        void* map = MAP_FAILED;
+        if (rc == 0) {
+            map = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) rc = 4;
+        }
+        if (rc == 0 && std::rename(tmpPath.c_str(), path_.c_str()) != 0) {
+            munmap(map, mapSize);
+            rc = 4;
+        }
+        if (rc) {
+            ::close(fd);
+            std::remove(tmpPath.c_str());
+            return rc;
+        }
+
+        // Switch to the new pack file, this releases the lock of the old one
+        closeFile();
+        fd_ = fd;
+        mapSize_ = mapSize;
+        pHeader_ = static_cast<Header*>(map);
+        pSlots_ = reinterpret_cast<Slot*>(pHeader_ + 1);
+        return 0;
+    } // PackCache::compactLocked
+
+    PackCache::Slot* PackCache::findSlot(const FileId& id) const
+    {
+        const uint32_t mask = pHeader_->slots_ - 1;
+        uint32_t pos = static_cast<uint32_t>(hashId(id.dev_, id.ino_)) & mask;
+        for (uint32_t i = 0; i < pHeader_->slots_; ++i) {
+            Slot* pSlot = pSlots_ + pos;
+            if (   !pSlot->used_
+                || (pSlot->dev_ == id.dev_ && pSlot->ino_ == id.ino_)) {
+                return pSlot;
+            }
+            pos = (pos + 1) & mask;
+        }
+        return 0;
+    } // PackCache::findSlot
+
+#else
+    // No memory mapped files and locks, the cache is never open
+    int PackCache::find(const FileId& id, DataBuf& buf) { return -1; }
+    int PackCache::add(const FileId& id, const byte* buf, long size) { return -1; }
+    int PackCache::compact(long capacity) { return -1; }
+    long PackCache::count() const { return 0; }
+    int PackCache::openFile() { return -1; }
+    void PackCache::closeFile() {}
+#endif // _MSC_VER
+
+}                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    uint32_t slotsFor(long capacity)
+    {
+        // Keep the hash table at most three quarters full
+        uint32_t slots = minSlots;
+        while (static_cast<uint64_t>(slots) * 3 < static_cast<uint64_t>(capacity) * 4) {
+            slots *= 2;
+        }
+        return slots;
+    }
+
+    uint64_t hashId(uint64_t dev, uint64_t ino)
+    {
+        uint64_t h = ino * 0x9e3779b97f4a7c15ULL ^ dev;
+        return h ^ (h >> 29);
+    }
+
+}
@@ -0,0 +1,200 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    packcache.hpp
+  @brief   Persistent cache of data about image files, kept in a pack file
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef PACKCACHE_HPP_
+#define PACKCACHE_HPP_
+
+// *****************************************************************************
+// included header files
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class definitions
+
+    /*!
+      @brief Identity of a version of a file: the device and inode of the
+             file and its size and modification time. A file which is
+             changed gets a new identity.
+     */
+    struct FileId {
+        //! Default constructor
+        FileId() : dev_(0), ino_(0), size_(0), mtime_(0) {}
+        //! Return true if \em rhs is the same version of the same file
+        bool operator==(const FileId& rhs) const
+        {
+            return    dev_ == rhs.dev_ && ino_ == rhs.ino_
+                   && size_ == rhs.size_ && mtime_ == rhs.mtime_;
+        }
+        uint64_t dev_;                          //!< Device of the file
+        uint64_t ino_;                          //!< Inode of the file
+        uint64_t size_;                         //!< Size in bytes
+        int64_t mtime_;                         //!< Modification time
+    };
+
+    /*!
+      @brief Get the identity of file \em path with stat(). Return 0 if
+             successful, -1 if the file can not be accessed.
+     */
+    int fileId(const std::string& path, FileId& id);
+
+    /*!
+      @brief A persistent cache of data about image files, kept in one
+             pack file. Each entry is a buffer which belongs to a version
+             of an image file, identified by its FileId.
+
+      The pack file starts with a hash table which indexes the entries
+      by the FileId of their image file, followed by the entries, which
+      are appended as they are added. The hash table is memory mapped, an
+      entry is read with one read. An entry that is replaced leaves a hole
+      in the pack file. The holes are removed and the hash table is grown
+      by writing a new pack file which replaces the old one.
+
+      Several processes can use the same pack file at the same time; the
+      file is locked for reading (shared) and writing (exclusive) and
+      reopened if it was replaced. The file is in the byte order of the
+      host. A %PackCache must not be used by several threads at the same
+      time, but each thread can use its own instance.
+     */
+    class PackCache {
+    public:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor. Does not open the pack file.
+          @param path Path of the pack file.
+         */
+        explicit PackCache(const std::string& path);
+        //! Virtual destructor, closes the pack file.
+        virtual ~PackCache();
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Open the pack file, create it if it does not exist. If the
+                 file can not be written, it is opened read-only and nothing
+                 can be added. A broken pack file is reinitialized.
+          @return 0 if successful;<BR>
+                 -1 if the pack file can not be opened or created;<BR>
+                  2 if the pack file is broken and can not be written;<BR>
+         */
+        int open();
+        //! Close the pack file.
+        void close();
+        /*!
+          @brief Look up the entry of the image file with identity \em id.
+                 The pack file is reopened if it was replaced.
+          @param id Identity of the image file
+          @param buf Set to a copy of the entry, empty if the entry is
+                 empty
+          @return 0 if successful;<BR>
+                 -1 if the cache is not open;<BR>
+                  1 if the cache does not have an entry for \em id;<BR>
+         */
+        int find(const FileId& id, DataBuf& buf);
+        /*!
+          @brief Add entry \em buf of size \em size for the image file with
+                 identity \em id, replacing the entry of an earlier version
+                 of the file. The entry may be empty.
+          @return 0 if successful;<BR>
+                 -1 if the cache is not open or read-only;<BR>
+                  4 if writing to the pack file failed;<BR>
+         */
+        int add(const FileId& id, const byte* buf, long size);
+        /*!
+          @brief Write a new pack file without the holes left by replaced
+                 entries, with room for at least \em capacity entries in
+                 the hash table. It replaces the old pack file.
+          @return 0 if successful;<BR>
+                 -1 if the cache is not open or read-only;<BR>
+                  1 if reading from the pack file failed;<BR>
+                  4 if writing the new pack file failed;<BR>
+         */
+        int compact(long capacity =0);
+        //@}
+
+        //! @name Accessors
+        //@{
+        //! Return the number of images in the cache.
+        long count() const;
+        //@}
+
+    private:
+        //! Header of the pack file
+        struct Header;
+        //! Entry of the hash table
+        struct Slot;
+
+        //! @name Manipulators
+        //@{
+        //! Open and map the pack file, initialize it if it is new
+        int openFile();
+        //! Unmap and close the pack file
+        void closeFile();
+        /*!
+          @brief Lock the pack file with \em op (LOCK_SH or LOCK_EX) and
+                 reopen it first if it was replaced. Return 0 if successful.
+         */
+        int lock(int op);
+        //! Unlock the pack file
+        void unlock();
+        //! Write a new, compacted pack file, the old one is locked
+        int compactLocked(long capacity);
+        //@}
+
+        //! @name Accessors
+        //@{
+        //! Return the slot of \em id or the empty slot to put it in
+        Slot* findSlot(const FileId& id) const;
+        //@}
+
+        // NOT Implemented
+        //! Copy constructor
+        PackCache(const PackCache& rhs);
+        //! Assignment operator
+        PackCache& operator=(const PackCache& rhs);
+
+        // DATA
+        std::string path_;                      //!< Path of the pack file
+        int fd_;                                //!< Pack file descriptor
+        bool readOnly_;                         //!< Opened read-only
+        Header* pHeader_;                       //!< Mapped header
+        Slot* pSlots_;                          //!< Mapped hash table
+        long mapSize_;                          //!< Size of the mapping
+
+    }; // class PackCache
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef PACKCACHE_HPP_
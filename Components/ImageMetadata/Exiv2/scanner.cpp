@@ -0,0 +1,339 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      scanner.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#include "scanner.hpp"
+#include "basicio.hpp"
+#include "image.hpp"
+#include "makernote.hpp"
+#include "error.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <exception>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _MSC_VER
+# include <dirent.h>
+# include <pthread.h>
+#endif
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    // Return the id of a tag in a group (IFD or record) to compare keys
+    uint32_t keyId(int group, uint16_t tag);
+
+    // Unary predicate that matches a metadatum whose id is not in ids
+    class IdNotIn {
+    public:
+        // Constructor, ids are the ids of the metadata to keep
+        IdNotIn(const std::set<uint32_t>& ids) : ids_(ids) {}
+        bool operator()(const Exiv2::Exifdatum& exifdatum) const
+            { return ids_.find(keyId(exifdatum.ifdId(),
+                                     exifdatum.tag())) == ids_.end(); }
+        bool operator()(const Exiv2::Iptcdatum& iptcdatum) const
+            { return ids_.find(keyId(iptcdatum.record(),
+                                     iptcdatum.tag())) == ids_.end(); }
+    private:
+        const std::set<uint32_t>& ids_;
+    };
+
+    // Erase all metadata with ids that are not in ids, in one pass
+    template<typename T>
+    void keepKeys(T& metadata, const std::set<uint32_t>& ids);
+
+}
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    struct MetadataScanner::State {
+        const MetadataScanner* scanner_;        // Scanner to scan for
+        Callback* callback_;                    // Receives the results
+        long next_;                             // Index of the next file
+        long done_;                             // Number of files done
+        int ioSlots_;                           // Reads that may start
+#ifndef _MSC_VER
+        pthread_mutex_t mutex_;                 // Protects next_, ioSlots_
+        pthread_cond_t ioFree_;                 // Signals a free I/O slot
+        pthread_mutex_t callbackMutex_;         // Serializes the callbacks
+#endif
+    };
+
+    MetadataScanner::MetadataScanner(int threads, int maxIo)
+        : threads_(threads > 0 ? threads : 1),
+          maxIo_(maxIo > 0 ? maxIo : 1)
+    {
+    }
+
+    void MetadataScanner::addKey(const std::string& key)
+    {
+        keys_.insert(key);
+        // Metadata is matched by the numbers of the key, so that the keys
+        // of the metadata are not created. A key which cannot be parsed
+        // matches no metadata.
+        try {
+            if (key.compare(0, 5, "Exif.") == 0) {
+                ExifKey exifKey(key);
+                exifIds_.insert(keyId(exifKey.ifdId(), exifKey.tag()));
+            }
+            if (key.compare(0, 5, "Iptc.") == 0) {
+                IptcKey iptcKey(key);
+                iptcIds_.insert(keyId(iptcKey.record(), iptcKey.tag()));
+            }
+        }
+        catch (const Error&) {
+        }
+    }
+
+    void MetadataScanner::addFile(const std::string& path)
+    {
+        files_.push_back(path);
+    }
+
+    int MetadataScanner::addDirectory(const std::string& path)
+    {
+#ifndef _MSC_VER
+        DIR* dir = opendir(path.c_str());
+        if (dir == 0) return -1;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != 0) {
+            // Skips ".", ".." and hidden files
+            if (entry->d_name[0] == '.') continue;
+            if (entry->d_type == DT_DIR) continue;
+            std::string file = path + "/" + entry->d_name;
+            // Some file systems, e.g. NFS, don't report the type
+            if (entry->d_type == DT_UNKNOWN) {
+                struct stat buf;
+                if (lstat(file.c_str(), &buf) == 0 && S_ISDIR(buf.st_mode)) {
+                    continue;
+                }
+            }
+            files_.push_back(file);
+        }
+        closedir(dir);
+        return 0;
+#else
+        return -1;
+#endif
+    } // MetadataScanner::addDirectory
+
+    long MetadataScanner::scan(Callback& callback) const
+    {
+        // Create the factories before any thread uses them
+        ImageFactory::instance();
+        MakerNoteFactory::instance();
+
+        State state;
+        state.scanner_ = this;
+        state.callback_ = &callback;
+        state.next_ = 0;
+        state.done_ = 0;
+        state.ioSlots_ = maxIo_;
+#ifndef _MSC_VER
+        pthread_mutex_init(&state.mutex_, 0);
+        pthread_cond_init(&state.ioFree_, 0);
+        pthread_mutex_init(&state.callbackMutex_, 0);
+
+        std::vector<pthread_t> threads;
+        for (int i = 0; i < threads_ && i < count(); ++i) {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, work, &state) == 0) {
+                threads.push_back(thread);
+            }
+        }
+        // Scan in the calling thread if no thread could be started
+        if (threads.empty()) work(&state);
+        for (std::vector<pthread_t>::size_type i = 0; i < threads.size(); ++i) {
+            pthread_join(threads[i], 0);
+        }
+
+        pthread_mutex_destroy(&state.callbackMutex_);
+        pthread_cond_destroy(&state.ioFree_);
+        pthread_mutex_destroy(&state.mutex_);
+#else
+        work(&state);
+#endif
+        return state.done_;
+    } // MetadataScanner::scan
+
+    void* MetadataScanner::work(void* arg)
+    {
+        State& state = *static_cast<State*>(arg);
+        const MetadataScanner& scanner = *state.scanner_;
+        for (;;) {
+            // Take the next file and wait until it may be read
+#ifndef _MSC_VER
+            pthread_mutex_lock(&state.mutex_);
+#endif
+            if (state.next_ >= scanner.count()) {
+#ifndef _MSC_VER
+                pthread_mutex_unlock(&state.mutex_);
+#endif
+                break;
+            }
+            ScanResult result;
+            result.path_ = scanner.files_[state.next_++];
+#ifndef _MSC_VER
+            while (state.ioSlots_ == 0) {
+                pthread_cond_wait(&state.ioFree_, &state.mutex_);
+            }
+            --state.ioSlots_;
+            pthread_mutex_unlock(&state.mutex_);
+#endif
+            Image::AutoPtr image = scanner.readImage(result.path_, result);
+#ifndef _MSC_VER
+            pthread_mutex_lock(&state.mutex_);
+            ++state.ioSlots_;
+            pthread_cond_signal(&state.ioFree_);
+            pthread_mutex_unlock(&state.mutex_);
+#endif
+            // Parsing the metadata does not need the disk
+            if (image.get() != 0) {
+                scanner.parseImage(*image, result);
+                image.reset();
+            }
+#ifndef _MSC_VER
+            pthread_mutex_lock(&state.callbackMutex_);
+#endif
+            ++state.done_;
+            state.callback_->scanned(result);
+#ifndef _MSC_VER
+            pthread_mutex_unlock(&state.callbackMutex_);
+#endif
+        }
+        return 0;
+    } // MetadataScanner::work
+
+    void MetadataScanner::scanFile(const std::string& path,
+                                   ScanResult& result) const
+    {
+        result.path_ = path;
+        Image::AutoPtr image = readImage(path, result);
+        if (image.get() != 0) parseImage(*image, result);
+    }
+
+    Image::AutoPtr MetadataScanner::readImage(const std::string& path,
+                                              ScanResult& result) const
+    {
+        Image::AutoPtr image;
+        try {
+            BasicIo::AutoPtr io(new MmapIo(path));
+            if (io->open() != 0) {
+                result.rc_ = -1;
+                return image;
+            }
+            image = ImageFactory::instance().open(io);
+            if (image.get() == 0) {
+                result.rc_ = -2;
+                return image;
+            }
+            // Only read the metadata types with requested keys
+            int mask = mdExif | mdIptc;
+            if (!keys_.empty()) {
+                mask = mdNone;
+                if (!exifIds_.empty()) mask |= mdExif;
+                if (!iptcIds_.empty()) mask |= mdIptc;
+            }
+            result.rc_ = image->readMetadata(mask);
+            if (result.rc_ != 0) image.reset();
+        }
+        catch (const Error& e) {
+            result.rc_ = -5;
+            result.error_ = e.message();
+            image.reset();
+        }
+        catch (const std::exception& e) {
+            result.rc_ = -6;
+            result.error_ = e.what();
+            image.reset();
+        }
+        return image;
+    } // MetadataScanner::readImage
+
+    void MetadataScanner::parseImage(const Image& image,
+                                     ScanResult& result) const
+    {
+        try {
+            if (   (keys_.empty() || !exifIds_.empty())
+                && image.sizeExifData() > 0) {
+                // The image is discarded before the result is passed on,
+                // so the data is copied; a borrowed buffer would dangle.
+                // Keys and values are still only created when used.
+                result.rc_ = result.exifData_.read(image.exifData(),
+                                                   image.sizeExifData());
+                if (result.rc_ != 0) return;
+                if (!keys_.empty()) keepKeys(result.exifData_, exifIds_);
+            }
+            if (   (keys_.empty() || !iptcIds_.empty())
+                && image.sizeIptcData() > 0) {
+                result.rc_ = result.iptcData_.read(image.iptcData(),
+                                                   image.sizeIptcData());
+                if (result.rc_ != 0) return;
+                if (!keys_.empty()) keepKeys(result.iptcData_, iptcIds_);
+            }
+        }
+        catch (const Error& e) {
+            result.rc_ = -5;
+            result.error_ = e.message();
+        }
+        catch (const std::exception& e) {
+            result.rc_ = -6;
+            result.error_ = e.what();
+        }
+    } // MetadataScanner::parseImage
+
+}                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    uint32_t keyId(int group, uint16_t tag)
+    {
+        return (static_cast<uint32_t>(group) << 16) | tag;
+    }
+
+    template<typename T>
+    void keepKeys(T& metadata, const std::set<uint32_t>& ids)
+    {
+        metadata.erase(std::remove_if(metadata.begin(), metadata.end(),
+                                      IdNotIn(ids)),
+                       metadata.end());
+    }
+
+}
@@ -0,0 +1,168 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    scanner.hpp
+  @brief   Read the metadata of many files using several threads
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef SCANNER_HPP_
+#define SCANNER_HPP_
+
+// *****************************************************************************
+// included header files
+#include "image.hpp"
+#include "exif.hpp"
+#include "iptc.hpp"
+
+// + standard includes
+#include <string>
+#include <vector>
+#include <set>
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class definitions
+
+    //! The metadata read from one file by a MetadataScanner
+    struct ScanResult {
+        //! Default constructor
+        ScanResult() : rc_(0) {}
+        std::string path_;                      //!< Path of the file
+        /*!
+          @brief 0 if successful;<BR>
+                 -1 if the file can not be opened;<BR>
+                 -2 if the file contains an unknown image type;<BR>
+                 -5 if an Error was thrown, see error_;<BR>
+                 -6 if another exception, e.g. std::bad_alloc, was thrown,
+                    see error_;<BR>
+                 the return code of Image::readMetadata(), ExifData::read()
+                 or IptcData::read() if one of them fails;<BR>
+         */
+        int rc_;
+        std::string error_;                     //!< Message of the exception
+        ExifData exifData_;                     //!< Requested Exif metadata
+        IptcData iptcData_;                     //!< Requested Iptc metadata
+    };
+
+    /*!
+      @brief Read the metadata of a list of files with a pool of threads.
+
+      Each thread takes the next file from the list as soon as it is done
+      with the previous one, so a slow file holds up one thread only. The
+      number of files read from disk at the same time is limited separately
+      from the number of threads, which parse the metadata once it is read.
+      Results are passed to a Callback in the order in which the files are
+      done. Only the metadata of the requested keys is kept.
+     */
+    class MetadataScanner {
+    public:
+        /*!
+          @brief Interface to receive the results of a scan.
+         */
+        class Callback {
+        public:
+            //! Virtual destructor.
+            virtual ~Callback() {}
+            /*!
+              @brief Called once for each file when it is done. Calls are
+                     made from the threads of the scanner, one at a time.
+                     Must not throw.
+             */
+            virtual void scanned(const ScanResult& result) =0;
+        };
+
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor.
+          @param threads Number of threads to use.
+          @param maxIo Maximum number of files read from disk at a time.
+         */
+        explicit MetadataScanner(int threads =4, int maxIo =2);
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Request the metadata with key \em key, e.g.,
+                 "Exif.Image.Model" or "Iptc.Application2.Keywords". If no
+                 keys are requested, all metadata is kept. If no Exif (Iptc)
+                 keys are requested, Exif (Iptc) data is not parsed at all.
+         */
+        void addKey(const std::string& key);
+        //! Add a file to the list of files to scan.
+        void addFile(const std::string& path);
+        /*!
+          @brief Add all files in directory \em path to the list of files
+                 to scan. Subdirectories and hidden files are skipped.
+          @return 0 if successful;<BR>
+                  -1 if the directory can not be read;<BR>
+         */
+        int addDirectory(const std::string& path);
+        //@}
+
+        //! @name Accessors
+        //@{
+        /*!
+          @brief Read the requested metadata of all files and pass the
+                 results to \em callback. Returns when all files are done.
+          @return Number of files scanned.
+         */
+        long scan(Callback& callback) const;
+        /*!
+          @brief Read the requested metadata of one file in the calling
+                 thread.
+         */
+        void scanFile(const std::string& path, ScanResult& result) const;
+        //! Return the number of files to scan
+        long count() const { return static_cast<long>(files_.size()); }
+        //@}
+
+    private:
+        //! Shared state of the threads of a scan
+        struct State;
+
+        //! Thread function, scans files until there are none left
+        static void* work(void* arg);
+        //! Open the image and read its metadata, 0 if that fails
+        Image::AutoPtr readImage(const std::string& path,
+                                 ScanResult& result) const;
+        //! Parse the requested metadata of an image
+        void parseImage(const Image& image, ScanResult& result) const;
+
+        // DATA
+        int threads_;                           //!< Number of threads
+        int maxIo_;                             //!< Concurrent reads
+        std::vector<std::string> files_;        //!< Files to scan
+        std::set<std::string> keys_;            //!< Requested keys
+        std::set<uint32_t> exifIds_;            //!< Exif keys as IFD id, tag
+        std::set<uint32_t> iptcIds_;            //!< Iptc keys as record, dataset
+
+    }; // class MetadataScanner
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef SCANNER_HPP_
@@ -82,8 +82,14 @@ namespace Exiv2 {
         MakerNote::MnTagInfo(0xffff, "(UnknownSigmaMakerNoteTag)", "Unknown SigmaMakerNote tag")
     };
 
+    // Index of the Sigma MakerNote Tag Info
+    static const TagIndex sigmaMnTagIndex(sigmaMnTagInfo,
+                                          &MakerNote::MnTagInfo::tag_,
+                                          &MakerNote::MnTagInfo::name_);
+
     SigmaMakerNote::SigmaMakerNote(bool alloc)
-        : IfdMakerNote(sigmaMnTagInfo, alloc), ifdItem_("Sigma")
+        : IfdMakerNote(sigmaMnTagInfo, alloc, &sigmaMnTagIndex),
+          ifdItem_("Sigma")
     {
         byte buf[] = {
             'S', 'I', 'G', 'M', 'A', '\0', '\0', '\0', 0x01, 0x00
@@ -272,15 +272,25 @@ namespace Exiv2 {
         0
     };
 
+    // Indexes of the tag lookup lists by tag and tag name, built at startup
+    static const TagIndex ifdTagIndex(ifdTagInfo, &TagInfo::tag_, &TagInfo::name_);
+    static const TagIndex exifTagIndex(exifTagInfo, &TagInfo::tag_, &TagInfo::name_);
+    static const TagIndex gpsTagIndex(gpsTagInfo, &TagInfo::tag_, &TagInfo::name_);
+    static const TagIndex makerNoteTagIndex(makerNoteTagInfo, &TagInfo::tag_, &TagInfo::name_);
+    static const TagIndex iopTagIndex(iopTagInfo, &TagInfo::tag_, &TagInfo::name_);
+
+    // The indexes of the lists in tagInfos_, in the same order
+    const TagIndex* ExifTags::tagIndexes_[] = {
+        0, 
+        &ifdTagIndex, &exifTagIndex, &gpsTagIndex, &makerNoteTagIndex, &iopTagIndex, &ifdTagIndex, 
+        0
+    };
+
     int ExifTags::tagInfoIdx(uint16_t tag, IfdId ifdId)
     {
-        const TagInfo* tagInfo = tagInfos_[ifdId];
-        if (tagInfo == 0) return -1;
-        int idx;
-        for (idx = 0; tagInfo[idx].tag_ != 0xffff; ++idx) {
-            if (tagInfo[idx].tag_ == tag) return idx;
-        }
-        return -1;
+        const TagIndex* tagIndex = tagIndexes_[ifdId];
+        if (tagIndex == 0) return -1;
+        return tagIndex->find(tag);
     }
 
     std::string ExifTags::tagName(uint16_t tag, IfdId ifdId)
@@ -320,13 +330,10 @@ namespace Exiv2 {
     uint16_t ExifTags::tag(const std::string& tagName, IfdId ifdId)
     {
         uint16_t tag = 0xffff;
-        const TagInfo* tagInfo = tagInfos_[ifdId];
-        if (tagInfo) {
-            int idx;
-            for (idx = 0; tagInfo[idx].tag_ != 0xffff; ++idx) {
-                if (tagInfo[idx].name_ == tagName) break;
-            }
-            tag = tagInfo[idx].tag_;
+        const TagIndex* tagIndex = tagIndexes_[ifdId];
+        if (tagIndex) {
+            int idx = tagIndex->find(tagName);
+            if (idx != -1) tag = tagInfos_[ifdId][idx].tag_;
         }
         if (tag == 0xffff) {
             if (!isHex(tagName, 4, "0x")) throw Error("Invalid tag name");
@@ -402,40 +409,40 @@ namespace Exiv2 {
 
     ExifKey::ExifKey(const std::string& key)
         : tag_(0), ifdId_(ifdIdNotSet), ifdItem_(""),
-          idx_(0), key_(key)
+          idx_(0), pMakerNote_(0), key_(key)
     {
         decomposeKey();
     }
 
     ExifKey::ExifKey(uint16_t tag, const std::string& ifdItem)
         : tag_(0), ifdId_(ifdIdNotSet), ifdItem_(""),
-          idx_(0), key_("")
+          idx_(0), pMakerNote_(0), key_("")
     {
         IfdId ifdId = ExifTags::ifdIdByIfdItem(ifdItem);
         if (ifdId == makerIfdId) throw Error("Invalid key");
-        MakerNote::AutoPtr makerNote; 
+        const MakerNote* pMakerNote = 0;
         if (ifdId == ifdIdNotSet) {
-            makerNote = MakerNoteFactory::instance().create(ifdItem);
-            if (makerNote.get() != 0) ifdId = makerIfdId;
+            pMakerNote = MakerNoteFactory::instance().prototype(ifdItem);
+            if (pMakerNote != 0) ifdId = makerIfdId;
             else throw Error("Invalid key");
         }
         tag_ = tag;
         ifdId_ = ifdId;
         ifdItem_ = ifdItem;
-        makerNote_ = makerNote;
+        pMakerNote_ = pMakerNote;
         makeKey();
     }
 
     ExifKey::ExifKey(const Entry& e)
         : tag_(e.tag()), ifdId_(e.ifdId()), ifdItem_(""),
-          idx_(e.idx()), key_("")
+          idx_(e.idx()), pMakerNote_(0), key_("")
     {
         if (ifdId_ == makerIfdId) {
             if (e.makerNote()) {
                 ifdItem_ = e.makerNote()->ifdItem();
-                makerNote_ = e.makerNote()->clone();
+                pMakerNote_ = MakerNoteFactory::instance().prototype(ifdItem_);
             }
-            else throw Error("Invalid Key");
+            if (pMakerNote_ == 0) throw Error("Invalid Key");
         }
         else {
             ifdItem_ = ExifTags::ifdItem(ifdId_);
@@ -445,10 +452,7 @@ namespace Exiv2 {
 
     ExifKey::ExifKey(const ExifKey& rhs)
         : tag_(rhs.tag_), ifdId_(rhs.ifdId_), ifdItem_(rhs.ifdItem_),
-          idx_(rhs.idx_), 
-          makerNote_(rhs.makerNote_.get() != 0 ? rhs.makerNote_->clone() 
-                                               : MakerNote::AutoPtr(0)),
-          key_(rhs.key_)
+          idx_(rhs.idx_), pMakerNote_(rhs.pMakerNote_), key_(rhs.key_)
     {
     }
 
@@ -464,8 +468,7 @@ namespace Exiv2 {
         ifdId_ = rhs.ifdId_;
         ifdItem_ = rhs.ifdItem_;
         idx_ = rhs.idx_;
-        makerNote_ = rhs.makerNote_.get() != 0 ? rhs.makerNote_->clone() 
-                                               : MakerNote::AutoPtr(0);
+        pMakerNote_ = rhs.pMakerNote_;
         key_ = rhs.key_;
         return *this;
     }
@@ -473,8 +476,8 @@ namespace Exiv2 {
     std::string ExifKey::tagName() const
     {
         if (ifdId_ == makerIfdId) {
-            assert(makerNote_.get() != 0);
-            return makerNote_->tagName(tag_);
+            assert(pMakerNote_ != 0);
+            return pMakerNote_->tagName(tag_);
         }
         return ExifTags::tagName(tag_, ifdId_); 
     }
@@ -492,8 +495,8 @@ namespace Exiv2 {
     std::string ExifKey::sectionName() const 
     {
         if (ifdId_ == makerIfdId) {
-            assert(makerNote_.get() != 0);
-            return makerNote_->ifdItem();
+            assert(pMakerNote_ != 0);
+            return pMakerNote_->ifdItem();
         }
         return ExifTags::sectionName(tag(), ifdId()); 
     }
@@ -518,23 +521,23 @@ namespace Exiv2 {
         // Find IfdId
         IfdId ifdId = ExifTags::ifdIdByIfdItem(ifdItem);
         if (ifdId == makerIfdId) throw Error("Invalid key");
-        MakerNote::AutoPtr makerNote; 
+        const MakerNote* pMakerNote = 0;
         if (ifdId == ifdIdNotSet) {
-            makerNote = MakerNoteFactory::instance().create(ifdItem);
-            if (makerNote.get() != 0) ifdId = makerIfdId;
+            pMakerNote = MakerNoteFactory::instance().prototype(ifdItem);
+            if (pMakerNote != 0) ifdId = makerIfdId;
             else throw Error("Invalid key");
         }
 
         // Convert tag
-        uint16_t tag = makerNote.get() != 0 ? makerNote->tag(tagName)
-                                            : ExifTags::tag(tagName, ifdId);
+        uint16_t tag = pMakerNote != 0 ? pMakerNote->tag(tagName)
+                                       : ExifTags::tag(tagName, ifdId);
         // Translate hex tag name (0xabcd) to a real tag name if there is one
-        tagName = makerNote.get() != 0 ? makerNote->tagName(tag) 
-                                       : ExifTags::tagName(tag, ifdId);
+        tagName = pMakerNote != 0 ? pMakerNote->tagName(tag) 
+                                  : ExifTags::tagName(tag, ifdId);
         tag_ = tag;
         ifdId_ = ifdId;
         ifdItem_ = ifdItem;
-        makerNote_ = makerNote;
+        pMakerNote_ = pMakerNote;
         key_ = familyName + "." + ifdItem + "." + tagName;
     }
 
@@ -542,15 +545,15 @@ namespace Exiv2 {
     {
         key_ = std::string(familyName_) 
             + "." + ifdItem_
-            + "." + (makerNote_.get() != 0 ? makerNote_->tagName(tag_) 
-                                           : ExifTags::tagName(tag_, ifdId_));
+            + "." + (pMakerNote_ != 0 ? pMakerNote_->tagName(tag_) 
+                                      : ExifTags::tagName(tag_, ifdId_));
     }
 
     std::ostream& ExifKey::printTag(std::ostream& os, const Value& value) const
     {
         if (ifdId_ == makerIfdId) {
-            assert(makerNote_.get() != 0);
-            return makerNote_->printTag(os, tag(), value);
+            assert(pMakerNote_ != 0);
+            return pMakerNote_->printTag(os, tag(), value);
         }
         return ExifTags::printTag(os, tag(), ifdId(), value);
     }
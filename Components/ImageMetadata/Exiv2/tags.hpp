@@ -193,6 +193,7 @@ namespace Exiv2 {
         static const SectionInfo sectionInfo_[];
 
         static const TagInfo*    tagInfos_[];
+        static const TagIndex*   tagIndexes_[];
 
     }; // class ExifTags
 
@@ -295,8 +296,12 @@ namespace Exiv2 {
         IfdId ifdId_;                   //!< The IFD associated with this tag
         std::string ifdItem_;           //!< The IFD item 
         int idx_;                       //!< Unique id of an entry within one IFD
-        //! Auto-pointer to the associated MakerNote
-        std::auto_ptr<MakerNote> makerNote_; 
+        /*!
+          @brief The MakerNote prototype of the MakerNote tag, 0 if this is
+                 not a MakerNote tag. Shared by all keys of the MakerNote
+                 and owned by the MakerNoteFactory.
+         */
+        const MakerNote* pMakerNote_;
         std::string key_;               //!< Key
     }; // class ExifKey
 
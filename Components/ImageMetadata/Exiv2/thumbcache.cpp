@@ -0,0 +1,80 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      thumbcache.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#include "thumbcache.hpp"
+#include "basicio.hpp"
+#include "exif.hpp"
+#include "types.hpp"
+
+// + standard includes
+#include <string>
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    ThumbnailCache::ThumbnailCache(const std::string& path)
+        : PackCache(path)
+    {
+    }
+
+    int ThumbnailCache::thumbnail(const std::string& path, DataBuf& buf)
+    {
+        FileId id;
+        if (fileId(path, id) != 0) return -1;
+        int rc = find(id, buf);
+        if (rc == 0) return buf.size_ == 0 ? 8 : 0;
+
+        long offset = 0;
+        long size = 0;
+        rc = ExifData::findThumbnail(path, offset, size);
+        if (rc == 3 || rc == 8) {
+            add(id, 0, 0);
+            return 8;
+        }
+        if (rc) return rc;
+        FileIo io(path);
+        if (io.open() != 0) return -1;
+        DataBuf thumb(size);
+        if (   io.seek(offset, BasicIo::beg) != 0
+            || io.read(thumb.pData_, size) != size) return 1;
+        io.close();
+        // Don't add the thumbnail if the file changed while it was read
+        FileId after;
+        if (fileId(path, after) == 0 && after == id) {
+            add(id, thumb.pData_, thumb.size_);
+        }
+        buf = thumb;
+        return 0;
+    } // ThumbnailCache::thumbnail
+
+}                                       // namespace Exiv2
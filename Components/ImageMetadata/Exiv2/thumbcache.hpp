@@ -0,0 +1,82 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    thumbcache.hpp
+  @brief   Persistent cache of the Exif thumbnails of image files
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef THUMBCACHE_HPP_
+#define THUMBCACHE_HPP_
+
+// *****************************************************************************
+// included header files
+#include "types.hpp"
+#include "packcache.hpp"
+
+// + standard includes
+#include <string>
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class definitions
+
+    /*!
+      @brief A persistent cache of the Exif thumbnails of image files. The
+             cache also remembers images that have no thumbnail, their
+             entry is empty.
+     */
+    class ThumbnailCache : public PackCache {
+    public:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Constructor. Does not open the pack file.
+          @param path Path of the pack file.
+         */
+        explicit ThumbnailCache(const std::string& path);
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Get the thumbnail of the image file \em path. If the cache
+                 does not have it, it is extracted from the Exif data of
+                 the image with ExifData::findThumbnail() and added.
+          @param path Path of the image file
+          @param buf Set to a copy of the thumbnail
+          @return 0 if successful;<BR>
+                  8 if the image has no JPEG thumbnail;<BR>
+                  the return code of ExifData::findThumbnail() if the
+                    thumbnail can not be extracted
+         */
+        int thumbnail(const std::string& path, DataBuf& buf);
+        //@}
+
+    }; // class ThumbnailCache
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef THUMBCACHE_HPP_
@@ -40,6 +40,28 @@ EXIV2_RCSID("@(#) $Id: types.cpp 485 2005-01-16 14:37:45Z ahuggel $");
 #include <sstream>
 #include <utility>
 #include <cctype>
+#include <cstring>
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    // Header in front of each object allocated with Arena::newObject()
+    union ObjectHeader {
+        Exiv2::Arena* pArena_;                  // 0 for heap objects
+        double align_;                          // Alignment only
+        long double longAlign_;                 // Alignment only
+    };
+
+    // Alignment of the memory returned by Arena::allocate()
+    const long arenaAlign = sizeof(ObjectHeader);
+
+    // Hash of a tag number for TagIndex
+    unsigned hashNumber(uint16_t number);
+    // Hash of a tag name of length len for TagIndex
+    unsigned hashName(const char* name, std::size_t len);
+
+}
 
 // *****************************************************************************
 // class member definitions
@@ -139,9 +161,143 @@ namespace Exiv2 {
         size_ = p.second;
     }
 
+    Arena::Arena(long blockSize)
+        : blockSize_(blockSize), used_(0), size_(0)
+    {
+    }
+
+    void* Arena::allocate(long size)
+    {
+        size = (size + arenaAlign - 1) / arenaAlign * arenaAlign;
+        if (size > blockSize_ / 4) {
+            // Large requests get a block of their own, before the last one
+            byte* pBlock = new byte[size];
+            blocks_.insert(blocks_.end() - (blocks_.empty() ? 0 : 1), pBlock);
+            return pBlock;
+        }
+        if (blocks_.empty() || used_ + size > size_) {
+            blocks_.push_back(new byte[blockSize_]);
+            used_ = 0;
+            size_ = blockSize_;
+        }
+        void* p = blocks_.back() + used_;
+        used_ += size;
+        return p;
+    } // Arena::allocate
+
+    void Arena::reset()
+    {
+        for (std::vector<byte*>::size_type i = 0; i < blocks_.size(); ++i) {
+            delete[] blocks_[i];
+        }
+        blocks_.clear();
+        used_ = 0;
+        size_ = 0;
+    }
+
+    void* Arena::newObject(std::size_t size, Arena* pArena)
+    {
+        long total = static_cast<long>(size) + sizeof(ObjectHeader);
+        ObjectHeader* pHeader = static_cast<ObjectHeader*>(
+            pArena != 0 ? pArena->allocate(total) : ::operator new(total));
+        pHeader->pArena_ = pArena;
+        return pHeader + 1;
+    }
+
+    void Arena::deleteObject(void* p)
+    {
+        if (p == 0) return;
+        ObjectHeader* pHeader = static_cast<ObjectHeader*>(p) - 1;
+        // Memory in an arena is released with the arena
+        if (pHeader->pArena_ == 0) ::operator delete(pHeader);
+    }
+
+    void TagIndex::init(int count)
+    {
+        // At most half of the slots are used
+        unsigned size = 16;
+        while (size < 2 * static_cast<unsigned>(count)) size *= 2;
+        mask_ = size - 1;
+        numbers_.reserve(count);
+        names_.reserve(count);
+        byNumber_.assign(size, -1);
+        byName_.assign(size, -1);
+    }
+
+    void TagIndex::add(int idx, uint16_t number, const char* name)
+    {
+        numbers_.push_back(number);
+        names_.push_back(name);
+        // Keep the first entry with a number or name
+        unsigned i = hashNumber(number) & mask_;
+        while (byNumber_[i] != -1 && numbers_[byNumber_[i]] != number) {
+            i = (i + 1) & mask_;
+        }
+        if (byNumber_[i] == -1) byNumber_[i] = idx;
+        i = hashName(name, std::strlen(name)) & mask_;
+        while (byName_[i] != -1 && std::strcmp(names_[byName_[i]], name) != 0) {
+            i = (i + 1) & mask_;
+        }
+        if (byName_[i] == -1) byName_[i] = idx;
+    } // TagIndex::add
+
+    int TagIndex::find(uint16_t number) const
+    {
+        unsigned i = hashNumber(number) & mask_;
+        while (byNumber_[i] != -1) {
+            if (numbers_[byNumber_[i]] == number) return byNumber_[i];
+            i = (i + 1) & mask_;
+        }
+        return -1;
+    }
+
+    int TagIndex::find(const std::string& name) const
+    {
+        unsigned i = hashName(name.data(), name.size()) & mask_;
+        while (byName_[i] != -1) {
+            if (names_[byName_[i]] == name) return byName_[i];
+            i = (i + 1) & mask_;
+        }
+        return -1;
+    }
+
     // *************************************************************************
     // free functions
 
+    ByteOrder hostByteOrder()
+    {
+        const uint16_t one = 1;
+        return *reinterpret_cast<const byte*>(&one) == 1 ? littleEndian
+                                                         : bigEndian;
+    }
+
+    void swapBytes(byte* dst, const byte* src, long count, long size)
+    {
+        // Simple loops with a constant value size, which compilers can
+        // unroll and vectorize
+        if (size == 2) {
+            for (long i = 0; i < 2 * count; i += 2) {
+                dst[i]     = src[i + 1];
+                dst[i + 1] = src[i];
+            }
+        }
+        else if (size == 4) {
+            for (long i = 0; i < 4 * count; i += 4) {
+                dst[i]     = src[i + 3];
+                dst[i + 1] = src[i + 2];
+                dst[i + 2] = src[i + 1];
+                dst[i + 3] = src[i];
+            }
+        }
+        else {
+            for (long i = 0; i < size * count; i += size) {
+                for (long j = 0; j < size; ++j) {
+                    dst[i + j] = src[i + size - 1 - j];
+                }
+            }
+        }
+    } // swapBytes
+
     uint16_t getUShort(const byte* buf, ByteOrder byteOrder)
     {
         if (byteOrder == littleEndian) {
@@ -341,3 +497,24 @@ namespace Exiv2 {
     } // isHex
 
 }                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    unsigned hashNumber(uint16_t number)
+    {
+        return (number * 2654435761U) >> 8;
+    }
+
+    unsigned hashName(const char* name, std::size_t len)
+    {
+        // FNV-1a
+        unsigned h = 2166136261U;
+        for (std::size_t i = 0; i < len; ++i) {
+            h = (h ^ static_cast<unsigned char>(name[i])) * 16777619U;
+        }
+        return h;
+    }
+
+}
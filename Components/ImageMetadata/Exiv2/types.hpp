@@ -47,6 +47,8 @@
 #include <utility>
 #include <sstream>
 #include <cstdio>
+#include <cstddef>
+#include <vector>
 //#ifdef HAVE_STDINT_H
 # include <stdint.h>
 //#endif
@@ -91,6 +93,10 @@ namespace Exiv2 {
                  ifd0Id, exifIfdId, gpsIfdId, makerIfdId, iopIfdId, ifd1Id, 
                  lastIfdId };
 
+    //! Metadata of an image, used as a mask to select what is read
+    enum MetadataId { mdNone = 0, mdExif = 1, mdIptc = 2, mdComment = 4,
+                      mdDimensions = 8 };
+
 // *****************************************************************************
 // class definitions
 
@@ -238,6 +244,115 @@ namespace Exiv2 {
         FILE *fp_; 
     }; // class FileCloser
 
+    /*!
+      @brief Memory arena for the many small objects created when metadata
+             is parsed. Memory is handed out from large blocks, which are
+             only released, all at once, when the arena is destroyed or
+             reset. Objects allocated in an arena must be destroyed before.
+
+      Classes that support arenas (Key, Value) allocate their objects with
+      newObject() and free them with deleteObject(). These put a small
+      header in front of each object to remember where it came from, so
+      that an object can be deleted through an std::auto_ptr, no matter if
+      it lives in an arena or on the heap.
+     */
+    class Arena {
+        // Not implemented
+        //! Copy constructor
+        Arena(const Arena&);
+        //! Assignment operator
+        Arena& operator=(const Arena&);
+    public:
+        //! @name Creators
+        //@{
+        //! Constructor, takes the size of the memory blocks
+        explicit Arena(long blockSize =4096);
+        //! Destructor, releases all memory
+        ~Arena() { reset(); }
+        //@}
+
+        //! @name Manipulators
+        //@{
+        /*!
+          @brief Return \em size bytes of memory, aligned like the memory
+                 returned by operator new.
+         */
+        void* allocate(long size);
+        //! Release all memory
+        void reset();
+        //@}
+
+        /*!
+          @brief Allocate memory for an object of \em size bytes in arena
+                 \em pArena, or on the heap if \em pArena is 0.
+         */
+        static void* newObject(std::size_t size, Arena* pArena);
+        //! Free the memory of an object allocated with newObject()
+        static void deleteObject(void* p);
+
+    private:
+        // DATA
+        long blockSize_;                        //!< Size of the blocks
+        std::vector<byte*> blocks_;             //!< Allocated blocks
+        long used_;                             //!< Used bytes of last block
+        long size_;                             //!< Size of last block
+    }; // class Arena
+
+    /*!
+      @brief Hash index of a lookup table with tag numbers and names, like
+             the tag and dataset tables, in both directions. The table is an
+             array of structures ending with an entry with number 0xffff.
+
+      The index is built once, when it is constructed, and is read-only
+      afterwards. Lookups return the position of the first entry with the
+      number or name in the table, as a linear search through the table
+      does.
+     */
+    class TagIndex {
+    public:
+        //! @name Creators
+        //@{
+        /*!
+          @brief Build the index of \em table. \em number and \em name
+                 are the members of the table entries with the number and
+                 name, e.g., &TagInfo::tag_ and &TagInfo::name_.
+         */
+        template<typename T>
+        TagIndex(const T* table, 
+                 uint16_t T::*number,
+                 const char* T::*name)
+        {
+            int count = 0;
+            while (table[count].*number != 0xffff) ++count;
+            init(count);
+            for (int i = 0; i < count; ++i) {
+                add(i, table[i].*number, table[i].*name);
+            }
+        }
+        //@}
+
+        //! @name Accessors
+        //@{
+        //! Return the position of \em number in the table, -1 if not found
+        int find(uint16_t number) const;
+        //! Return the position of \em name in the table, -1 if not found
+        int find(const std::string& name) const;
+        //@}
+
+    private:
+        //! Size the hash tables for \em count entries
+        void init(int count);
+        //! Add the entry at position \em idx to the index
+        void add(int idx, uint16_t number, const char* name);
+
+        // DATA
+        std::vector<uint16_t> numbers_;         //!< Numbers of the entries
+        std::vector<const char*> names_;        //!< Names of the entries
+        std::vector<int> byNumber_;             //!< Hash table, -1 if empty
+        std::vector<int> byName_;               //!< Hash table, -1 if empty
+        unsigned mask_;                         //!< Size of the tables - 1
+    }; // class TagIndex
+
 // *****************************************************************************
 // free functions
 
@@ -294,6 +409,93 @@ namespace Exiv2 {
      */
     long r2Data(byte* buf, Rational l, ByteOrder byteOrder);
 
+    /*!
+      @brief Read a 2 byte unsigned short value in byte order \em byteOrder
+             from the data buffer. Loops that read many values in the same
+             byte order use this instead of getUShort(const byte*, ByteOrder)
+             to decide on the byte order only once.
+     */
+    template<ByteOrder byteOrder> uint16_t getUShort(const byte* buf);
+    //! Read a 4 byte unsigned long value in byte order \em byteOrder
+    template<ByteOrder byteOrder> uint32_t getULong(const byte* buf);
+    //! Write an unsigned short in byte order \em byteOrder, return 2
+    template<ByteOrder byteOrder> long us2Data(byte* buf, uint16_t s);
+    //! Write an unsigned long in byte order \em byteOrder, return 4
+    template<ByteOrder byteOrder> long ul2Data(byte* buf, uint32_t l);
+
+    //! Specialization to read an unsigned short in little endian
+    template<>
+    inline uint16_t getUShort<littleEndian>(const byte* buf)
+    {
+        return buf[1] << 8 | buf[0];
+    }
+    //! Specialization to read an unsigned short in big endian
+    template<>
+    inline uint16_t getUShort<bigEndian>(const byte* buf)
+    {
+        return buf[0] << 8 | buf[1];
+    }
+    //! Specialization to read an unsigned long in little endian
+    template<>
+    inline uint32_t getULong<littleEndian>(const byte* buf)
+    {
+        return   static_cast<uint32_t>(buf[3]) << 24 | buf[2] << 16 
+               | buf[1] << 8 | buf[0];
+    }
+    //! Specialization to read an unsigned long in big endian
+    template<>
+    inline uint32_t getULong<bigEndian>(const byte* buf)
+    {
+        return   static_cast<uint32_t>(buf[0]) << 24 | buf[1] << 16 
+               | buf[2] << 8 | buf[3];
+    }
+    //! Specialization to write an unsigned short in little endian
+    template<>
+    inline long us2Data<littleEndian>(byte* buf, uint16_t s)
+    {
+        buf[0] = static_cast<byte>(s);
+        buf[1] = static_cast<byte>(s >> 8);
+        return 2;
+    }
+    //! Specialization to write an unsigned short in big endian
+    template<>
+    inline long us2Data<bigEndian>(byte* buf, uint16_t s)
+    {
+        buf[0] = static_cast<byte>(s >> 8);
+        buf[1] = static_cast<byte>(s);
+        return 2;
+    }
+    //! Specialization to write an unsigned long in little endian
+    template<>
+    inline long ul2Data<littleEndian>(byte* buf, uint32_t l)
+    {
+        buf[0] = static_cast<byte>(l);
+        buf[1] = static_cast<byte>(l >> 8);
+        buf[2] = static_cast<byte>(l >> 16);
+        buf[3] = static_cast<byte>(l >> 24);
+        return 4;
+    }
+    //! Specialization to write an unsigned long in big endian
+    template<>
+    inline long ul2Data<bigEndian>(byte* buf, uint32_t l)
+    {
+        buf[0] = static_cast<byte>(l >> 24);
+        buf[1] = static_cast<byte>(l >> 16);
+        buf[2] = static_cast<byte>(l >> 8);
+        buf[3] = static_cast<byte>(l);
+        return 4;
+    }
+
+    //! Return the byte order of the host
+    ByteOrder hostByteOrder();
+    /*!
+      @brief Copy \em count values of \em size bytes each (2 or 4) from
+             \em src to \em dst and reverse the bytes of each value, i.e.,
+             convert them from one byte order to the other. The buffers must
+             not overlap.
+     */
+    void swapBytes(byte* dst, const byte* src, long count, long size);
+
     /*!
       @brief Print len bytes from buf in hex and ASCII format to the given
              stream, prefixed with the position in the buffer adjusted by
@@ -54,57 +54,57 @@ namespace Exiv2 {
         return *this;
     }
 
-    Value::AutoPtr Value::create(TypeId typeId)
+    Value::AutoPtr Value::create(TypeId typeId, Arena* pArena)
     {
         AutoPtr value;
         switch (typeId) {
         case invalidTypeId:
-            value = AutoPtr(new DataValue(invalidTypeId));
+            value = AutoPtr(new (pArena) DataValue(invalidTypeId));
             break;
         case unsignedByte:
-            value = AutoPtr(new DataValue(unsignedByte));
+            value = AutoPtr(new (pArena) DataValue(unsignedByte));
             break;
         case asciiString:
-            value = AutoPtr(new AsciiValue);
+            value = AutoPtr(new (pArena) AsciiValue);
             break;
         case unsignedShort:
-            value = AutoPtr(new ValueType<uint16_t>);
+            value = AutoPtr(new (pArena) ValueType<uint16_t>);
             break;
         case unsignedLong:
-            value = AutoPtr(new ValueType<uint32_t>);
+            value = AutoPtr(new (pArena) ValueType<uint32_t>);
             break;
         case unsignedRational:
-            value = AutoPtr(new ValueType<URational>);
+            value = AutoPtr(new (pArena) ValueType<URational>);
             break;
         case invalid6:
-            value = AutoPtr(new DataValue(invalid6));
+            value = AutoPtr(new (pArena) DataValue(invalid6));
             break;
         case undefined:
-            value = AutoPtr(new DataValue);
+            value = AutoPtr(new (pArena) DataValue);
             break;
         case signedShort:
-            value = AutoPtr(new ValueType<int16_t>);
+            value = AutoPtr(new (pArena) ValueType<int16_t>);
             break;
         case signedLong:
-            value = AutoPtr(new ValueType<int32_t>);
+            value = AutoPtr(new (pArena) ValueType<int32_t>);
             break;
         case signedRational:
-            value = AutoPtr(new ValueType<Rational>);
+            value = AutoPtr(new (pArena) ValueType<Rational>);
             break;
         case string:
-            value = AutoPtr(new StringValue);
+            value = AutoPtr(new (pArena) StringValue);
             break;
         case date:
-            value = AutoPtr(new DateValue);
+            value = AutoPtr(new (pArena) DateValue);
             break;
         case time:
-            value = AutoPtr(new TimeValue);
+            value = AutoPtr(new (pArena) TimeValue);
             break;
         case comment:
-            value = AutoPtr(new CommentValue);
+            value = AutoPtr(new (pArena) CommentValue);
             break;
         default:
-            value = AutoPtr(new DataValue(typeId));
+            value = AutoPtr(new (pArena) DataValue(typeId));
             break;
         }
         return value;
@@ -75,6 +75,22 @@ namespace Exiv2 {
         virtual ~Value() {}
         //@}
 
+        //! @name Memory management
+        //@{
+        //! Allocate a value on the heap
+        static void* operator new(std::size_t size)
+            { return Arena::newObject(size, 0); }
+        //! Allocate a value in arena \em pArena, or on the heap if it is 0
+        static void* operator new(std::size_t size, Arena* pArena)
+            { return Arena::newObject(size, pArena); }
+        //! Free a value, memory in an arena is released with the arena
+        static void operator delete(void* p)
+            { Arena::deleteObject(p); }
+        //! Free a value if its constructor throws
+        static void operator delete(void* p, Arena*)
+            { Arena::deleteObject(p); }
+        //@}
+
         //! @name Manipulators
         //@{
         /*!
@@ -212,10 +228,12 @@ namespace Exiv2 {
           </TABLE>
 
           @param typeId Type of the value.
+          @param pArena Arena to create the value in, 0 to create it on the
+                 heap. The value must be deleted before the arena.
           @return Auto-pointer to the newly created Value. The caller owns this
                   copy and the auto-pointer ensures that it will be deleted.
          */
-        static AutoPtr create(TypeId typeId);
+        static AutoPtr create(TypeId typeId, Arena* pArena =0);
 
     protected:
         /*!
@@ -1042,6 +1060,141 @@ namespace Exiv2 {
         return r2Data(buf, t, byteOrder);
     }
 
+    /*!
+      @brief Read \em count values of type T from the data buffer into
+             \em values, replacing its contents.
+
+      The default implementation reads one value at a time. Integer types
+      are copied as a whole, with the bytes of each value reversed if the
+      byte order is not that of the host.
+
+      @param values Vector to read the values into.
+      @param buf Pointer to the data buffer to read from.
+      @param count Number of values to read.
+      @param byteOrder Applicable byte order (little or big endian).
+     */
+    template<typename T>
+    void readValues(std::vector<T>& values, const byte* buf, long count, 
+                    ByteOrder byteOrder)
+    {
+        const long typeSize = TypeInfo::typeSize(getType<T>());
+        values.clear();
+        values.reserve(count);
+        for (long i = 0; i < count; ++i) {
+            values.push_back(getValue<T>(buf + i * typeSize, byteOrder));
+        }
+    }
+    /*!
+      @brief Read \em count integer values of type T from the data buffer
+             into \em values, see readValues().
+     */
+    template<typename T>
+    void readIntValues(std::vector<T>& values, const byte* buf, long count, 
+                       ByteOrder byteOrder)
+    {
+        values.resize(count);
+        if (count == 0) return;
+        byte* pValues = reinterpret_cast<byte*>(&values[0]);
+        if ((byteOrder == littleEndian) == (hostByteOrder() == littleEndian)) {
+            memcpy(pValues, buf, count * sizeof(T));
+        }
+        else {
+            swapBytes(pValues, buf, count, sizeof(T));
+        }
+    }
+    //! Specialization to read unsigned shorts
+    template<>
+    inline void readValues(std::vector<uint16_t>& values, const byte* buf,
+                           long count, ByteOrder byteOrder)
+    {
+        readIntValues(values, buf, count, byteOrder);
+    }
+    //! Specialization to read unsigned longs
+    template<>
+    inline void readValues(std::vector<uint32_t>& values, const byte* buf,
+                           long count, ByteOrder byteOrder)
+    {
+        readIntValues(values, buf, count, byteOrder);
+    }
+    //! Specialization to read signed shorts
+    template<>
+    inline void readValues(std::vector<int16_t>& values, const byte* buf,
+                           long count, ByteOrder byteOrder)
+    {
+        readIntValues(values, buf, count, byteOrder);
+    }
+    //! Specialization to read signed longs
+    template<>
+    inline void readValues(std::vector<int32_t>& values, const byte* buf,
+                           long count, ByteOrder byteOrder)
+    {
+        readIntValues(values, buf, count, byteOrder);
+    }
+
+    /*!
+      @brief Write \em values to the data buffer, return the number of
+             bytes written. The counterpart of readValues().
+     */
+    template<typename T>
+    long copyValues(byte* buf, const std::vector<T>& values, 
+                    ByteOrder byteOrder)
+    {
+        long offset = 0;
+        typename std::vector<T>::const_iterator end = values.end();
+        for (typename std::vector<T>::const_iterator i = values.begin();
+             i != end; ++i) {
+            offset += toData(buf + offset, *i, byteOrder);
+        }
+        return offset;
+    }
+    /*!
+      @brief Write integer \em values of type T to the data buffer, see
+             copyValues().
+     */
+    template<typename T>
+    long copyIntValues(byte* buf, const std::vector<T>& values, 
+                       ByteOrder byteOrder)
+    {
+        const long count = static_cast<long>(values.size());
+        if (count == 0) return 0;
+        const byte* pValues = reinterpret_cast<const byte*>(&values[0]);
+        if ((byteOrder == littleEndian) == (hostByteOrder() == littleEndian)) {
+            memcpy(buf, pValues, count * sizeof(T));
+        }
+        else {
+            swapBytes(buf, pValues, count, sizeof(T));
+        }
+        return count * sizeof(T);
+    }
+    //! Specialization to write unsigned shorts
+    template<>
+    inline long copyValues(byte* buf, const std::vector<uint16_t>& values,
+                           ByteOrder byteOrder)
+    {
+        return copyIntValues(buf, values, byteOrder);
+    }
+    //! Specialization to write unsigned longs
+    template<>
+    inline long copyValues(byte* buf, const std::vector<uint32_t>& values,
+                           ByteOrder byteOrder)
+    {
+        return copyIntValues(buf, values, byteOrder);
+    }
+    //! Specialization to write signed shorts
+    template<>
+    inline long copyValues(byte* buf, const std::vector<int16_t>& values,
+                           ByteOrder byteOrder)
+    {
+        return copyIntValues(buf, values, byteOrder);
+    }
+    //! Specialization to write signed longs
+    template<>
+    inline long copyValues(byte* buf, const std::vector<int32_t>& values,
+                           ByteOrder byteOrder)
+    {
+        return copyIntValues(buf, values, byteOrder);
+    }
+
     template<typename T>
     ValueType<T>::ValueType(const byte* buf, long len, ByteOrder byteOrder) 
         : Value(getType<T>()), pDataArea_(0), sizeDataArea_(0)
@@ -1097,10 +1250,7 @@ namespace Exiv2 {
     template<typename T>
     void ValueType<T>::read(const byte* buf, long len, ByteOrder byteOrder)
     {
-        value_.clear();
-        for (long i = 0; i < len; i += TypeInfo::typeSize(typeId())) {
-            value_.push_back(getValue<T>(buf + i, byteOrder));
-        }
+        readValues(value_, buf, len / TypeInfo::typeSize(typeId()), byteOrder);
     }
 
     template<typename T>
@@ -1117,12 +1267,7 @@ namespace Exiv2 {
     template<typename T>
     long ValueType<T>::copy(byte* buf, ByteOrder byteOrder) const
     {
-        long offset = 0;
-        typename ValueList::const_iterator end = value_.end();
-        for (typename ValueList::const_iterator i = value_.begin(); i != end; ++i) {
-            offset += toData(buf + offset, *i, byteOrder);
-        }
-        return offset;
+        return copyValues(buf, value_, byteOrder);
     }
 
     template<typename T>
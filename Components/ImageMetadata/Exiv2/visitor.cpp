@@ -0,0 +1,287 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*
+  File:      visitor.cpp
+  Version:   $Rev$
+  Author(s): Elliot Glaysher (eg)
+  History:   16-Oct-26, eg: created
+ */
+// *****************************************************************************
+#include "rcsid.hpp"
+EXIV2_RCSID("@(#) $Id$");
+
+// *****************************************************************************
+// included header files
+#include "visitor.hpp"
+#include "types.hpp"
+#include "ifd.hpp"
+#include "image.hpp"
+#include "makernote.hpp"
+
+// + standard includes
+#include <string>
+#include <algorithm>
+
+// *****************************************************************************
+// local declarations
+namespace {
+
+    using namespace Exiv2;
+
+    /*
+      Walks the IFDs of an Exif data buffer in byte order byteOrder and
+      remembers the positions of the sub-IFDs and the makernote on the way.
+     */
+    template<ByteOrder byteOrder>
+    class ExifWalker {
+    public:
+        // Constructor
+        ExifWalker(const byte* buf, long len, ExifVisitor& visitor);
+        // Walk the IFDs, IFD0 is at offset
+        int walk(uint32_t offset);
+
+    private:
+        // Walk IFD ifdId at offset and its sub-IFDs if the visitor enters it
+        int walkIfd(IfdId ifdId, uint32_t offset);
+        // Pass the entries of the IFD at offset to the visitor
+        int walkEntries(IfdId ifdId, uint32_t offset);
+        // Get the offset of the IFD following the IFD at offset
+        int nextIfd(uint32_t offset, uint32_t& next) const;
+        // Remember the position of an entry if it is needed later
+        void remember(IfdId ifdId, uint16_t tag, const byte* pData, long size);
+        // Pass the entries of the makernote to the visitor
+        void walkMakerNote();
+
+        const byte* buf_;                       // Exif data buffer
+        long len_;                              // Length of the buffer
+        ExifVisitor& visitor_;                  // Receives the entries
+        bool stop_;                             // Visitor stopped the walk
+        uint32_t exifIfd_;                      // Offset of the ExifIFD
+        uint32_t gpsIfd_;                       // Offset of the GPSInfo IFD
+        uint32_t iopIfd_;                       // Offset of the Iop IFD
+        const byte* pMakerNote_;                // The makernote
+        long sizeMakerNote_;                    // Size of the makernote
+        const byte* pMake_;                     // Camera make
+        long sizeMake_;                         // Size of the camera make
+        const byte* pModel_;                    // Camera model
+        long sizeModel_;                        // Size of the camera model
+    };
+
+    // Convert a string value of at most size bytes to a std::string
+    std::string toString(const byte* pData, long size);
+
+}
+
+// *****************************************************************************
+// class member definitions
+namespace Exiv2 {
+
+    int visitExif(const byte* buf, long len, ExifVisitor& visitor)
+    {
+        TiffHeader tiffHeader;
+        if (len < tiffHeader.size()) return 1;
+        int rc = tiffHeader.read(buf);
+        if (rc) return rc;
+        if (tiffHeader.byteOrder() == littleEndian) {
+            ExifWalker<littleEndian> walker(buf, len, visitor);
+            rc = walker.walk(tiffHeader.offset());
+        }
+        else {
+            ExifWalker<bigEndian> walker(buf, len, visitor);
+            rc = walker.walk(tiffHeader.offset());
+        }
+        return rc;
+    } // visitExif
+
+}                                       // namespace Exiv2
+
+// *****************************************************************************
+// local definitions
+namespace {
+
+    template<ByteOrder byteOrder>
+    ExifWalker<byteOrder>::ExifWalker(const byte* buf, long len,
+                                      ExifVisitor& visitor)
+        : buf_(buf), len_(len), visitor_(visitor), stop_(false),
+          exifIfd_(0), gpsIfd_(0), iopIfd_(0),
+          pMakerNote_(0), sizeMakerNote_(0),
+          pMake_(0), sizeMake_(0), pModel_(0), sizeModel_(0)
+    {
+    }
+
+    template<ByteOrder byteOrder>
+    int ExifWalker<byteOrder>::walk(uint32_t offset)
+    {
+        int rc = walkIfd(ifd0Id, offset);
+        if (rc || stop_) return rc;
+        // IFD1 follows IFD0, it is walked even if IFD0 was skipped
+        uint32_t ifd1 = 0;
+        rc = nextIfd(offset, ifd1);
+        if (rc == 0 && ifd1 != 0) {
+            rc = walkIfd(ifd1Id, ifd1);
+        }
+        return rc;
+    } // ExifWalker::walk
+
+    template<ByteOrder byteOrder>
+    int ExifWalker<byteOrder>::walkIfd(IfdId ifdId, uint32_t offset)
+    {
+        if (!visitor_.enterIfd(ifdId)) return 0;
+        int rc = walkEntries(ifdId, offset);
+        if (rc || stop_) return rc;
+        if (ifdId == ifd0Id) {
+            if (exifIfd_ != 0) {
+                rc = walkIfd(exifIfdId, exifIfd_);
+                if (rc || stop_) return rc;
+            }
+            if (gpsIfd_ != 0) {
+                rc = walkIfd(gpsIfdId, gpsIfd_);
+                if (rc || stop_) return rc;
+            }
+        }
+        if (ifdId == exifIfdId) {
+            walkMakerNote();
+            if (stop_) return 0;
+            if (iopIfd_ != 0) {
+                rc = walkIfd(iopIfdId, iopIfd_);
+                if (rc || stop_) return rc;
+            }
+        }
+        visitor_.leaveIfd(ifdId);
+        return 0;
+    } // ExifWalker::walkIfd
+
+    template<ByteOrder byteOrder>
+    int ExifWalker<byteOrder>::walkEntries(IfdId ifdId, uint32_t offset)
+    {
+        if (len_ < 2 || offset > static_cast<uint32_t>(len_ - 2)) return 6;
+        const byte* pIfd = buf_ + offset;
+        long n = getUShort<byteOrder>(pIfd);
+        // The directory entries and the offset of the next IFD
+        if (len_ - static_cast<long>(offset) < 2 + 12 * n + 4) return 6;
+
+        for (long i = 0; i < n; ++i) {
+            const byte* pEntry = pIfd + 2 + 12 * i;
+            uint16_t tag = getUShort<byteOrder>(pEntry);
+            uint16_t type = getUShort<byteOrder>(pEntry + 2);
+            uint32_t count = getULong<byteOrder>(pEntry + 4);
+            long typeSize = TypeInfo::typeSize(TypeId(type));
+            const byte* pData = pEntry + 8;
+            long size = 0;
+            if (count <= static_cast<uint32_t>(len_)) {
+                size = count * typeSize;
+            }
+            if (size > 4) {
+                uint32_t o = getULong<byteOrder>(pEntry + 8);
+                if (   o > static_cast<uint32_t>(len_)
+                    || size > len_ - static_cast<long>(o)) {
+                    size = 0;
+                }
+                else {
+                    pData = buf_ + o;
+                }
+            }
+            if (size == 0 && typeSize != 0) {
+                // The value lies outside of the buffer
+                count = 0;
+            }
+            remember(ifdId, tag, pData, size);
+            if (!visitor_.visitEntry(ifdId, tag, type, count,
+                                     pData, size, byteOrder)) {
+                stop_ = true;
+                return 0;
+            }
+        }
+        return 0;
+    } // ExifWalker::walkEntries
+
+    template<ByteOrder byteOrder>
+    int ExifWalker<byteOrder>::nextIfd(uint32_t offset, uint32_t& next) const
+    {
+        if (len_ < 2 || offset > static_cast<uint32_t>(len_ - 2)) return 6;
+        long n = getUShort<byteOrder>(buf_ + offset);
+        if (len_ - static_cast<long>(offset) < 2 + 12 * n + 4) return 6;
+        next = getULong<byteOrder>(buf_ + offset + 2 + 12 * n);
+        return 0;
+    } // ExifWalker::nextIfd
+
+    template<ByteOrder byteOrder>
+    void ExifWalker<byteOrder>::remember(IfdId ifdId, uint16_t tag,
+                                         const byte* pData, long size)
+    {
+        if (ifdId == ifd0Id) {
+            switch (tag) {
+            case 0x010f: pMake_ = pData; sizeMake_ = size; break;
+            case 0x0110: pModel_ = pData; sizeModel_ = size; break;
+            case 0x8769:
+                if (size >= 4) exifIfd_ = getULong<byteOrder>(pData);
+                break;
+            case 0x8825:
+                if (size >= 4) gpsIfd_ = getULong<byteOrder>(pData);
+                break;
+            }
+        }
+        if (ifdId == exifIfdId) {
+            switch (tag) {
+            case 0x927c: pMakerNote_ = pData; sizeMakerNote_ = size; break;
+            case 0xa005:
+                if (size >= 4) iopIfd_ = getULong<byteOrder>(pData);
+                break;
+            }
+        }
+    } // ExifWalker::remember
+
+    template<ByteOrder byteOrder>
+    void ExifWalker<byteOrder>::walkMakerNote()
+    {
+        if (   sizeMakerNote_ == 0 || sizeMake_ == 0 || sizeModel_ == 0
+            || !visitor_.enterIfd(makerIfdId)) return;
+
+        // The makernote entries refer to the buffer (alloc is false)
+        long offset = static_cast<long>(pMakerNote_ - buf_);
+        MakerNote::AutoPtr makerNote = MakerNoteFactory::instance().create(
+            toString(pMake_, sizeMake_), toString(pModel_, sizeModel_),
+            false, pMakerNote_, sizeMakerNote_, byteOrder, offset);
+        if (   makerNote.get() != 0
+            && makerNote->read(pMakerNote_, sizeMakerNote_,
+                               byteOrder, offset) == 0) {
+            Entries::const_iterator end = makerNote->end();
+            for (Entries::const_iterator i = makerNote->begin(); i != end; ++i) {
+                long size = std::min(i->size(), static_cast<long>(
+                    i->count() * TypeInfo::typeSize(TypeId(i->type()))));
+                if (!visitor_.visitEntry(makerIfdId, i->tag(), i->type(),
+                                         i->count(), i->data(), size,
+                                         makerNote->byteOrder())) {
+                    stop_ = true;
+                    return;
+                }
+            }
+        }
+        visitor_.leaveIfd(makerIfdId);
+    } // ExifWalker::walkMakerNote
+
+    std::string toString(const byte* pData, long size)
+    {
+        const char* p = reinterpret_cast<const char*>(pData);
+        return std::string(p, std::find(p, p + size, '\0'));
+    }
+
+}
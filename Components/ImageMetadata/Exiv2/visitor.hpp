@@ -0,0 +1,114 @@
+// ***************************************************************** -*- C++ -*-
+/*
+ * Copyright (C) 2004 Andreas Huggel <ahuggel@gmx.net>
+ *
+ * This program is part of the Exiv2 distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+/*!
+  @file    visitor.hpp
+  @brief   Walk the IFD entries of an Exif data buffer without parsing it
+  @version $Rev$
+  @author  Elliot Glaysher (eg)
+  @date    16-Oct-26, eg: created
+ */
+#ifndef VISITOR_HPP_
+#define VISITOR_HPP_
+
+// *****************************************************************************
+// included header files
+#include "types.hpp"
+
+// *****************************************************************************
+// namespace extensions
+namespace Exiv2 {
+
+// *****************************************************************************
+// class definitions
+
+    /*!
+      @brief Interface to receive the IFD entries of an Exif data buffer
+             from visitExif().
+
+      The IFDs are walked in the order IFD0, ExifIFD, the makernote,
+      Interoperability IFD, GPSInfo IFD and IFD1, each IFD entry by entry.
+      The entries that link the sub-IFDs are passed to the visitor like all
+      other entries.
+     */
+    class ExifVisitor {
+    public:
+        //! Virtual destructor.
+        virtual ~ExifVisitor() {}
+
+        /*!
+          @brief Called before the entries of IFD \em ifdId are walked.
+                 Return false to skip the IFD and its sub-IFDs, i.e., the
+                 ExifIFD, Interoperability and GPSInfo IFD and the makernote
+                 for IFD0 and the Interoperability IFD and the makernote
+                 for the ExifIFD. The default implementation returns true.
+         */
+        virtual bool enterIfd(IfdId) { return true; }
+        /*!
+          @brief Called for each entry of an IFD.
+
+          @param ifdId Id of the IFD of the entry.
+          @param tag Tag of the entry.
+          @param type Type of the entry, see TypeId.
+          @param count Number of components of the value. 0 if the value
+                 lies outside of the buffer.
+          @param pData Pointer to the value in the Exif data buffer. The
+                 value is not decoded.
+          @param size Size of the value in bytes.
+          @param byteOrder Byte order of the value.
+          @return True to continue, false to stop the walk.
+         */
+        virtual bool visitEntry(IfdId ifdId,
+                                uint16_t tag,
+                                uint16_t type,
+                                uint32_t count,
+                                const byte* pData,
+                                long size,
+                                ByteOrder byteOrder) =0;
+        /*!
+          @brief Called after the entries and the sub-IFDs of IFD \em ifdId
+                 are walked. Not called if the walk was stopped. The
+                 default implementation does nothing.
+         */
+        virtual void leaveIfd(IfdId) {}
+    }; // class ExifVisitor
+
+// *****************************************************************************
+// free functions
+
+    /*!
+      @brief Walk the IFDs of the Exif data buffer \em buf of length \em len,
+             which starts with the TIFF header, and pass their entries to
+             \em visitor.
+
+      In contrast to ExifData::read(), nothing is copied, decoded or
+      allocated, the visitor is passed pointers into the buffer. Only the
+      makernote needs a MakerNote to be read and that is only created if
+      the visitor enters the makernote IFD. The buffer is not modified.
+
+      @return 0 if successful, also if the visitor stopped the walk;<BR>
+              1 if the buffer does not start with a TIFF header;<BR>
+              6 if an IFD lies outside of the buffer. The walk stops there.
+     */
+    int visitExif(const byte* buf, long len, ExifVisitor& visitor);
+
+}                                       // namespace Exiv2
+
+#endif                                  // #ifndef VISITOR_HPP_
@@ -31,7 +31,9 @@
 #import "ImageMetadata.h"
 
 #import "iptc.hpp"
+#import "image.hpp"
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -56,16 +58,13 @@ using namespace std;
 	}
 	
 	NSMutableArray* keywords = [[NSMutableArray alloc] init];
-	Exiv2::IptcData::iterator end = iptcData.end();
-	for(Exiv2::IptcData::iterator md = iptcData.begin(); md != end; ++md)
+	std::pair<Exiv2::IptcData::iterator, Exiv2::IptcData::iterator> range =
+		iptcData.equalRange(Exiv2::IptcDataSets::Keywords);
+	for(Exiv2::IptcData::iterator md = range.first; md != range.second; ++md)
 	{
-		if(md->tagName() == "Keywords")
-		{
-			// This entry is a keyword. Add it to our list.
-			const char* keyVal = md->value().toString().c_str();
-			NSString* keyword = [NSString stringWithUTF8String:keyVal];
-			[keywords addObject:keyword];
-		}
+		string keyVal = md->value().toString();
+		NSString* keyword = [NSString stringWithUTF8String:keyVal.c_str()];
+		[keywords addObject:keyword];
 	}
 
 	return [keywords autorelease];
@@ -80,30 +79,32 @@ using namespace std;
 	NSFileManager* fm = [NSFileManager defaultManager];
 	NSDictionary* attributes = [fm fileAttributesAtPath:file traverseLink:YES];
 	
+	// Open the file once. The image keeps it open and remembers where the
+	// metadata is, so writing below doesn't open and scan it again.
+	Exiv2::Image::AutoPtr image =
+		Exiv2::ImageFactory::instance().open([file fileSystemRepresentation]);
+	if(image.get() == 0)
+		return;
+	
 	// Read the IPTC data for the file. We don't want to clobber other
 	// metadata.
 	Exiv2::IptcData iptcData;
 	// Ignore return value. Doesn't matter if there is no IPTC data...
-	iptcData.read([file fileSystemRepresentation]);
-	
-	// Second, go through and remove all keyword entries
-	Exiv2::IptcKey keywordsKey("Iptc.Application2.Keywords");
-	Exiv2::IptcData::iterator keywordIter;
-	while((keywordIter = iptcData.findKey(keywordsKey)) != iptcData.end())
-		iptcData.erase(keywordIter);
+	iptcData.read(*image);
 	
-	// Now, add all keywords
+	// Replace all keyword entries with the new keywords in one pass
+	vector<string> values;
+	values.reserve([keywords count]);
 	NSEnumerator* e = [keywords objectEnumerator];
 	NSString* keyword;
 	while(keyword = [e nextObject])
-	{
-		Exiv2::Value::AutoPtr v = Exiv2::Value::create(Exiv2::string);
-		v->read([keyword UTF8String]);
-		iptcData.add(keywordsKey, v.get());
-	}
+		values.push_back([keyword UTF8String]);
+	iptcData.replaceAll(Exiv2::IptcDataSets::Keywords,
+						Exiv2::IptcDataSets::application2, values);
 	
-	// write to file.
-	iptcData.write([file fileSystemRepresentation]);
+	// write to file. Reserve some space so that later keyword edits can
+	// update the file in place instead of rewriting it.
+	iptcData.write(*image, 1024);
 	
 	// Restore the creation time
 	NSDictionary* creationDictionary = 